@@ -0,0 +1,217 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include "commandLine.h"
+#include "search.h"
+
+using namespace std;
+
+// Fixed positions used to compare search changes: openings, middlegames and endgames
+const vector<string> BENCH_FENS = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP1B1PPP/R2QKB1R w KQ - 0 8",
+    "2r3k1/pp3ppp/4p3/3n4/3P4/P3BP2/1P3P1P/2R3K1 b - - 0 25",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "8/8/4k3/8/2p5/8/B2K4/8 w - - 0 1",
+};
+
+inline uint64_t benchNodes(const SearchOptions &options, int depth, double &seconds, uint64_t &previousDepthNodes)
+{
+    uint64_t total = 0;
+    seconds = 0;
+    previousDepthNodes = 0; // Nodes to finish depth - 1, for the effective branching factor
+    for (const string &fen : BENCH_FENS)
+    {
+        Position pos;
+        pos.setFen(fen);
+        Search search;
+        search.options = options;
+        SearchLimits limits;
+        limits.depth = depth;
+        search.onIteration = [&](const SearchResult &iteration)
+        {
+            if (iteration.depth == depth - 1)
+                previousDepthNodes += iteration.nodes;
+        };
+        SearchResult result = search.think(pos, limits);
+        total += result.nodes;
+        seconds += result.seconds;
+    }
+    return total;
+}
+
+struct BenchConfig
+{
+    string name;
+    SearchOptions options;
+};
+
+// Searches the bench positions to a fixed depth once per configuration and compares node counts
+inline void runBenchComparison(const string &title, const vector<BenchConfig> &configs, int depth)
+{
+    cout << title << ": " << BENCH_FENS.size() << " positions, depth " << depth << "\n";
+    uint64_t baseline = 0;
+    for (const BenchConfig &config : configs)
+    {
+        double seconds = 0;
+        uint64_t previousDepthNodes = 0;
+        uint64_t nodes = benchNodes(config.options, depth, seconds, previousDepthNodes);
+        if (!baseline)
+            baseline = nodes;
+        cout << left << setw(22) << config.name << right << setw(14) << nodes << " nodes"
+             << setw(9) << fixed << setprecision(1) << 100.0 * nodes / baseline << "%"
+             << setw(9) << setprecision(2) << seconds << " s"
+             << setw(8) << (previousDepthNodes ? double(nodes) / previousDepthNodes : 0.0) << " EBF\n";
+    }
+}
+
+// Enables the move ordering heuristics one at a time
+inline int runOrderingBench(int depth)
+{
+    vector<BenchConfig> configs(6);
+    configs[0].name = "raster order";
+    configs[0].options.ordering = {false, false, false, false, false};
+    configs[1].name = "+ hash move";
+    configs[1].options.ordering = {true, false, false, false, false};
+    configs[2].name = "+ MVV-LVA captures";
+    configs[2].options.ordering = {true, true, false, false, false};
+    configs[3].name = "+ killers";
+    configs[3].options.ordering = {true, true, true, false, false};
+    configs[4].name = "+ history";
+    configs[4].options.ordering = {true, true, true, true, false};
+    configs[5].name = "+ SEE (bad caps last)";
+    configs[5].options.ordering = {true, true, true, true, true};
+    runBenchComparison("Move ordering bench", configs, depth);
+    return 0;
+}
+
+// Compares static leaves with quiescence search, with and without SEE pruning
+inline int runQuiescenceBench(int depth)
+{
+    vector<BenchConfig> configs(3);
+    configs[0].name = "static leaves";
+    configs[0].options.quiescence = false;
+    configs[1].name = "quiescence";
+    configs[1].options.seePruning = false;
+    configs[2].name = "+ SEE pruning";
+    runBenchComparison("Quiescence bench", configs, depth);
+    return 0;
+}
+
+// Turns on the selective search techniques one at a time, starting from a full-width search
+inline int runSelectivityBench(int depth)
+{
+    vector<BenchConfig> configs(6);
+    configs[0].name = "full width";
+    configs[0].options.checkExtensions = false;
+    configs[0].options.nullMove = false;
+    configs[0].options.lateMoveReductions = false;
+    configs[0].options.reverseFutility = false;
+    configs[0].options.futility = false;
+    configs[1] = configs[0];
+    configs[1].name = "+ check extensions";
+    configs[1].options.checkExtensions = true;
+    configs[2] = configs[1];
+    configs[2].name = "+ null move";
+    configs[2].options.nullMove = true;
+    configs[3] = configs[2];
+    configs[3].name = "+ late move reductions";
+    configs[3].options.lateMoveReductions = true;
+    configs[4] = configs[3];
+    configs[4].name = "+ reverse futility";
+    configs[4].options.reverseFutility = true;
+    configs[5] = configs[4];
+    configs[5].name = "+ futility";
+    configs[5].options.futility = true;
+    runBenchComparison("Selective search bench", configs, depth);
+    return 0;
+}
+
+// "chess bench [depth] [--expect nodes]": searches every bench position to a fixed depth with
+// the default options and prints nodes, time and nodes per second. Each position starts from a
+// fresh search with its own table, so the total node count depends only on the search code and
+// serves as its signature: a pure speed change must leave it alone.
+inline int runSearchBench(const CommandArgs &args)
+{
+    long long depth = 11;
+    if (!args.positional.empty() && !parseIntArgument("depth", args.positional[0], 1, MAX_PLY - 1, depth))
+    {
+        cerr << "Usage: chess bench [depth] [--expect nodes]" << endl;
+        return 1;
+    }
+    uint64_t totalNodes = 0;
+    double seconds = 0;
+    for (size_t i = 0; i < BENCH_FENS.size(); i++)
+    {
+        Position pos;
+        pos.setFen(BENCH_FENS[i]);
+        Search search;
+        SearchLimits limits;
+        limits.depth = depth;
+        auto start = chrono::steady_clock::now(); // Allocating the table is left out
+        SearchResult result = search.think(pos, limits);
+        seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        totalNodes += result.nodes;
+        cout << "Position " << setw(2) << i + 1 << "/" << BENCH_FENS.size() << setw(12) << result.nodes << " nodes  "
+             << left << setw(7) << (result.bestMove == MOVE_NONE ? "-" : pos.moveToSan(result.bestMove)) << right
+             << BENCH_FENS[i] << "\n";
+    }
+
+    cout << "===========================\n"
+         << "Depth           : " << depth << "\n"
+         << "Total time (ms) : " << uint64_t(seconds * 1000) << "\n"
+         << "Nodes searched  : " << totalNodes << "\n"
+         << "Nodes/second    : " << uint64_t(totalNodes / max(seconds, 1e-9)) << endl;
+
+    if (args.has("expect") && args.getString("expect", "") != to_string(totalNodes))
+    {
+        cerr << "Error: bench signature " << totalNodes << " does not match the expected " << args.getString("expect", "") << endl;
+        return 1;
+    }
+    return 0;
+}
+
+struct PerftCase
+{
+    string fen;
+    int depth;
+    uint64_t nodes; // Published leaf count
+};
+
+// Standard move generator test positions: castling, en passant, promotions and pins
+const vector<PerftCase> PERFT_CASES = {
+    {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5, 4865609},
+    {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4, 4085603},
+    {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6, 11030083},
+    {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4, 422333},
+    {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4, 2103487},
+    {"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4, 3894594},
+};
+
+inline int runPerftBench() // Checks the move generator against known counts and reports its speed
+{
+    uint64_t totalNodes = 0;
+    double totalSeconds = 0;
+    bool allMatch = true;
+    for (const PerftCase &test : PERFT_CASES)
+    {
+        Position pos;
+        pos.setFen(test.fen);
+        auto start = chrono::steady_clock::now();
+        uint64_t nodes = perft(pos, test.depth);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        totalNodes += nodes;
+        totalSeconds += seconds;
+        allMatch &= nodes == test.nodes;
+        cout << left << setw(76) << test.fen << right << " depth " << test.depth << setw(12) << nodes
+             << (nodes == test.nodes ? "  ok  " : "  MISMATCH ") << fixed << setprecision(2) << setw(7) << seconds << " s" << endl;
+    }
+    cout << "Total " << totalNodes << " nodes in " << setprecision(2) << totalSeconds << " s, "
+         << setprecision(0) << totalNodes / totalSeconds << " nodes/s" << endl;
+    return allMatch ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "chessBoard.h"
+#include "position.h"
+
+using namespace std;
+
+// Helpers for keeping an engine Position and a ChessBoard in step. ChessBoard stays the
+// authority on the rules; Position is what the engine searches.
+
+inline Position positionFromBoard(ChessBoard &board, bool isWhiteTurn)
+{
+    Position pos;
+    pos.setFen(board.toFen(isWhiteTurn)); // ChessBoard promotes on arrival, so its FEN always parses
+    return pos;
+}
+
+inline bool parseBoardUci(const string &uci, int &fromX, int &fromY, int &toX, int &toY) // "e2e4" -> ChessBoard coordinates
+{
+    if (uci.size() < 4 || uci[0] < 'a' || uci[0] > 'h' || uci[2] < 'a' || uci[2] > 'h' ||
+        uci[1] < '1' || uci[1] > '8' || uci[3] < '1' || uci[3] > '8')
+        return false;
+    fromX = uci[0] - 'a';
+    fromY = '8' - uci[1];
+    toX = uci[2] - 'a';
+    toY = '8' - uci[3];
+    return true;
+}
+
+inline string boardUci(int fromX, int fromY, int toX, int toY)
+{
+    return squareName(fromY * 8 + fromX) + squareName(toY * 8 + toX);
+}
+
+inline bool playOnBoard(ChessBoard &board, Move m) // Validates and plays an engine move with the ChessBoard rules
+{
+    return board.applyMove(squareX(moveFrom(m)), squareY(moveFrom(m)), squareX(moveTo(m)), squareY(moveTo(m)));
+}
+
+// Legal moves the ChessBoard rules also accept: ChessBoard always promotes to a queen and
+// only allows en passant directly after a plain double push
+inline vector<Move> boardCompatibleMoves(const Position &pos, const ChessBoard &board)
+{
+    MoveList list;
+    pos.generateLegal(list);
+    vector<Move> moves;
+    for (int i = 0; i < list.size; i++)
+    {
+        Move m = list.moves[i].move;
+        if (moveFlag(m) == PROMOTION && movePromotion(m) != QUEEN)
+            continue;
+        if (moveFlag(m) == EN_PASSANT)
+        {
+            ChessBoard probe = board; // isValidMove plays the capture itself
+            if (!probe.isValidMove(squareX(moveFrom(m)), squareY(moveFrom(m)), squareX(moveTo(m)), squareY(moveTo(m))))
+                continue;
+        }
+        moves.push_back(m);
+    }
+    return moves;
+}
@@ -4,21 +4,36 @@
 #include <SFML/Graphics.hpp>
 #include <cmath>
 #include <map>
+#include "chessBoard.h"
+#include "movePrecompute.h"
+#include "engineWorker.h"
+#include "bench.h"
+#include "gameHost.h"
+#include "match.h"
+#include "gameDb.h"
+#include "explorer.h"
+#include "microbench.h"
+#include "loadTest.h"
+#include "remoteOpponent.h"
+#include "datagen.h"
+#include "inputReplay.h"
+#include "mateSolver.h"
+#include "gameAnalysis.h"
+#include "spectator.h"
+#include "gameJournal.h"
+#include "distributed.h"
 
 using namespace std;
 using namespace sf;
 
 // Constants
-const int SIZE = 8;            // Size of the chess board
 const int TILE_SIZE = 64;      // Size of each tile
 const int SIDEBAR_WIDTH = 150; // Width of the moves table sidebar
 const int colLabelHeight = TILE_SIZE / 4;
 const int rowLabelWidth = TILE_SIZE / 4;
 const int WINDOW_WIDTH = SIZE * TILE_SIZE + rowLabelWidth + SIDEBAR_WIDTH;
 const int WINDOW_HEIGHT = SIZE * TILE_SIZE + colLabelHeight;
-const size_t MAX_VISIBLE_MOVES = 24;     // Maximum number of moves to display in the sidebar
-bool isWhiteTurn = true;                 // True for white's turn, false for black's turn
-vector<pair<Vector2i, Vector2i>> arrows; // To store the arrows drawn by the user
+const size_t MAX_VISIBLE_MOVES = 24; // Number of move rows that fit in the sidebar
 const float PI = 3.14159265358979323846;
 
 enum GameState
@@ -27,757 +42,574 @@ enum GameState
     PLAYING,
     EXIT
 };
-GameState currentState = MENU;
 
 void loadResources(map<string, Texture> &textures, map<string, Font> &fonts);
-void drawMenu(RenderWindow &window, map<string, Texture> &textures, map<string, Font> &fonts);
-
-class Piece // Represents a chess piece
-{
-public:
-    string type;  // "P", "R", "N", "B", "Q", "K"
-    bool isWhite; // true for white, false for black
-
-    Piece(string type = " ", bool isWhite = false) : type(type), isWhite(isWhite) {}
-    bool isEmpty() // Check if the piece is empty
-    {
-        return type == " ";
-    }
-};
-
-class Square // Represents a square on the chess board
-{
-public:
-    Piece piece;
-    Square(Piece piece = Piece()) : piece(piece) {} // Initialize the square with a piece
-};
-
-class ChessBoard // Represents the chess board
+struct LayerCache // Part of the window that rarely changes, drawn once offscreen and then composited as one quad
 {
-private:
-    bool hasWhiteKingMoved = false;
-    bool hasBlackKingMoved = false;
-    bool hasWhiteRookMoved[2] = {false, false}; // [0] for queenside, [1] for kingside
-    bool hasBlackRookMoved[2] = {false, false}; // [0] for queenside, [1] for kingside
-
-    vector<vector<Square>> board;
-    bool didWEnPassant = false; // Check if white did en passant
-    bool didBEnPassant = false; // Check if black did en passant
-
-public:
-    string lastMove = "";               // Store the last move
-    string backupLastMove = "";         // Store the last move before simulation
-    vector<vector<Square>> backupBoard; // Store the board before simulation
-
-    ChessBoard() // Initialize the board
-    {
-        board.resize(SIZE, vector<Square>(SIZE, Square()));
-        initializeBoard();
-    }
+    RenderTexture texture;
+    FloatRect area;            // Window region the layer covers
+    Color background;          // Opaque, so text edges blend as they would on the window
+    bool isValid = false;      // Cleared when the content changes
+    bool isAvailable = true;   // False if offscreen rendering is unsupported; the layer is then drawn directly
 
-    void resetBoard()
-    {
-        board.resize(SIZE, vector<Square>(SIZE, Square()));
-        initializeBoard();
-        hasWhiteKingMoved = false;
-        hasBlackKingMoved = false;
-        hasWhiteRookMoved[0] = false;
-        hasWhiteRookMoved[1] = false;
-        hasBlackRookMoved[0] = false;
-        hasBlackRookMoved[1] = false;
-        didWEnPassant = false;
-        didBEnPassant = false;
-        lastMove = "";
-        backupLastMove = "";
-    }
+    LayerCache(FloatRect area, Color background) : area(area), background(background) {}
 
-    void initializeBoard() // Set up the board with pieces
+    template <typename DrawLayer>
+    void draw(RenderTarget &target, DrawLayer drawLayer) // drawLayer draws in window coordinates
     {
-        // place pawns
-        for (int x = 0; x < SIZE; x++)
+        if (!isValid && isAvailable)
         {
-            board[1][x].piece = {"P", false}; // black pawns
-            board[6][x].piece = {"P", true};  // white pawns
+            if (texture.getSize().x != unsigned(area.width) || texture.getSize().y != unsigned(area.height))
+                isAvailable = texture.create(unsigned(area.width), unsigned(area.height));
+            if (isAvailable)
+            {
+                texture.setView(View(area));
+                texture.clear(background);
+                drawLayer(texture);
+                texture.display();
+                isValid = true;
+            }
         }
-
-        // Place other pieces
-        string order = "RNBQKBNR";
-        for (int x = 0; x < SIZE; x++)
+        if (!isAvailable)
         {
-            board[0][x].piece = Piece(string(1, order[x]), false); // Black pieces
-            board[7][x].piece = Piece(string(1, order[x]), true);  // White pieces
+            drawLayer(target);
+            return;
         }
+        Sprite layer(texture.getTexture());
+        layer.setPosition(area.left, area.top);
+        target.draw(layer);
     }
+};
 
-    Square &getSquare(int y, int x) // Get the square at position (x, y)
-    {
-        return board[y][x];
-    }
+void drawMenuScreen(RenderTarget &window, map<string, Texture> &textures, map<string, Font> &fonts);
 
-    bool isValidTile(int x, int y) // Check if the tile is within the board
-    {
-        return x >= 0 && x < SIZE && y >= 0 && y < SIZE;
-    }
+const int labelFontSize = 10;                 // Font Size for cols/rows labels
+const int sideBarFontSize = 16;               // Font Size for sidebar
+const float historyColumns[3] = {10, 42, 94}; // Sidebar x offsets of the move number, white and black moves
+const auto LOGIC_TICK = chrono::milliseconds(4); // Input and game updates run at 250 Hz, independent of drawing
 
-    bool isSameColor(Piece piece1, Piece piece2) // Check if two pieces are of the same color
-    {
-        if (piece2.isEmpty())
-            return false;
-        return (piece1.isWhite == piece2.isWhite);
-    }
+inline FloatRect analyzeButtonArea() // Below the "Game Over" text
+{
+    return FloatRect(TILE_SIZE * SIZE / 2 - 70, TILE_SIZE * SIZE / 2 + 30, 140, 36);
+}
 
-    string toAlgebraic(int x, int y) // Convert board coordinates to algebraic notation (e.g., (0, 0) -> "a8")
-    {
-        return string(1, char('a' + x)) + to_string(8 - y);
-    }
+struct HistoryCell // One label of the move list
+{
+    string label;
+    int row;        // Counted from the first row in view
+    int column;     // 0 move number, 1 white, 2 black
+    Color color;
+    bool isCurrent; // The move that led to the board shown
+};
 
-    bool isKingInCheck(bool isWhite)
-    {
-        int kingX = -1, kingY = -1;
+// Everything one frame shows, copied out of the Game. The game thread fills one per update
+// and hands it over through a Mailbox; the render thread draws the newest one without ever
+// touching the Game, so a slow rules check delays the next snapshot, never a frame.
+struct FrameSnapshot
+{
+    GameState state = MENU;
+    uint64_t layoutVersion = 0;   // Changes after a resize or when the sidebar switches; every cached layer is redrawn
+    uint64_t sidebarVersion = 0;  // Changes with the move list or explorer
+    string pieceKeys[SIZE][SIZE]; // Texture of the piece on each square, e.g. "WN"; empty if none
+    uint64_t checkedKings = 0;    // Squares (y * 8 + x) of kings in check
+    bool isDragging = false;
+    int selectedTileX = -1, selectedTileY = -1;
+    Sprite draggedPieceSprite;
+    vector<pair<int, int>> validMoves;
+    vector<pair<Vector2i, Vector2i>> arrows;
+    bool isDrawingArrow = false;
+    Vector2i arrowStart, arrowEnd;
+    bool showExplorer = false;
+    vector<HistoryCell> historyCells; // Only the rows in view
+    size_t historyRowCount = 0, visibleHistoryRows = 0, historyScroll = 0;
+    vector<pair<string, ExplorerMove>> explorerMoves; // Only the rows that fit
+    bool hasEngine = false, hasEngineReport = false, isEngineTurn = false;
+    EngineReport engineReport;
+    bool hasMateLine = false;
+    string mateLine;
+    bool hasAnalysisLine = false;
+    string analysisLine;
+    bool hasRemote = false;
+    string remoteStatus;
+    bool isGameOver = false, showAnalyzeButton = false;
+};
 
-        // Find the king's position
-        for (int y = 0; y < SIZE; y++)
+class FrameRenderer // Draws snapshots; owns the cached layers, so it lives on the thread that draws
+{
+public:
+    void draw(RenderTarget &window, const FrameSnapshot &frame, map<string, Texture> &textures, map<string, Font> &fonts)
+    {
+        if (frame.layoutVersion != layoutVersion) // Resized, or the sidebar switched between move list and explorer
         {
-            for (int x = 0; x < SIZE; x++)
-            {
-                if (board[y][x].piece.isEmpty())
-                    continue;
-                Piece &piece = board[y][x].piece;
-                if (piece.type == "K" && piece.isWhite == isWhite)
-                {
-                    kingX = x;
-                    kingY = y;
-                    break;
-                }
-            }
+            layoutVersion = frame.layoutVersion;
+            menuLayer.isValid = chromeLayer.isValid = sidebarLayer.isValid = false;
         }
-
-        // Ensure the king's position is valid
-        if (kingX == -1 || kingY == -1)
+        if (frame.sidebarVersion != sidebarVersion)
         {
-            cerr << "Error: King not found on board. Invalid state.\n";
-            return true; // Assume check if king is missing
+            sidebarVersion = frame.sidebarVersion;
+            sidebarLayer.isValid = false;
         }
+        if (frame.state == MENU)
+        {
+            menuLayer.draw(window, [&](RenderTarget &layer)
+                           { drawMenuScreen(layer, textures, fonts); }); // The whole menu is static
+            return;
+        }
+        if (frame.state != PLAYING)
+            return;
 
-        string backupLastMove = lastMove; // Backup lastMove before simulation
-        backupBoard = board;              // Backup the board before simulation
-        bool isUnderCheck = false;
+        // Static parts first, each redrawn only when invalidated
+        chromeLayer.draw(window, [&](RenderTarget &layer)
+                         { drawChrome(layer, frame, textures, fonts); });
+        sidebarLayer.draw(window, [&](RenderTarget &layer)
+                          {
+            if (frame.showExplorer)
+                drawExplorer(layer, frame, fonts);
+            else
+                drawMoveHistory(layer, frame, fonts); });
 
-        // Check if any opponent piece can attack the king
+        // Draw pieces
         for (int y = 0; y < SIZE; y++)
         {
             for (int x = 0; x < SIZE; x++)
             {
-                if (board[y][x].piece.isEmpty())
-                    continue;
-                Piece &piece = board[y][x].piece;
-                if (!piece.isEmpty() && piece.isWhite != isWhite)
+                // Skip the dragged piece
+                const string &textureKey = frame.pieceKeys[y][x];
+                if (!(frame.isDragging && frame.selectedTileX == x && frame.selectedTileY == y) && !textureKey.empty())
                 {
-                    bool tempCheck = false, tempCheckmate = false;
-                    if (isValidMove(x, y, kingX, kingY, tempCheck, tempCheckmate, true, true))
-                    {
-                        isUnderCheck = true;
-                        break;
-                    }
+                    Sprite sprite;
+                    sprite.setTexture(textures[textureKey]);
+                    sprite.setPosition(x * TILE_SIZE, y * TILE_SIZE);
+                    sprite.setScale(0.5f, 0.5f);
+                    window.draw(sprite);
                 }
-            }
-        }
-
-        // Restore state before returning
-        lastMove = backupLastMove;
-        board = backupBoard;
-        return isUnderCheck;
-    }
-
-    bool isCheckmate(bool isWhite)
-    {
-        // Check if the king is in check
-        if (!isKingInCheck(isWhite))
-            return false;
-
-        string backupLastMove = lastMove; // Backup lastMove before simulation
-        backupBoard = board;              // Backup the board before simulation
 
-        // Iterate through all squares to find pieces of the current player
-        for (int y = 0; y < SIZE; y++)
-        {
-            for (int x = 0; x < SIZE; x++)
-            {
-                if (board[y][x].piece.isEmpty())
-                    continue;
-                Piece &piece = board[y][x].piece;
-                if (!piece.isEmpty() && piece.isWhite == isWhite)
+                // Highlight king in check or checkmate
+                if (frame.checkedKings >> (y * SIZE + x) & 1)
                 {
-                    // Check if this piece has any valid moves
-                    for (int toY = 0; toY < SIZE; toY++)
-                    {
-                        for (int toX = 0; toX < SIZE; toX++)
-                        {
-                            bool tempCheck = false, tempCheckmate = false;
-                            if (isValidMove(x, y, toX, toY, tempCheck, tempCheckmate, true))
-                            {
-                                lastMove = backupLastMove; // Restore lastMove
-                                board = backupBoard;       // Restore the board
-                                return false;              // The player has at least one valid move
-                            }
-                        }
-                    }
+                    CircleShape outline(TILE_SIZE / 2.5f);          // Circle size matches piece size
+                    outline.setFillColor(Color::Transparent);       // No fill
+                    outline.setOutlineColor(Color(255, 0, 0, 128)); // Semi-transparent red
+                    outline.setOutlineThickness(4.0f);              // Thickness of the outline
+                    outline.setPosition(
+                        x * TILE_SIZE + TILE_SIZE / 2.0f - outline.getRadius(),
+                        y * TILE_SIZE + TILE_SIZE / 2.0f - outline.getRadius());
+                    window.draw(outline);
                 }
             }
         }
-        // Restore state before returning checkmate status
-        lastMove = backupLastMove; // Restore lastMove
-        board = backupBoard;       // Restore the board
-        return true;               // If no valid moves exist, it's a checkmate
-    }
 
-    bool isValidPawnMove(int fromX, int fromY, int toX, int toY, bool isWhite, string &lastMove, bool &didWEnPassant, bool &didBEnPassant, bool isDrawingMoves)
-    {
-        int direction = isWhite ? -1 : 1;
-        int startRow = isWhite ? 6 : 1;
+        float buttonHeight = 40;
+        float buttonX = SIZE * TILE_SIZE + rowLabelWidth + 10;
+        float buttonY = WINDOW_HEIGHT - buttonHeight - 10;
 
-        // Single square move
-        if (toX == fromX && toY == fromY + direction && board[toY][toX].piece.isEmpty())
+        if (frame.hasEngine)
         {
-            if (!isDrawingMoves)
-            {
-                lastMove = toAlgebraic(toX, toY);
-            }
-            return true;
+            drawEnginePanel(window, frame, fonts);
         }
 
-        // Double square move from starting position
-        if (toX == fromX && toY == fromY + 2 * direction && fromY == startRow &&
-            board[toY][toX].piece.isEmpty() && board[fromY + direction][toX].piece.isEmpty())
+        // Mate solver result just above the button
+        if (frame.hasMateLine)
         {
-            if (!isDrawingMoves)
-            {
-                lastMove = toAlgebraic(toX, toY);
-            }
-            return true;
+            RectangleShape background(Vector2f(SIDEBAR_WIDTH, 18));
+            background.setFillColor(Color(220, 220, 220));
+            background.setPosition(SIZE * TILE_SIZE + rowLabelWidth, buttonY - 22);
+            window.draw(background);
+            Text mateText;
+            mateText.setFont(fonts["arial"]);
+            mateText.setString(frame.mateLine);
+            mateText.setCharacterSize(11);
+            mateText.setFillColor(Color::Black);
+            mateText.setPosition(buttonX, buttonY - 20);
+            window.draw(mateText);
         }
 
-        // Capture
-        if (abs(toX - fromX) == 1 && toY == fromY + direction && !board[toY][toX].piece.isEmpty() &&
-            !isSameColor(board[fromY][fromX].piece, board[toY][toX].piece))
+        // Game analysis above the mate solver line
+        if (frame.hasAnalysisLine)
         {
-            if (!isDrawingMoves)
-            {
-                lastMove = string(1, char(fromX + 'a')) + "x" + toAlgebraic(toX, toY);
-            }
-            return true;
+            float y = buttonY - 22 - (frame.hasMateLine ? 18 : 0);
+            RectangleShape background(Vector2f(SIDEBAR_WIDTH, 18));
+            background.setFillColor(Color(220, 220, 220));
+            background.setPosition(SIZE * TILE_SIZE + rowLabelWidth, y);
+            window.draw(background);
+            Text analysisText;
+            analysisText.setFont(fonts["arial"]);
+            analysisText.setString(frame.analysisLine);
+            analysisText.setCharacterSize(11);
+            analysisText.setFillColor(Color::Black);
+            analysisText.setPosition(buttonX, y + 2);
+            window.draw(analysisText);
         }
 
-        // En passant
-        if (abs(toX - fromX) == 1 && toY == fromY + direction && board[toY][toX].piece.isEmpty())
+        // Draw the online game status above the button
+        if (frame.hasRemote)
         {
-            string expectedLastMove = toAlgebraic(toX, fromY);
-            if (lastMove == expectedLastMove && board[fromY][toX].piece.type == "P" && board[fromY][toX].piece.isWhite != isWhite && (isWhite ? expectedLastMove[1] == '5' : expectedLastMove[1] == '4'))
-            {
-
-                if (!isDrawingMoves)
-                {
-                    if (isWhite)
-                        didWEnPassant = true;
-                    else
-                        didBEnPassant = true;
-                    lastMove = string(1, char(fromX + 'a')) + "x" + toAlgebraic(toX, toY);
-                    board[fromY][toX].piece = Piece(); // Capture the pawn
-                }
-                return true;
-            }
+            Text statusText;
+            statusText.setFont(fonts["arial"]);
+            statusText.setString(frame.remoteStatus);
+            statusText.setCharacterSize(12);
+            statusText.setFillColor(Color::Black);
+            statusText.setPosition(buttonX, buttonY - 36);
+            window.draw(statusText);
         }
 
-        return false;
-    }
-
-    bool isValidRookMove(int fromX, int fromY, int toX, int toY, bool isWhite, string &lastMove)
-    {
-        // Rook can only move horizontally or vertically
-        if (fromX != toX && fromY != toY)
-            return false;
-
-        // Check if the path is clear
-        if (!isPathClear(fromX, fromY, toX, toY))
-            return false;
-
-        // Check if the destination square contains a piece of the same color
-        if (isSameColor(board[fromY][fromX].piece, board[toY][toX].piece))
-            return false;
-
-        // Detect ambiguity
-        auto [requiresFile, requiresRank] = detectAmbiguity(fromX, fromY, toX, toY, 'R', isWhite);
-
-        // Construct disambiguation
-        string disambiguation = "";
-        if (requiresFile && requiresRank)
-        {
-            // Include both file and rank when full ambiguity exists
-            disambiguation = toAlgebraic(toX, toY);
-        }
-        else if (requiresFile)
+        // Draw valid moves highlights
+        for (auto &move : frame.validMoves)
         {
-            // Include only the file when rank is not ambiguous
-            disambiguation = string(1, char(fromX + 'a'));
+            CircleShape highlight(TILE_SIZE / 16.0f);
+            highlight.setFillColor(Color(0, 255, 0, 128));
+            highlight.setPosition(move.first * TILE_SIZE + TILE_SIZE / 2.0f - highlight.getRadius(),
+                                  move.second * TILE_SIZE + TILE_SIZE / 2.0f - highlight.getRadius());
+            window.draw(highlight);
         }
-        else if (requiresRank)
+
+        // Draw dragged piece on top
+        if (frame.isDragging)
         {
-            // Include only the rank when file is not ambiguous
-            disambiguation = to_string(8 - fromY);
+            window.draw(frame.draggedPieceSprite);
         }
 
-        // Determine capture notation
-        string capture = board[toY][toX].piece.isEmpty() ? "" : "x";
-
-        // Construct the move notation
-        lastMove = "R" + disambiguation + capture + toAlgebraic(toX, toY);
-
-        return true;
-    }
-
-    bool isValidKnightMove(int fromX, int fromY, int toX, int toY, bool isWhite, string &lastMove)
-    {
-        // Knight can only move in an L-shape
-        if (abs(fromX - toX) * abs(fromY - toY) != 2)
-            return false;
-
-        // Check if the destination square contains a piece of the same color
-        if (isSameColor(board[fromY][fromX].piece, board[toY][toX].piece))
-            return false;
-
-        // Detect ambiguity
-        auto [requiresFile, requiresRank] = detectAmbiguity(fromX, fromY, toX, toY, 'N', isWhite);
+        // Draw arrows
+        drawArrows(window, frame);
 
-        // Construct disambiguation
-        string disambiguation = "";
-        if (requiresFile && requiresRank)
-        {
-            // Include both file and rank if necessary
-            disambiguation = toAlgebraic(toX, toY);
-        }
-        else if (requiresFile)
-        {
-            // Include only the file
-            disambiguation = string(1, char(fromX + 'a'));
-        }
-        else if (requiresRank)
+        // Highlight game-over state
+        if (frame.isGameOver)
         {
-            // Include only the rank
-            disambiguation = to_string(8 - fromY);
-        }
-
-        // Determine capture notation
-        string capture = board[toY][toX].piece.isEmpty() ? "" : "x";
+            RectangleShape overlay(Vector2f(TILE_SIZE * SIZE + rowLabelWidth, WINDOW_HEIGHT));
+            overlay.setFillColor(Color(0, 0, 0, 150)); // Semi-transparent black overlay
+            window.draw(overlay);
 
-        // Construct move notation
-        lastMove = "N" + disambiguation + capture + toAlgebraic(toX, toY);
+            Text gameOverText;
+            gameOverText.setFont(fonts["arial"]);
+            gameOverText.setString("Game Over");
+            gameOverText.setCharacterSize(32);
+            gameOverText.setFillColor(Color::White);
+            gameOverText.setPosition(TILE_SIZE * SIZE / 2 - 80, TILE_SIZE * SIZE / 2 - 20);
+            window.draw(gameOverText);
 
-        return true;
+            if (frame.showAnalyzeButton)
+            {
+                FloatRect area = analyzeButtonArea();
+                RectangleShape analyzeButton(Vector2f(area.width, area.height));
+                analyzeButton.setFillColor(Color(200, 200, 200));
+                analyzeButton.setOutlineColor(Color::Black);
+                analyzeButton.setOutlineThickness(2.0f);
+                analyzeButton.setPosition(area.left, area.top);
+                window.draw(analyzeButton);
+
+                Text analyzeText;
+                analyzeText.setFont(fonts["arial"]);
+                analyzeText.setString("Analyze game");
+                analyzeText.setCharacterSize(16);
+                analyzeText.setFillColor(Color::Black);
+                FloatRect textRect = analyzeText.getLocalBounds();
+                analyzeText.setOrigin(textRect.left + textRect.width / 2.0f, textRect.top + textRect.height / 2.0f);
+                analyzeText.setPosition(area.left + area.width / 2.0f, area.top + area.height / 2.0f);
+                window.draw(analyzeText);
+            }
+        }
     }
 
-    bool isValidBishopMove(int fromX, int fromY, int toX, int toY, bool isWhite, string &lastMove)
+    void drawChrome(RenderTarget &window, const FrameSnapshot &frame, map<string, Texture> &textures, map<string, Font> &fonts) // Everything that only changes on resize or when the sidebar switches
     {
-        // Bishop can only move diagonally
-        if (abs(fromX - toX) != abs(fromY - toY))
-            return false;
-
-        // Check if the path is clear
-        if (!isPathClear(fromX, fromY, toX, toY))
-            return false;
-
-        // Check if the destination square contains a piece of the same color
-        if (isSameColor(board[fromY][fromX].piece, board[toY][toX].piece))
-            return false;
-
-        // Detect ambiguity
-        auto [requiresFile, requiresRank] = detectAmbiguity(fromX, fromY, toX, toY, 'B', isWhite);
-
-        // Construct disambiguation
-        string disambiguation = "";
-        if (requiresFile && requiresRank)
-        {
-            // Include both file and rank if necessary
-            disambiguation = toAlgebraic(toX, toY);
-        }
-        else if (requiresFile)
-        {
-            // Include only the file
-            disambiguation = string(1, char(fromX + 'a'));
-        }
-        else if (requiresRank)
+        // Draw board tiles
+        for (int y = 0; y < SIZE; y++)
         {
-            // Include only the rank
-            disambiguation = to_string(8 - fromY);
+            for (int x = 0; x < SIZE; x++)
+            {
+                RectangleShape square(Vector2f(TILE_SIZE, TILE_SIZE));
+                square.setPosition(x * TILE_SIZE, y * TILE_SIZE);
+                square.setTexture((x + y) % 2 == 0 ? &textures["WS1"] : &textures["BS1"]);
+                window.draw(square);
+            }
         }
 
-        // Determine capture notation
-        string capture = board[toY][toX].piece.isEmpty() ? "" : "x";
-
-        // Construct move notation
-        lastMove = "B" + disambiguation + capture + toAlgebraic(toX, toY);
+        // Draw row and column labels
+        for (int i = 0; i < SIZE; i++)
+        {
+            // Draw column letters (a-h)
+            Text colText;
+            colText.setFont(fonts["arial"]);
+            colText.setString(string(1, char('a' + i)));
+            colText.setCharacterSize(labelFontSize);
+            colText.setFillColor(Color::White);
+            colText.setPosition(i * TILE_SIZE + TILE_SIZE / 2 - labelFontSize / 2, SIZE * TILE_SIZE + colLabelHeight / 2 - labelFontSize / 2); // Below board
+            window.draw(colText);
 
-        return true;
-    }
+            // Draw row numbers (1-8)
+            Text rowText;
+            rowText.setFont(fonts["arial"]);
+            rowText.setString(to_string(SIZE - i));
+            rowText.setCharacterSize(labelFontSize);
+            rowText.setFillColor(Color::White);
+            rowText.setPosition(SIZE * TILE_SIZE + rowLabelWidth / 2 - labelFontSize / 2, i * TILE_SIZE + TILE_SIZE / 2 - labelFontSize / 2); // Right of board
+            window.draw(rowText);
+        }
 
-    bool isValidQueenMove(int fromX, int fromY, int toX, int toY, bool isWhite, string &lastMove)
-    {
-        // Queen can move horizontally, vertically, or diagonally
-        if (fromX != toX && fromY != toY && abs(fromX - toX) != abs(fromY - toY))
-            return false;
+        // Draw move history sidebar
+        RectangleShape sidebar(Vector2f(SIDEBAR_WIDTH, SIZE * TILE_SIZE + TILE_SIZE / 4));
+        sidebar.setFillColor(Color(220, 220, 220)); // Light gray background
+        sidebar.setPosition(SIZE * TILE_SIZE + rowLabelWidth, 0);
+        window.draw(sidebar);
 
-        // Check if the path is clear
-        if (!isPathClear(fromX, fromY, toX, toY))
-            return false;
+        // Draw sidebar title
+        Text sidebarTitle;
+        sidebarTitle.setFont(fonts["arial"]);
+        sidebarTitle.setString(frame.showExplorer ? "Explorer" : "Move History");
+        sidebarTitle.setCharacterSize(sideBarFontSize);
+        sidebarTitle.setFillColor(Color::Black);
+        sidebarTitle.setPosition(SIZE * TILE_SIZE + rowLabelWidth + SIDEBAR_WIDTH / 2 - 45, 10);
+        window.draw(sidebarTitle);
 
-        // Check if the destination square contains a piece of the same color
-        if (isSameColor(board[fromY][fromX].piece, board[toY][toX].piece))
-            return false;
+        // Draw sidebar border
+        RectangleShape sidebarBorder(Vector2f(SIDEBAR_WIDTH, 2));
+        sidebarBorder.setFillColor(Color::Black);
+        sidebarBorder.setPosition(SIZE * TILE_SIZE + rowLabelWidth, 30);
+        window.draw(sidebarBorder);
 
-        // Detect ambiguity
-        auto [requiresFile, requiresRank] = detectAmbiguity(fromX, fromY, toX, toY, 'Q', isWhite);
+        // Button dimensions
+        float buttonWidth = SIDEBAR_WIDTH - 20;
+        float buttonHeight = 40;
+        float buttonX = SIZE * TILE_SIZE + rowLabelWidth + 10;
+        float buttonY = WINDOW_HEIGHT - buttonHeight - 10; // Position at the bottom
 
-        // Construct disambiguation
-        string disambiguation = "";
-        if (requiresFile && requiresRank)
-        {
-            // Include both file and rank if necessary
-            disambiguation = toAlgebraic(toX, toY);
-        }
-        else if (requiresFile)
-        {
-            // Include only the file
-            disambiguation = string(1, char(fromX + 'a'));
-        }
-        else if (requiresRank)
-        {
-            // Include only the rank
-            disambiguation = to_string(8 - fromY);
-        }
+        // Draw the button
+        RectangleShape menuButton(Vector2f(buttonWidth, buttonHeight));
+        menuButton.setFillColor(Color(200, 200, 200)); // Light gray
+        menuButton.setOutlineColor(Color::Black);
+        menuButton.setOutlineThickness(2.0f);
+        menuButton.setPosition(buttonX, buttonY);
 
-        // Determine capture notation
-        string capture = board[toY][toX].piece.isEmpty() ? "" : "x";
+        // Draw button text (smaller size and centered)
+        Text menuText;
+        menuText.setFont(fonts["arial"]);
+        menuText.setString("Return to Main Menu");
+        menuText.setCharacterSize(12); // Smaller font size
+        menuText.setFillColor(Color::Black);
 
-        // Construct move notation
-        lastMove = "Q" + disambiguation + capture + toAlgebraic(toX, toY);
+        // Center text within the button
+        FloatRect textRect = menuText.getLocalBounds();
+        menuText.setOrigin(textRect.left + textRect.width / 2.0f, textRect.top + textRect.height / 2.0f);
+        menuText.setPosition(buttonX + buttonWidth / 2.0f, buttonY + buttonHeight / 2.0f);
 
-        return true;
+        window.draw(menuButton);
+        window.draw(menuText);
     }
 
-    bool isValidKingMove(int fromX, int fromY, int toX, int toY, bool isWhite, bool &isCastling, int &rookFromX, int &rookToX)
+    void drawMoveHistory(RenderTarget &window, const FrameSnapshot &frame, map<string, Font> &fonts) // Only the rows in view are drawn
     {
-        int dx = abs(toX - fromX);
-        int dy = abs(toY - fromY);
-
-        // Normal king move
-        if (dx <= 1 && dy <= 1)
+        float left = SIZE * TILE_SIZE + rowLabelWidth;
+        float rowHeight = sideBarFontSize + 2;
+        for (const HistoryCell &cell : frame.historyCells)
         {
-            if (!isSameColor(board[fromY][fromX].piece, board[toY][toX].piece))
+            float y = 40 + cell.row * rowHeight;
+            if (cell.isCurrent) // The move that led to the board shown
             {
-                // Simulate the move
-                Piece capturedPiece = board[toY][toX].piece;
-                board[toY][toX].piece = board[fromY][fromX].piece;
-                board[fromY][fromX].piece = Piece();
-
-                bool inCheck = isKingInCheck(isWhite);
-
-                // Revert the move
-                board[fromY][fromX].piece = board[toY][toX].piece;
-                board[toY][toX].piece = capturedPiece;
-
-                // Ensure the king does not move into a square under attack
-                if (inCheck)
-                    return false;
-
-                // Update last move notation
-                if (!board[toY][toX].piece.isEmpty())        // Capture
-                    lastMove = "Kx" + toAlgebraic(toX, toY); // Example: Kxe5
-                else
-                    lastMove = "K" + toAlgebraic(toX, toY); // Example: Ke5
-
-                return true;
+                RectangleShape highlight(Vector2f(historyColumns[cell.column] - historyColumns[cell.column - 1] + 4, rowHeight));
+                highlight.setFillColor(Color(250, 210, 120));
+                highlight.setPosition(left + historyColumns[cell.column] - 2, y + 1);
+                window.draw(highlight);
             }
-            return false;
+            Text moveText;
+            moveText.setFont(fonts["arial"]);
+            moveText.setString(cell.label);
+            moveText.setCharacterSize(sideBarFontSize);
+            moveText.setFillColor(cell.color);
+            moveText.setPosition(left + historyColumns[cell.column], y);
+            window.draw(moveText);
         }
 
-        // Castling logic (unchanged)
-        if (dy == 0 && dx == 2)
+        // Scrollbar, once the game no longer fits
+        size_t rows = frame.historyRowCount, visibleRows = frame.visibleHistoryRows;
+        if (rows > visibleRows)
         {
-            bool isShortCastle = toX > fromX;
-            rookFromX = isShortCastle ? 7 : 0; // Kingside or Queenside rook position
-            rookToX = isShortCastle ? 5 : 3;   // Rook's new position during castling
-
-            // Check if the king or the rook has moved
-            if ((isWhite && hasWhiteKingMoved) || (!isWhite && hasBlackKingMoved))
-                return false;
-
-            if (isWhite)
-            {
-                if (isShortCastle && hasWhiteRookMoved[1])
-                    return false;
-                if (!isShortCastle && hasWhiteRookMoved[0])
-                    return false;
-            }
-            else
-            {
-                if (isShortCastle && hasBlackRookMoved[1])
-                    return false;
-                if (!isShortCastle && hasBlackRookMoved[0])
-                    return false;
-            }
+            float trackHeight = visibleRows * rowHeight;
+            RectangleShape thumb(Vector2f(4, trackHeight * visibleRows / rows));
+            thumb.setFillColor(Color(120, 120, 120));
+            thumb.setPosition(left + SIDEBAR_WIDTH - 6, 40 + trackHeight * frame.historyScroll / rows);
+            window.draw(thumb);
+        }
+    }
 
-            // Check if path is clear
-            int step = isShortCastle ? 1 : -1;
-            for (int x = fromX + step; x != rookFromX; x += step)
+    void drawEnginePanel(RenderTarget &window, const FrameSnapshot &frame, map<string, Font> &fonts) // Eval bar and best line at the bottom of the sidebar
+    {
+        float left = SIZE * TILE_SIZE + rowLabelWidth;
+        float top = 40 + frame.visibleHistoryRows * (sideBarFontSize + 2) + 4;
+        float width = SIDEBAR_WIDTH - 20;
+
+        RectangleShape background(Vector2f(SIDEBAR_WIDTH, WINDOW_HEIGHT - 50 - top));
+        background.setFillColor(Color(220, 220, 220));
+        background.setPosition(left, top);
+        window.draw(background);
+
+        // White's share of the bar follows the expected score, and fills it for a forced mate
+        float share = 0.5f;
+        if (frame.hasEngineReport)
+            share = abs(frame.engineReport.whiteScore) >= VALUE_MATE_IN_MAX_PLY ? (frame.engineReport.whiteScore > 0 ? 1.0f : 0.0f)
+                                                                         : 1.0f / (1.0f + exp(-frame.engineReport.whiteScore / 250.0f));
+        RectangleShape blackBar(Vector2f(width, 10));
+        blackBar.setFillColor(Color(40, 40, 40));
+        blackBar.setOutlineColor(Color::Black);
+        blackBar.setOutlineThickness(1.0f);
+        blackBar.setPosition(left + 10, top + 4);
+        window.draw(blackBar);
+        RectangleShape whiteBar(Vector2f(width * share, 10));
+        whiteBar.setFillColor(Color::White);
+        whiteBar.setPosition(left + 10, top + 4);
+        window.draw(whiteBar);
+
+        Text scoreText;
+        scoreText.setFont(fonts["arial"]);
+        scoreText.setString(frame.hasEngineReport ? ::scoreText(frame.engineReport.whiteScore) + "   depth " + to_string(frame.engineReport.depth)
+                                            : string(frame.isEngineTurn ? "Thinking..." : "Engine"));
+        scoreText.setCharacterSize(12);
+        scoreText.setFillColor(Color::Black);
+        scoreText.setPosition(left + 10, top + 18);
+        window.draw(scoreText);
+
+        // Best line, wrapped onto two lines
+        if (frame.hasEngineReport)
+        {
+            istringstream moves(frame.engineReport.line);
+            string move, lines[2];
+            int line = 0;
+            while (moves >> move && line < 2)
             {
-                if (!board[fromY][x].piece.isEmpty())
-                    return false;
+                if (!lines[line].empty() && (lines[line].size() + move.size()) * 6.5f > width)
+                    line++;
+                if (line < 2)
+                    lines[line] += (lines[line].empty() ? "" : " ") + move;
             }
-
-            // Ensure the rook exists and matches the king's color
-            Piece rook = board[fromY][rookFromX].piece;
-            if (rook.type == "R" && rook.isWhite == isWhite)
+            for (int i = 0; i < 2; i++)
             {
-                isCastling = true;
-                lastMove = isShortCastle ? "O-O" : "O-O-O"; // Castling notation
-                return true;
+                Text lineText;
+                lineText.setFont(fonts["arial"]);
+                lineText.setString(lines[i]);
+                lineText.setCharacterSize(11);
+                lineText.setFillColor(Color(60, 60, 60));
+                lineText.setPosition(left + 10, top + 36 + i * 14);
+                window.draw(lineText);
             }
         }
-
-        return false;
-    }
-
-    bool isValidMove(int fromX, int fromY, int toX, int toY)
-    {
-        bool putsOpponentInCheck = false;
-        bool resultsInCheckmate = false;
-        return isValidMove(fromX, fromY, toX, toY, putsOpponentInCheck, resultsInCheckmate);
-    }
-
-    bool isValidMove(int fromX, int fromY, int toX, int toY, bool isDrawingMoves)
-    {
-        bool putsOpponentInCheck = false;
-        bool resultsInCheckmate = false;
-        return isValidMove(fromX, fromY, toX, toY, putsOpponentInCheck, resultsInCheckmate, isDrawingMoves);
     }
 
-    bool isValidMove(int fromX, int fromY, int toX, int toY, bool &putsOpponentInCheck, bool &resultsInCheckmate, bool inSimulation = false, bool skipKingSafetyCheck = false, bool isDrawingMoves = false)
+    void drawExplorer(RenderTarget &window, const FrameSnapshot &frame, map<string, Font> &fonts)
     {
-        Piece piece = board[fromY][fromX].piece;
-        if (piece.isEmpty())
-            return false;
-
-        if (!isValidTile(fromX, fromY) || !isValidTile(toX, toY))
+        const size_t maxRows = frame.hasEngine ? 11 : 14; // Leave room for the engine panel
+        float left = SIZE * TILE_SIZE + rowLabelWidth + 10;
+        float barWidth = SIDEBAR_WIDTH - 20;
+        if (frame.explorerMoves.empty())
         {
-            cerr << "Invalid move: Out of bounds (" << fromX << ", " << fromY << ") to (" << toX << ", " << toY << ")\n";
-            return false;
+            Text emptyText;
+            emptyText.setFont(fonts["arial"]);
+            emptyText.setString("No games");
+            emptyText.setCharacterSize(12);
+            emptyText.setFillColor(Color::Black);
+            emptyText.setPosition(left, 40);
+            window.draw(emptyText);
         }
 
-        backupLastMove = lastMove; // Backup lastMove before simulation
-        backupBoard = board;       // Backup the board before simulation
-
-        bool isCastling = false;
-        int rookFromX = -1, rookToX = -1;
-
-        // Validate the move based on the piece type
-        bool valid = false;
-        switch (piece.type[0])
+        for (size_t i = 0; i < frame.explorerMoves.size() && i < maxRows; i++)
         {
-        case 'P':
-            valid = isValidPawnMove(fromX, fromY, toX, toY, piece.isWhite, lastMove, didWEnPassant, didBEnPassant, isDrawingMoves);
-            break;
-        case 'R':
-            valid = isValidRookMove(fromX, fromY, toX, toY, piece.isWhite, lastMove);
-            break;
-        case 'N':
-            valid = isValidKnightMove(fromX, fromY, toX, toY, piece.isWhite, lastMove);
-            break;
-        case 'B':
-            valid = isValidBishopMove(fromX, fromY, toX, toY, piece.isWhite, lastMove);
-            break;
-        case 'Q':
-            valid = isValidQueenMove(fromX, fromY, toX, toY, piece.isWhite, lastMove);
-            break;
-        case 'K':
-            valid = isValidKingMove(fromX, fromY, toX, toY, piece.isWhite, isCastling, rookFromX, rookToX);
-            break;
-        default:
-            return false;
-        }
-
-        if (!valid)
-        {
-            lastMove = backupLastMove; // Restore lastMove if invalid
-            backupBoard = board;       // Restore the board if invalid
-            return false;
-        }
-
-        // Simulate the move
-        Piece capturedPiece = board[toY][toX].piece;
-        board[toY][toX].piece = piece;
-        board[fromY][fromX].piece = Piece();
+            const ExplorerMove &entry = frame.explorerMoves[i].second;
+            float y = 40 + i * 30;
 
-        // Skip king safety checks if explicitly told to
-        bool kingInCheck = false;
-        if (!skipKingSafetyCheck)
-        {
-            // Prevent the king from moving into check
-            kingInCheck = isKingInCheck(piece.isWhite);
+            // Move and number of games
+            Text moveText;
+            moveText.setFont(fonts["arial"]);
+            moveText.setString(frame.explorerMoves[i].first);
+            moveText.setCharacterSize(14);
+            moveText.setFillColor(Color::Black);
+            moveText.setPosition(left, y);
+            window.draw(moveText);
+            Text countText;
+            countText.setFont(fonts["arial"]);
+            countText.setString(to_string(entry.games()));
+            countText.setCharacterSize(12);
+            countText.setFillColor(Color(80, 80, 80));
+            countText.setPosition(left + 60, y + 2);
+            window.draw(countText);
+
+            // White wins / draws / black wins bar
+            float games = entry.games();
+            float parts[3] = {entry.white / games, entry.draws / games, entry.black / games};
+            Color colors[3] = {Color::White, Color(150, 150, 150), Color::Black};
+            float x = left;
+            for (int p = 0; p < 3; p++)
+            {
+                RectangleShape bar(Vector2f(barWidth * parts[p], 6));
+                bar.setFillColor(colors[p]);
+                bar.setPosition(x, y + 19);
+                window.draw(bar);
+                x += barWidth * parts[p];
+            }
         }
-
-        // Revert the move
-        board[fromY][fromX].piece = piece;
-        board[toY][toX].piece = capturedPiece;
-
-        // Restore lastMove after simulation
-        lastMove = backupLastMove;
-        backupBoard = board; // Restore the board after simulation
-
-        // Move is only valid if it does not leave the king in check
-        return !kingInCheck;
     }
 
-    pair<bool, bool> detectAmbiguity(int fromX, int fromY, int toX, int toY, char type, bool isWhite)
+    void drawArrows(RenderTarget &window, const FrameSnapshot &frame)
     {
-        bool requiresFile = false, requiresRank = false;
-        int ambiguityCount = 0; // Count how many pieces can move to (toX, toY)
-
-        for (int y = 0; y < SIZE; y++)
+        // Draw all finalized arrows
+        for (auto &arrow : frame.arrows)
         {
-            for (int x = 0; x < SIZE; x++)
-            {
-                if (x == fromX && y == fromY)
-                    continue; // Skip the current piece
-
-                if (board[y][x].piece.isEmpty())
-                    continue;
-
-                Piece &p = board[y][x].piece;
-
-                // Check if it's the same type and color
-                if (p.type[0] == type && p.isWhite == isWhite)
-                {
-                    // Validate if this piece can move to the target
-                    bool isValidMove = false;
-                    if (type == 'R') // Rook
-                        isValidMove = ((x == toX || y == toY) && isPathClear(x, y, toX, toY));
-                    else if (type == 'B') // Bishop
-                        isValidMove = (abs(x - toX) == abs(y - toY)) && isPathClear(x, y, toX, toY);
-                    else if (type == 'Q') // Queen
-                        isValidMove = ((x == toX || y == toY || abs(x - toX) == abs(y - toY)) && isPathClear(x, y, toX, toY));
-                    else if (type == 'N') // Knight
-                        isValidMove = (abs(x - toX) == 2 && abs(y - toY) == 1) || (abs(x - toX) == 1 && abs(y - toY) == 2);
-
-                    if (isValidMove)
-                    {
-                        ambiguityCount++;
-                        // Check file conflict
-                        if (x == fromX)
-                        {
-                            requiresRank = true;
-                        }
-                        // Check rank conflict
-                        if (y == fromY)
-                        {
-                            requiresFile = true;
-                        }
+            Vector2f start(arrow.first.x, arrow.first.y);
+            Vector2f end(arrow.second.x, arrow.second.y);
 
-                        // If this piece conflicts in both dimensions, both disambiguators are needed
-                        if (x != fromX && y != fromY)
-                        {
-                            requiresFile = true;
-                            requiresRank = true;
-                        }
-                    }
-                }
-            }
-        }
-        if (ambiguityCount <= 0)
-        {
-            requiresFile = false;
-            requiresRank = false;
-        }
-        if (ambiguityCount == 1 && requiresRank && requiresFile)
-        {
-            // Prioritize file disambiguation over rank
-            requiresRank = false;
+            // Draw the arrow with a thick shaft and bold arrowhead
+            drawPrettyArrow(window, start, end, Color::Green);
         }
-        return {requiresFile, requiresRank};
-    }
 
-    bool isPathClear(int fromX, int fromY, int toX, int toY)
-    {
-        int dx = (toX > fromX) - (toX < fromX); // Step direction in X
-        int dy = (toY > fromY) - (toY < fromY); // Step direction in Y
-
-        for (int x = fromX + dx, y = fromY + dy; x != toX || y != toY; x += dx, y += dy)
+        // Draw the temporary arrow while right-clicking
+        if (frame.isDrawingArrow && frame.arrowStart != frame.arrowEnd)
         {
-            if (!board[y][x].piece.isEmpty())
-                return false;
+            Vector2f start(frame.arrowStart.x, frame.arrowStart.y);
+            Vector2f end(frame.arrowEnd.x, frame.arrowEnd.y);
+
+            // Draw the temporary arrow
+            drawPrettyArrow(window, start, end, Color::Green);
         }
-        return true;
     }
 
-    void movePiece(int fromX, int fromY, int toX, int toY, bool isCastling = false, int rookFromX = -1, int rookToX = -1)
+    void drawPrettyArrow(RenderTarget &window, Vector2f start, Vector2f end, Color color)
     {
-        // En passant Handling
-        if (didWEnPassant || didBEnPassant)
-        {
-            int enPassantY = didWEnPassant ? 4 : 3;
-            board[enPassantY][toX].piece = Piece(); // Capture the pawn
-        }
+        // Adjust the transparency of the color (e.g., 128 for 50% opacity)
+        color.a = 128;
 
-        // Castling Handling
-        else if (isCastling)
-        {
-            board[fromY][rookToX].piece = board[fromY][rookFromX].piece; // Move rook
-            board[fromY][rookFromX].piece = Piece();                     // Clear rook square
-        }
+        // Calculate direction, length, and angle
+        Vector2f direction = end - start;
+        float length = sqrt(direction.x * direction.x + direction.y * direction.y);
+        float angle = atan2(direction.y, direction.x) * 180 / PI;
 
-        // Move the piece
-        board[toY][toX].piece = board[fromY][fromX].piece;
-        board[fromY][fromX].piece = Piece();
+        // 1. Draw the arrow shaft (centered rectangle)
+        RectangleShape shaft(Vector2f(length - 20, 8)); // Shaft: length minus head, thickness = 8
+        shaft.setFillColor(color);
 
-        didWEnPassant = false;
-        didBEnPassant = false;
+        // Set origin to center-left of the rectangle
+        shaft.setOrigin(0, shaft.getSize().y / 2);
 
-        // Update castling flags
-        if (board[toY][toX].piece.type == "K")
-        {
-            if (board[toY][toX].piece.isWhite)
-                hasWhiteKingMoved = true;
-            else
-                hasBlackKingMoved = true;
-        }
-        else if (board[toY][toX].piece.type == "R")
-        {
-            if (fromX == 0)
-                (fromY == 7 ? hasWhiteRookMoved[0] : hasBlackRookMoved[0]) = true;
-            else if (fromX == 7)
-                (fromY == 7 ? hasWhiteRookMoved[1] : hasBlackRookMoved[1]) = true;
-        }
+        // Position and rotate the shaft
+        shaft.setPosition(start);
+        shaft.setRotation(angle);
+        window.draw(shaft);
 
-        // Promotion
-        if (board[toY][toX].piece.type == "P" && (toY == 0 || toY == SIZE - 1))
-        {
-            board[toY][toX].piece = Piece("Q", board[toY][toX].piece.isWhite);
-            lastMove += "=Q"; // Add promotion notation
-        }
+        // 2. Draw the arrowhead (triangle)
+        ConvexShape arrowhead;
+        arrowhead.setPointCount(3);
+        arrowhead.setPoint(0, Vector2f(0, 0));     // Tip of the arrowhead
+        arrowhead.setPoint(1, Vector2f(-20, 10));  // Bottom left corner
+        arrowhead.setPoint(2, Vector2f(-20, -10)); // Bottom right corner
+        arrowhead.setFillColor(color);
 
-        // Check and Checkmate Detection
-        if (isKingInCheck(!board[toY][toX].piece.isWhite))
-        {
-            if (isCheckmate(!board[toY][toX].piece.isWhite))
-            {
-                lastMove += "#"; // Checkmate notation
-                cout << "Game over: Checkmate! No more moves allowed!" << endl;
-            }
-            else
-            {
-                lastMove += "+"; // Check notation
-            }
-        }
-        arrows.clear(); // Clear the arrows after the move
+        // Position and rotate the arrowhead at the endpoint
+        arrowhead.setPosition(end);
+        arrowhead.setRotation(angle);
+        window.draw(arrowhead);
     }
+
+private:
+    LayerCache menuLayer{FloatRect(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT), Color::Black};
+    LayerCache chromeLayer{FloatRect(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT), Color::Black};                  // Tiles, labels, sidebar frame and button
+    LayerCache sidebarLayer{FloatRect(SIZE * TILE_SIZE + rowLabelWidth, 32, SIDEBAR_WIDTH, 444), Color(220, 220, 220)}; // Move list or explorer
+    uint64_t layoutVersion = 0, sidebarVersion = 0; // Of the snapshot the layers were drawn from
 };
 
 class Game // Represents the game of chess
@@ -788,18 +620,46 @@ private:
     Sprite draggedPieceSprite;                  // Sprite for the piece being dragged
     bool isDragging = false;                    // Track if dragging is active
     Vector2f dragOffset;                        // Offset for smooth dragging
-    vector<string> moveHistory;                 // Store the history of the moves
-    int moveCounter = 1;                        // Count how many moves have been played
+    vector<ChessBoard::PlyRecord> plies;        // Every move of the game with what it changed on the board
+    vector<string> sanMoves;                    // Notation of each ply
+    size_t currentPly = 0;                      // Plies played on the board; later ones were undone and can be redone
+    bool startsWithBlack = false;               // The game started from a position with black to move
+    size_t historyScroll = 0;                   // First move row shown in the sidebar
     vector<pair<int, int>> validMoves;          // Store the valid moves for the selected piece
     Font font;                                  // Store the font of the labels
-    const int labelFontSize = 10;               // Font Size for cols/rows labels
-    const int sideBarFontSize = 16;             // Font Size for sidebar
     map<string, Texture> *textures;             // Pointer to the textures map
     Vector2i arrowStart;                        // To store the starting point
     Vector2i arrowEnd;                          // To store the ending point
     bool isDrawingArrow = false;                // To track if the user is drawing an arrow
+    Vector2i clickStartTile;                    // To store the tile where the right mouse was pressed
+    bool isMousePressed = false;                // Track the left mouse button between frames
+    bool isWhiteTurn = true;                    // True for white's turn, false for black's turn
+    vector<pair<Vector2i, Vector2i>> arrows;    // To store the arrows drawn by the user
+    RemoteOpponent *remote = nullptr;           // Set while playing against an opponent on a server
+    OpeningExplorer explorer;                   // Opening statistics, if an index was found
+    vector<pair<string, ExplorerMove>> explorerMoves; // Continuations of the current position, in SAN
+    bool showExplorer = false;                  // Sidebar shows the explorer instead of the move history
+    MovePrecomputer movePrecomputer;            // Finds the drag targets of each new position in the background
+    uint64_t boardGeneration = 0;               // Bumped on every change to the board
+    unique_ptr<EngineWorker> engine;            // Set when the engine plays one side
+    bool enginePlaysWhite = false;
+    int64_t engineMoveTimeMs = 1000;
+    EngineReport engineReport;                  // Latest search result for the current position
+    bool hasEngineReport = false;
+    unique_ptr<MateWorker> mateWorker;          // Set while the mate solver line is shown
+    string startFen = Position::START_FEN;      // Where the game began, for the analysis
+    unique_ptr<GameAnalysis> analysis;          // Set from "Analyze game" until the game changes
+    vector<PlyAnalysis> analysisResults;        // One per ply, once the analysis is done
+    string analysisMessage;                     // Shown on the analysis line instead of the current move, e.g. after saving
+    uint64_t layoutVersion = 1, sidebarVersion = 1; // Bumped when the cached layers have to be redrawn
+    GameJournal *journal = nullptr;             // Set when moves are journaled for crash recovery
+    uint64_t journalGameId = 0;                 // Journal id of this game once its first move is logged, else 0
+    FrameSnapshot localFrame;                   // For draw(), which captures and renders on the calling thread
+    FrameRenderer localRenderer;
 
 public:
+    GameState currentState = MENU; // Which screen the window is showing
+
     // Game constructor
     Game(map<string, Texture> &texturesRef) : textures(&texturesRef)
     {
@@ -808,27 +668,235 @@ public:
 
     void resetGame()
     {
+        endJournalGame();
         chessBoard = ChessBoard();
+        chessBoard.announcesCheckmate = true; // Headless games report the result themselves
         selectedTileX = -1;
         selectedTileY = -1;
         validMoves.clear();
 
         isWhiteTurn = true;
         isDragging = false;
-        moveHistory.clear();
-        moveCounter = 1;
+        plies.clear();
+        sanMoves.clear();
+        currentPly = 0;
+        startsWithBlack = false;
+        historyScroll = 0;
         chessBoard.resetBoard();
         arrows.clear();
+        startFen = Position::START_FEN;
+        dropAnalysis();
+        sidebarVersion++;
+        updateExplorer();
+        boardChanged();
+    }
+
+    bool loadPosition(const string &fen) // Starts a game from a FEN position
+    {
+        resetGame();
+        if (!chessBoard.loadFen(fen, isWhiteTurn))
+            return false;
+        startsWithBlack = !isWhiteTurn;
+        startFen = fen;
+        sidebarVersion++;
+        updateExplorer();
+        boardChanged();
+        return true;
+    }
+
+    string positionFen() // The position on the board, with whoever is to move
+    {
+        return chessBoard.toFen(isWhiteTurn);
+    }
+
+    vector<string> playedMoves() const // SAN of the plies up to the one on the board
+    {
+        return vector<string>(sanMoves.begin(), sanMoves.begin() + currentPly);
+    }
+
+    void openExplorer(const string &path)
+    {
+        if (filesystem::exists(path) && explorer.open(path))
+            updateExplorer();
+    }
+
+    void toggleExplorer()
+    {
+        showExplorer = explorer.isOpen() && !showExplorer;
+        invalidateLayers(); // The sidebar title changes too
+    }
+
+    void toggleMateSolver() // Shows whether the side to move has a forced mate, solved again after every move
+    {
+        if (mateWorker)
+            mateWorker.reset();
+        else
+        {
+            mateWorker = make_unique<MateWorker>(8, 2000000);
+            requestMate();
+        }
+        invalidateLayers(); // The move list makes room for the result line
+    }
+
+    void requestMate()
+    {
+        if (mateWorker)
+            mateWorker->request(positionFromBoard(chessBoard, isWhiteTurn), boardGeneration);
+    }
+
+    void startAnalysis() // Searches every position of the game in the background; the result line follows the move shown
+    {
+        if (analysis || plies.empty())
+            return;
+        analysis = make_unique<GameAnalysis>(startFen, sanMoves, AnalysisSettings());
+        if (!analysis->start())
+            analysis.reset();
+        analysisMessage.clear();
+        invalidateLayers(); // The move list makes room for the analysis line
+        scrollToCurrentPly();
+    }
+
+    void dropAnalysis() // The game no longer matches the analysis
+    {
+        if (!analysis)
+            return;
+        analysis.reset();
+        analysisResults.clear();
+        invalidateLayers();
+    }
+
+    void pollAnalysis()
+    {
+        if (analysis && analysisResults.empty() && analysis->isDone())
+        {
+            analysisResults = analysis->results();
+            sidebarVersion++; // Moves get their ?!, ? and ?? marks
+        }
+    }
+
+    bool saveAnalysis(const string &path) // Writes the game with the analysis as annotated PGN
+    {
+        if (analysisResults.empty())
+            return false;
+        PgnGame pgn;
+        pgn.startFen = startFen;
+        time_t now = time(nullptr);
+        char date[16];
+        strftime(date, sizeof(date), "%Y.%m.%d", localtime(&now));
+        pgn.setTag("Event", "Casual game");
+        pgn.setTag("Site", "local");
+        pgn.setTag("Date", date);
+        if (sanMoves.back().find('#') != string::npos)
+            pgn.result = (plies.size() % 2 == 1) != startsWithBlack ? "1-0" : "0-1"; // Whoever played the last move mated
+        annotatePgn(pgn, analysisResults, analysis->depth());
+        ofstream out(path);
+        writePgn(out, pgn);
+        analysisMessage = out ? "Saved to " + path : "Cannot write " + path;
+        if (!out)
+            cerr << "Error: cannot write " << path << endl;
+        return bool(out);
+    }
+
+    string analysisLine() // Progress while the analysis runs, then the verdict on the move that led to the board shown
+    {
+        if (!analysisMessage.empty())
+            return analysisMessage;
+        if (analysisResults.empty())
+            return "Analyzing " + to_string(analysis->searchedCount()) + "/" + to_string(analysis->positionCount()) + "...";
+        if (currentPly == 0)
+            return "Done: S saves as PGN";
+        const PlyAnalysis &ply = analysisResults[currentPly - 1];
+        string line = ply.san + qualitySuffix(ply.quality) + " " + playedScoreText(ply);
+        if (ply.quality != MOVE_GOOD)
+            line += ", best " + ply.bestSan;
+        return line;
+    }
+
+    void invalidateLayers() // After a resize, or anything else that changes the static parts of the screen
+    {
+        layoutVersion++;
+    }
+
+    void updateExplorer() // Looks up the games that reached the current position
+    {
+        explorerMoves.clear();
+        if (!explorer.isOpen())
+            return;
+        Position pos = positionFromBoard(chessBoard, isWhiteTurn);
+        for (const ExplorerMove &entry : explorer.query(pos.key))
+            explorerMoves.push_back({pos.moveToSan(entry.move), entry});
+    }
+    void setJournal(GameJournal *gameJournal) // Moves from now on are journaled
+    {
+        journal = gameJournal;
+    }
+
+    bool resumeJournalGame(const JournalGame &game) // Replays a game recovered from the journal and keeps journaling it
+    {
+        if (!game.startFen.empty() && !loadPosition(game.startFen))
+            return false;
+        GameJournal *gameJournal = journal;
+        journal = nullptr; // The moves are in the journal already
+        for (const BoardMove &m : game.moves)
+        {
+            if (!playMove(m[0], m[1], m[2], m[3]))
+            {
+                cerr << "Error: journaled game " << game.id << " does not replay at move " << currentPly + 1 << endl;
+                journal = gameJournal;
+                resetGame();
+                return false;
+            }
+        }
+        journal = gameJournal;
+        journalGameId = isGameOver() ? 0 : game.id;
+        return true;
+    }
+
+    void recordJournalMove(int fromX, int fromY, int toX, int toY)
+    {
+        if (!journal)
+            return;
+        if (!journalGameId) // Games are only journaled once they have a move
+        {
+            journalGameId = journal->nextGameId();
+            journal->append(journalNewGame(journalGameId, startFen == Position::START_FEN ? "" : startFen));
+        }
+        journal->append(journalMove(journalGameId, currentPly - 1, fromX, fromY, toX, toY));
+        if (isGameOver())
+            endJournalGame();
+    }
+
+    void endJournalGame() // A finished or abandoned game is not recovered
+    {
+        if (journal && journalGameId)
+            journal->append(journalEndGame(journalGameId));
+        journalGameId = 0;
+    }
+
+    void setRemote(RemoteOpponent *opponent)
+    {
+        remote = opponent;
+    }
+
+    void pollRemote() // Plays the moves the server confirmed, ours included
+    {
+        string uci;
+        int fromX, fromY, toX, toY;
+        while (remote && remote->pollMove(uci))
+        {
+            if (!parseBoardUci(uci, fromX, fromY, toX, toY) || !playMove(fromX, fromY, toX, toY))
+                cerr << "Error: move " << uci << " from the server does not fit the local board" << endl;
+        }
     }
+
     bool isGameOver()
     {
         return chessBoard.lastMove.find("#") != string::npos; // Check for checkmate symbol in the last move
     }
 
-    void handleRMB(RenderWindow &window, Event &event)
+    void handleRMB(const Event &event)
     {
-        static Vector2i clickStartTile; // To store the tile where the mouse was pressed
-        bool isShortClick = false;      // Flag for short-click detection
+        bool isShortClick = false; // Flag for short-click detection
 
         // Right mouse button pressed
         if (event.type == Event::MouseButtonPressed && event.mouseButton.button == Mouse::Right)
@@ -850,7 +918,7 @@ public:
         // Update arrow endpoint while moving the mouse
         if (event.type == Event::MouseMoved && isDrawingArrow)
         {
-            arrowEnd = Mouse::getPosition(window); // Update dynamically
+            arrowEnd = Vector2i(event.mouseMove.x, event.mouseMove.y); // Update dynamically
         }
 
         // Right mouse button released
@@ -889,62 +957,76 @@ public:
         }
     }
 
-    void handleLMB(RenderWindow &window, map<string, Texture> &textures)
+    void handleLMB(const Event &event, map<string, Texture> &textures) // Positions come from the event, so recorded input plays back exactly
     {
-        static bool isMousePressed = false;
-        Vector2i mousePosition = Mouse::getPosition(window);
-
         // Button dimensions (same as in draw function)
         float buttonWidth = SIDEBAR_WIDTH - 10;
         float buttonHeight = 40;
         float buttonX = SIZE * TILE_SIZE + rowLabelWidth + 5;
         float buttonY = WINDOW_HEIGHT - buttonHeight - 10;
 
-        // Allow "Return to Main Menu" button to work at all times
-        if (Mouse::isButtonPressed(Mouse::Left))
+        if (event.type == Event::MouseButtonPressed && event.mouseButton.button == Mouse::Left && !isMousePressed)
         {
-            if (!isMousePressed)
-            {
-                isMousePressed = true;
+            isMousePressed = true;
+            Vector2i mousePosition(event.mouseButton.x, event.mouseButton.y);
 
-                // Check for the button press
-                if (mousePosition.x > buttonX && mousePosition.x < buttonX + buttonWidth &&
-                    mousePosition.y > buttonY && mousePosition.y < buttonY + buttonHeight)
+            // Allow "Return to Main Menu" button to work at all times
+            if (mousePosition.x > buttonX && mousePosition.x < buttonX + buttonWidth &&
+                mousePosition.y > buttonY && mousePosition.y < buttonY + buttonHeight)
+            {
+                currentState = MENU;
+                if (remote)
                 {
-                    currentState = MENU;
-                    return; // Exit early to avoid processing game input
+                    remote->disconnect(); // Leaving the board abandons the online game
+                    remote = nullptr;
                 }
-
-                // Regular game interaction (only if not game over)
-                if (!isGameOver())
+                if (engine)
                 {
-                    onMousePress(mousePosition, textures);
+                    engine->cancel();
                 }
+                return; // Exit early to avoid processing game input
             }
-            else
+
+            if (clickHistory(mousePosition))
             {
-                if (!isGameOver())
-                {
-                    onMouseDrag(mousePosition);
-                }
+                return;
+            }
+
+            // "Analyze game" on the game over screen
+            if (isGameOver() && !analysis && analyzeButtonArea().contains(mousePosition.x, mousePosition.y))
+            {
+                startAnalysis();
+                return;
+            }
+
+            // Regular game interaction (only if not game over)
+            if (!isGameOver())
+            {
+                onMousePress(mousePosition, textures);
             }
         }
-        else
+        else if (event.type == Event::MouseMoved && isMousePressed)
         {
-            if (isMousePressed)
+            if (!isGameOver())
             {
-                isMousePressed = false;
+                onMouseDrag(Vector2i(event.mouseMove.x, event.mouseMove.y));
+            }
+        }
+        else if (event.type == Event::MouseButtonReleased && event.mouseButton.button == Mouse::Left && isMousePressed)
+        {
+            isMousePressed = false;
 
-                if (!isGameOver())
-                {
-                    onMouseRelease(mousePosition);
-                }
+            if (!isGameOver())
+            {
+                onMouseRelease(Vector2i(event.mouseButton.x, event.mouseButton.y));
             }
         }
     }
 
     void onMousePress(Vector2i mousePosition, map<string, Texture> &textures)
     {
+        TRACE_SCOPE("Game::onMousePress");
+        TRACE_INPUT(); // Closed by the next presented frame, which shows the highlights
         int tileX = mousePosition.x / TILE_SIZE;
         int tileY = mousePosition.y / TILE_SIZE;
 
@@ -953,7 +1035,7 @@ public:
             Piece &piece = chessBoard.getSquare(tileY, tileX).piece;
             validMoves.clear();
 
-            if (!piece.isEmpty() && piece.isWhite == isWhiteTurn)
+            if (!piece.isEmpty() && piece.isWhite == isWhiteTurn && !isEngineTurn() && (!remote || remote->isMyTurn(isWhiteTurn)))
             {
                 selectedTileX = tileX;
                 selectedTileY = tileY;
@@ -978,19 +1060,19 @@ public:
                         mousePosition.x - dragOffset.x,
                         mousePosition.y - dragOffset.y);
                 }
-                // Find valid moves for the selected piece
-                for (int y = 0; y < SIZE; y++)
+                // Look up the valid moves for the selected piece, computing them here only if the worker is not done yet
+                uint64_t targets;
+                if (auto table = movePrecomputer.table(boardGeneration))
+                    targets = table->targets[tileY * SIZE + tileX];
+                else
+                {
+                    TRACE_COUNT("move table misses");
+                    targets = highlightTargets(chessBoard, tileX, tileY);
+                }
+                for (int square = 0; square < SIZE * SIZE; square++)
                 {
-                    for (int x = 0; x < SIZE; x++)
-                    {
-                        bool putsOpponentInCheck = false;
-                        bool putsInCheckmate = false;
-                        if (chessBoard.isValidMove(tileX, tileY, x, y, putsOpponentInCheck, putsInCheckmate, false, false, true))
-                        {
-                            if(!putsOpponentInCheck && !putsInCheckmate) // Do not allow moves that put the opponent in check or checkmate
-                                validMoves.push_back({x, y});
-                        }
-                    }
+                    if (targets >> square & 1)
+                        validMoves.push_back({square % SIZE, square / SIZE});
                 }
             }
         }
@@ -1026,308 +1108,293 @@ public:
                 return;
             }
 
-            // Get the piece being dragged
-            Piece &fromPiece = chessBoard.getSquare(selectedTileY, selectedTileX).piece;
-
-            // Handle king-specific castling logic
-            bool isCastling = false;
-            int rookFromX = -1, rookToX = -1;
-
-            if (fromPiece.type == "K")
-            {
-                if (chessBoard.isValidKingMove(selectedTileX, selectedTileY, tileX, tileY, fromPiece.isWhite, isCastling, rookFromX, rookToX))
-                {
-                    chessBoard.movePiece(selectedTileX, selectedTileY, tileX, tileY, isCastling, rookFromX, rookToX);
-                    finalizeMove();
-                    return;
-                }
-            }
-
-            // General move validation
-            if (chessBoard.isValidMove(selectedTileX, selectedTileY, tileX, tileY))
+            // Online moves are validated by the server and played once it sends them back
+            if (remote)
             {
-                chessBoard.movePiece(selectedTileX, selectedTileY, tileX, tileY);
-                finalizeMove();
+                remote->sendMove(selectedTileX, selectedTileY, tileX, tileY);
             }
-            else
+            // Validate and play the move
+            else if (!playMove(selectedTileX, selectedTileY, tileX, tileY))
             {
                 cout << "Invalid move attempt from (" << selectedTileX << ", " << selectedTileY
-                     << ") to (" << tileX << ", " << tileY << ")\n";
-            }
-        }
-
-        // Reset dragging state in all cases
-        resetDraggingState();
-    }
-
-    void finalizeMove()
-    {
-        updateMoveHistory();
-        isWhiteTurn = !isWhiteTurn; // Switch turn
-        resetDraggingState();
-    }
-
-    void resetDraggingState()
-    {
-        isDragging = false;
-        // draggedPieceSprite.setTexture(Texture()); // Clear the texture
-    }
-
-    void updateMoveHistory()
-    {
-        if (moveHistory.size() >= MAX_VISIBLE_MOVES)
-        {
-            moveHistory.erase(moveHistory.begin()); // Remove oldest move if the list is full
-        }
-
-        // Handle castling separately
-        if (chessBoard.lastMove == "O-O" || chessBoard.lastMove == "O-O-O")
-        {
-            if (isWhiteTurn)
-            {
-                moveHistory.push_back(to_string(moveCounter) + ". " + chessBoard.lastMove);
-                moveCounter++;
-            }
-            else
-            {
-                moveHistory.back() += " " + chessBoard.lastMove;
-            }
-            return;
-        }
-
-        // Add regular move notation
-        if (isWhiteTurn)
-        {
-            moveHistory.push_back(to_string(moveCounter) + ". " + chessBoard.lastMove);
-            moveCounter++;
-        }
-        else
-        {
-            moveHistory.back() += " " + chessBoard.lastMove;
-        }
-    }
-
-    void draw(RenderWindow &window, map<string, Texture> &textures, map<string, Font> &fonts)
-    {
-        // Draw board
-        for (int y = 0; y < SIZE; y++)
-        {
-            for (int x = 0; x < SIZE; x++)
-            {
-                // Draw the tiles
-                RectangleShape square(Vector2f(TILE_SIZE, TILE_SIZE));
-                square.setPosition(x * TILE_SIZE, y * TILE_SIZE);
-                square.setTexture((x + y) % 2 == 0 ? &textures["WS1"] : &textures["BS1"]);
-                window.draw(square);
-
-                // Draw pieces, but skip the dragged piece
-                Piece &piece = chessBoard.getSquare(y, x).piece;
-                if (!(isDragging && selectedTileX == x && selectedTileY == y) && !piece.isEmpty())
-                {
-                    Sprite sprite;
-                    string textureKey = (piece.isWhite ? "W" : "B") + piece.type;
-                    sprite.setTexture(textures[textureKey]);
-                    sprite.setPosition(x * TILE_SIZE, y * TILE_SIZE);
-                    sprite.setScale(0.5f, 0.5f);
-                    window.draw(sprite);
-                }
-
-                // Highlight king in check or checkmate
-                if (!piece.isEmpty() && piece.type == "K" &&
-                    ((piece.isWhite && chessBoard.isKingInCheck(true)) ||
-                     (!piece.isWhite && chessBoard.isKingInCheck(false))))
-                {
-                    CircleShape outline(TILE_SIZE / 2.5f);          // Circle size matches piece size
-                    outline.setFillColor(Color::Transparent);       // No fill
-                    outline.setOutlineColor(Color(255, 0, 0, 128)); // Semi-transparent red
-                    outline.setOutlineThickness(4.0f);              // Thickness of the outline
-                    outline.setPosition(
-                        x * TILE_SIZE + TILE_SIZE / 2.0f - outline.getRadius(),
-                        y * TILE_SIZE + TILE_SIZE / 2.0f - outline.getRadius());
-                    window.draw(outline);
-                }
-            }
-        }
-
-        // Draw row and column labels
-        for (int i = 0; i < SIZE; i++)
-        {
-            // Draw column letters (a-h)
-            Text colText;
-            colText.setFont(fonts["arial"]);
-            colText.setString(string(1, char('a' + i)));
-            colText.setCharacterSize(labelFontSize);
-            colText.setFillColor(Color::White);
-            colText.setPosition(i * TILE_SIZE + TILE_SIZE / 2 - labelFontSize / 2, SIZE * TILE_SIZE + colLabelHeight / 2 - labelFontSize / 2); // Below board
-            window.draw(colText);
-
-            // Draw row numbers (1-8)
-            Text rowText;
-            rowText.setFont(fonts["arial"]);
-            rowText.setString(to_string(SIZE - i));
-            rowText.setCharacterSize(labelFontSize);
-            rowText.setFillColor(Color::White);
-            rowText.setPosition(SIZE * TILE_SIZE + rowLabelWidth / 2 - labelFontSize / 2, i * TILE_SIZE + TILE_SIZE / 2 - labelFontSize / 2); // Right of board
-            window.draw(rowText);
-        }
-
-        // Draw move history sidebar
-        RectangleShape sidebar(Vector2f(SIDEBAR_WIDTH, SIZE * TILE_SIZE + TILE_SIZE / 4));
-        sidebar.setFillColor(Color(220, 220, 220)); // Light gray background
-        sidebar.setPosition(SIZE * TILE_SIZE + rowLabelWidth, 0);
-        window.draw(sidebar);
-
-        // Draw sidebar title
-        Text sidebarTitle;
-        sidebarTitle.setFont(fonts["arial"]);
-        sidebarTitle.setString("Move History");
-        sidebarTitle.setCharacterSize(sideBarFontSize);
-        sidebarTitle.setFillColor(Color::Black);
-        sidebarTitle.setPosition(SIZE * TILE_SIZE + rowLabelWidth + SIDEBAR_WIDTH / 2 - 45, 10);
-        window.draw(sidebarTitle);
-
-        // Draw sidebar border
-        RectangleShape sidebarBorder(Vector2f(SIDEBAR_WIDTH, 2));
-        sidebarBorder.setFillColor(Color::Black);
-        sidebarBorder.setPosition(SIZE * TILE_SIZE + rowLabelWidth, 30);
-        window.draw(sidebarBorder);
-
-        // Draw move history
-        for (int i = 0; i < moveHistory.size(); i++)
-        {
-            Text moveText;
-            moveText.setFont(fonts["arial"]);
-            moveText.setString(moveHistory[i]);
-            moveText.setCharacterSize(sideBarFontSize);
-            moveText.setFillColor(Color::Black);
-            moveText.setPosition(SIZE * TILE_SIZE + rowLabelWidth + 10, i * (sideBarFontSize + 2) + 40);
-            window.draw(moveText);
+                     << ") to (" << tileX << ", " << tileY << ")\n";
+            }
         }
 
-        // Button dimensions
-        float buttonWidth = SIDEBAR_WIDTH - 20;
-        float buttonHeight = 40;
-        float buttonX = SIZE * TILE_SIZE + rowLabelWidth + 10;
-        float buttonY = WINDOW_HEIGHT - buttonHeight - 10; // Position at the bottom
+        // Reset dragging state in all cases
+        resetDraggingState();
+    }
 
-        // Draw the button
-        RectangleShape menuButton(Vector2f(buttonWidth, buttonHeight));
-        menuButton.setFillColor(Color(200, 200, 200)); // Light gray
-        menuButton.setOutlineColor(Color::Black);
-        menuButton.setOutlineThickness(2.0f);
-        menuButton.setPosition(buttonX, buttonY);
+    bool playMove(int fromX, int fromY, int toX, int toY) // Validate and play a move; it replaces any undone moves
+    {
+        ChessBoard::PlyRecord record;
+        if (!chessBoard.applyMove(fromX, fromY, toX, toY, record))
+            return false;
+        plies.resize(currentPly);
+        sanMoves.resize(currentPly);
+        dropAnalysis();
+        plies.push_back(record);
+        sanMoves.push_back(chessBoard.lastMove);
+        currentPly++;
+        finalizeMove(fromX, fromY, toX, toY);
+        return true;
+    }
 
-        // Draw button text (smaller size and centered)
-        Text menuText;
-        menuText.setFont(fonts["arial"]);
-        menuText.setString("Return to Main Menu");
-        menuText.setCharacterSize(12); // Smaller font size
-        menuText.setFillColor(Color::Black);
+    void finalizeMove(int fromX, int fromY, int toX, int toY)
+    {
+        TRACE_SCOPE("Game::finalizeMove");
+        recordJournalMove(fromX, fromY, toX, toY);
+        isWhiteTurn = !isWhiteTurn; // Switch turn
+        arrows.clear();             // Clear the arrows after the move
+        resetDraggingState();
+        scrollToCurrentPly();
+        sidebarVersion++;
+        updateExplorer();
+        boardChanged();
+    }
 
-        // Center text within the button
-        FloatRect textRect = menuText.getLocalBounds();
-        menuText.setOrigin(textRect.left + textRect.width / 2.0f, textRect.top + textRect.height / 2.0f);
-        menuText.setPosition(buttonX + buttonWidth / 2.0f, buttonY + buttonHeight / 2.0f);
+    void boardChanged() // Starts finding the drag targets of the new position, and the engine's move or evaluation
+    {
+        movePrecomputer.request(chessBoard, isWhiteTurn, ++boardGeneration);
+        startEngine();
+        requestMate();
+    }
 
-        window.draw(menuButton);
-        window.draw(menuText);
+    void setEngine(bool playsWhite, int64_t moveTimeMs)
+    {
+        engine = make_unique<EngineWorker>();
+        enginePlaysWhite = playsWhite;
+        engineMoveTimeMs = moveTimeMs;
+        invalidateLayers(); // The move list gets shorter to make room for the engine panel
+        startEngine();
+    }
 
-        // Draw valid moves highlights
-        for (auto &move : validMoves)
+    bool isEngineTurn() const
+    {
+        return engine && isWhiteTurn == enginePlaysWhite;
+    }
+
+    void startEngine() // Searches for a move on the engine's turn, and analyses until cancelled on ours
+    {
+        hasEngineReport = false;
+        if (!engine)
+            return;
+        Position pos = positionFromBoard(chessBoard, isWhiteTurn);
+        vector<Move> moves = boardCompatibleMoves(pos, chessBoard);
+        if (isGameOver() || moves.empty())
         {
-            CircleShape highlight(TILE_SIZE / 16.0f);
-            highlight.setFillColor(Color(0, 255, 0, 128));
-            highlight.setPosition(move.first * TILE_SIZE + TILE_SIZE / 2.0f - highlight.getRadius(),
-                                  move.second * TILE_SIZE + TILE_SIZE / 2.0f - highlight.getRadius());
-            window.draw(highlight);
+            engine->cancel();
+            return;
         }
+        engine->analyze(pos, boardGeneration, moves, isEngineTurn() ? engineMoveTimeMs : 0);
+    }
 
-        // Draw dragged piece on top
-        if (isDragging)
+    void pollEngine() // Takes the newest search result and plays the engine's move once its search is done
+    {
+        EngineReport report;
+        if (!engine || !engine->receive(report) || report.generation != boardGeneration)
+            return;
+        engineReport = report;
+        hasEngineReport = true;
+        if (report.isFinal && isEngineTurn() && !isDragging)
         {
-            window.draw(draggedPieceSprite);
+            Move m = report.bestMove;
+            if (!playMove(squareX(moveFrom(m)), squareY(moveFrom(m)), squareX(moveTo(m)), squareY(moveTo(m))))
+                cerr << "Error: engine move " << moveToUci(m) << " does not fit the local board" << endl;
         }
+    }
 
-        // Draw arrows
-        drawArrows(window);
-
-        // Highlight game-over state
-        if (isGameOver())
+    void jumpToPly(size_t ply) // Undoes or redoes one ply at a time until the board shows the given ply
+    {
+        if (remote || ply > plies.size() || ply == currentPly)
+            return; // Online games follow the server, so there is no takeback
+        while (currentPly > ply)
         {
-            RectangleShape overlay(Vector2f(TILE_SIZE * SIZE + rowLabelWidth, WINDOW_HEIGHT));
-            overlay.setFillColor(Color(0, 0, 0, 150)); // Semi-transparent black overlay
-            window.draw(overlay);
-
-            Text gameOverText;
-            gameOverText.setFont(fonts["arial"]);
-            gameOverText.setString("Game Over");
-            gameOverText.setCharacterSize(32);
-            gameOverText.setFillColor(Color::White);
-            gameOverText.setPosition(TILE_SIZE * SIZE / 2 - 80, TILE_SIZE * SIZE / 2 - 20);
-            window.draw(gameOverText);
+            chessBoard.undoMove(plies[--currentPly]);
+            isWhiteTurn = !isWhiteTurn;
+        }
+        while (currentPly < ply)
+        {
+            chessBoard.redoMove(plies[currentPly++]);
+            isWhiteTurn = !isWhiteTurn;
         }
+        validMoves.clear();
+        arrows.clear();
+        analysisMessage.clear();
+        resetDraggingState();
+        scrollToCurrentPly();
+        sidebarVersion++;
+        updateExplorer();
+        boardChanged();
     }
-    void drawArrows(RenderWindow &window)
+
+    void undo()
     {
-        // Draw all finalized arrows
-        for (auto &arrow : arrows)
-        {
-            Vector2f start(arrow.first.x, arrow.first.y);
-            Vector2f end(arrow.second.x, arrow.second.y);
+        if (currentPly > 0)
+            jumpToPly(currentPly - 1);
+    }
 
-            // Draw the arrow with a thick shaft and bold arrowhead
-            drawPrettyArrow(window, start, end, Color::Green);
-        }
+    void redo()
+    {
+        jumpToPly(currentPly + 1);
+    }
 
-        // Draw the temporary arrow while right-clicking
-        if (isDrawingArrow && arrowStart != arrowEnd)
+    void handleHistoryInput(const Event &event) // Arrow keys step through the game, the wheel scrolls the move list
+    {
+        if (event.type == Event::KeyPressed)
         {
-            Vector2f start(arrowStart.x, arrowStart.y);
-            Vector2f end(arrowEnd.x, arrowEnd.y);
-
-            // Draw the temporary arrow
-            drawPrettyArrow(window, start, end, Color::Green);
+            if (event.key.code == Keyboard::Left)
+                undo();
+            else if (event.key.code == Keyboard::Right)
+                redo();
+            else if (event.key.code == Keyboard::Home)
+                jumpToPly(0);
+            else if (event.key.code == Keyboard::End)
+                jumpToPly(plies.size());
+        }
+        else if (event.type == Event::MouseWheelScrolled && event.mouseWheelScroll.x > SIZE * TILE_SIZE + rowLabelWidth)
+        {
+            int rows = int(historyRowCount()) - int(visibleHistoryRows());
+            int scroll = int(historyScroll) - int(event.mouseWheelScroll.delta * 3);
+            historyScroll = max(0, min(scroll, rows));
+            sidebarVersion++;
         }
     }
 
-    void drawPrettyArrow(RenderWindow &window, Vector2f start, Vector2f end, Color color)
+    size_t visibleHistoryRows() const // The engine panel and the mate solver and analysis lines take the bottom of the sidebar
     {
-        // Adjust the transparency of the color (e.g., 128 for 50% opacity)
-        color.a = 128;
+        return MAX_VISIBLE_MOVES - (engine ? 5 : 0) - (mateWorker ? 1 : 0) - (analysis ? 1 : 0);
+    }
 
-        // Calculate direction, length, and angle
-        Vector2f direction = end - start;
-        float length = sqrt(direction.x * direction.x + direction.y * direction.y);
-        float angle = atan2(direction.y, direction.x) * 180 / PI;
+    size_t historyRowCount() const
+    {
+        return (plies.size() + startsWithBlack + 1) / 2;
+    }
 
-        // 1. Draw the arrow shaft (centered rectangle)
-        RectangleShape shaft(Vector2f(length - 20, 8)); // Shaft: length minus head, thickness = 8
-        shaft.setFillColor(color);
+    size_t plyRow(size_t ply) const // Sidebar row of a ply (0-based)
+    {
+        return (ply + startsWithBlack) / 2;
+    }
 
-        // Set origin to center-left of the rectangle
-        shaft.setOrigin(0, shaft.getSize().y / 2);
+    void scrollToCurrentPly() // Keeps the last played move in view
+    {
+        size_t row = currentPly > 0 ? plyRow(currentPly - 1) : 0;
+        if (row < historyScroll)
+            historyScroll = row;
+        else if (row >= historyScroll + visibleHistoryRows())
+            historyScroll = row - visibleHistoryRows() + 1;
+    }
 
-        // Position and rotate the shaft
-        shaft.setPosition(start);
-        shaft.setRotation(angle);
-        window.draw(shaft);
+    bool clickHistory(Vector2i mousePosition) // Jumps to the move clicked in the sidebar
+    {
+        float left = SIZE * TILE_SIZE + rowLabelWidth;
+        if (showExplorer || mousePosition.x < left + historyColumns[1] || mousePosition.y < 40)
+            return false;
+        size_t row = historyScroll + (mousePosition.y - 40) / (sideBarFontSize + 2);
+        if (row >= historyScroll + visibleHistoryRows())
+            return false;
+        int column = mousePosition.x < left + historyColumns[2] ? 0 : 1;
+        size_t ply = 2 * row + column; // Index counted as if white moved first
+        if (ply < size_t(startsWithBlack) || ply - startsWithBlack >= plies.size())
+            return false;
+        jumpToPly(ply - startsWithBlack + 1);
+        return true;
+    }
 
-        // 2. Draw the arrowhead (triangle)
-        ConvexShape arrowhead;
-        arrowhead.setPointCount(3);
-        arrowhead.setPoint(0, Vector2f(0, 0));     // Tip of the arrowhead
-        arrowhead.setPoint(1, Vector2f(-20, 10));  // Bottom left corner
-        arrowhead.setPoint(2, Vector2f(-20, -10)); // Bottom right corner
-        arrowhead.setFillColor(color);
+    void resetDraggingState()
+    {
+        isDragging = false;
+        // draggedPieceSprite.setTexture(Texture()); // Clear the texture
+    }
 
-        // Position and rotate the arrowhead at the endpoint
-        arrowhead.setPosition(end);
-        arrowhead.setRotation(angle);
-        window.draw(arrowhead);
+    void captureFrame(FrameSnapshot &frame) // Copies what the next frame shows, so it can be drawn on another thread
+    {
+        TRACE_SCOPE("Game::captureFrame");
+        frame.state = currentState;
+        frame.layoutVersion = layoutVersion;
+        frame.sidebarVersion = sidebarVersion;
+        frame.checkedKings = 0;
+        for (int y = 0; y < SIZE; y++)
+        {
+            for (int x = 0; x < SIZE; x++)
+            {
+                Piece &piece = chessBoard.getSquare(y, x).piece;
+                frame.pieceKeys[y][x] = piece.isEmpty() ? "" : (piece.isWhite ? "W" : "B") + piece.type;
+                if (!piece.isEmpty() && piece.type == "K" && chessBoard.isKingInCheck(piece.isWhite))
+                    frame.checkedKings |= uint64_t(1) << (y * SIZE + x);
+            }
+        }
+        frame.isDragging = isDragging;
+        frame.selectedTileX = selectedTileX;
+        frame.selectedTileY = selectedTileY;
+        frame.draggedPieceSprite = draggedPieceSprite;
+        frame.validMoves = validMoves;
+        frame.arrows = arrows;
+        frame.isDrawingArrow = isDrawingArrow;
+        frame.arrowStart = arrowStart;
+        frame.arrowEnd = arrowEnd;
+        frame.showExplorer = showExplorer;
+        captureHistory(frame);
+        frame.explorerMoves.assign(explorerMoves.begin(), explorerMoves.begin() + min<size_t>(explorerMoves.size(), 14));
+        frame.hasEngine = bool(engine);
+        frame.hasEngineReport = hasEngineReport;
+        frame.engineReport = engineReport;
+        frame.isEngineTurn = isEngineTurn();
+        frame.hasMateLine = bool(mateWorker);
+        if (mateWorker)
+        {
+            auto answer = mateWorker->answer(boardGeneration);
+            frame.mateLine = answer ? answer->text : "Solving...";
+        }
+        frame.hasAnalysisLine = bool(analysis);
+        if (analysis)
+            frame.analysisLine = analysisLine();
+        frame.hasRemote = remote != nullptr;
+        if (remote)
+            frame.remoteStatus = remote->status;
+        frame.isGameOver = isGameOver();
+        frame.showAnalyzeButton = !analysis;
+    }
+
+    void captureHistory(FrameSnapshot &frame) // Labels and colours of the move list rows in view
+    {
+        frame.historyCells.clear();
+        frame.historyRowCount = historyRowCount();
+        frame.visibleHistoryRows = visibleHistoryRows();
+        frame.historyScroll = historyScroll;
+        size_t lastRow = min(historyRowCount(), historyScroll + visibleHistoryRows());
+        for (size_t row = historyScroll; row < lastRow; row++)
+        {
+            for (int column = 0; column < 3; column++)
+            {
+                string label;
+                size_t ply = 2 * row + column - 1 - startsWithBlack; // Wraps around for "1. ..."
+                if (column == 0)
+                    label = to_string(row + 1) + ".";
+                else if (ply < plies.size())
+                    label = sanMoves[ply] + (ply < analysisResults.size() ? qualitySuffix(analysisResults[ply].quality) : "");
+                else if (ply == size_t(-1))
+                    label = "...";
+                if (label.empty())
+                    continue;
+
+                Color color = column > 0 && ply >= currentPly ? Color(140, 140, 140) : Color::Black; // Undone moves are grey
+                if (column > 0 && ply < analysisResults.size() && analysisResults[ply].quality >= MOVE_MISTAKE)
+                    color = analysisResults[ply].quality == MOVE_BLUNDER ? Color(200, 0, 0) : Color(220, 120, 0);
+                frame.historyCells.push_back({label, int(row - historyScroll), column, color, column > 0 && ply + 1 == currentPly});
+            }
+        }
+    }
+
+    void draw(RenderTarget &window, map<string, Texture> &textures, map<string, Font> &fonts) // Captures and renders on the calling thread
+    {
+        captureFrame(localFrame);
+        localRenderer.draw(window, localFrame, textures, fonts);
     }
+
 };
 
-void handleMenuInput(RenderWindow &window, Event &event, Game *game)
+void handleMenuInput(const Event &event, Game *game)
 {
     // Button dimensions (same as in drawMenu)
     float buttonWidth = 300.0f;                 // Button width
@@ -1345,16 +1412,15 @@ void handleMenuInput(RenderWindow &window, Event &event, Game *game)
 
     if (event.type == Event::MouseButtonPressed && event.mouseButton.button == Mouse::Left)
     {
-        Vector2i mousePosition = Mouse::getPosition(window);
+        Vector2i mousePosition(event.mouseButton.x, event.mouseButton.y);
 
         // Check "Play" button bounds
         if (mousePosition.x > playButtonX && mousePosition.x < playButtonX + buttonWidth &&
             mousePosition.y > playButtonY && mousePosition.y < playButtonY + buttonHeight)
         {
-            currentState = PLAYING;
+            game->currentState = PLAYING;
 
             // Reset gameplay state
-            isWhiteTurn = true;
             game->resetGame(); // Reset the game state
         }
 
@@ -1362,7 +1428,50 @@ void handleMenuInput(RenderWindow &window, Event &event, Game *game)
         if (mousePosition.x > exitButtonX && mousePosition.x < exitButtonX + buttonWidth &&
             mousePosition.y > exitButtonY && mousePosition.y < exitButtonY + buttonHeight)
         {
-            currentState = EXIT;
+            game->currentState = EXIT;
+        }
+    }
+}
+
+void handleEvent(Game *game, const Event &event, map<string, Texture> &textures) // Shared by the window and input playback
+{
+    // Cached layers are redrawn after a resize
+    if (event.type == Event::Resized)
+    {
+        game->invalidateLayers();
+    }
+
+    // Handle different game states
+    if (game->currentState == MENU)
+    {
+        handleMenuInput(event, game); // Handle menu interactions
+    }
+    else if (game->currentState == PLAYING)
+    {
+        game->handleLMB(event, textures); // Handle gameplay interactions
+        game->handleRMB(event);           // Right mouse button for arrows
+        game->handleHistoryInput(event);  // Undo/redo and scrolling the move list
+
+        // E switches the sidebar between the move history and the opening explorer
+        if (event.type == Event::KeyPressed && event.key.code == Keyboard::E)
+        {
+            game->toggleExplorer();
+        }
+
+        // M shows whether the side to move can force mate
+        if (event.type == Event::KeyPressed && event.key.code == Keyboard::M)
+        {
+            game->toggleMateSolver();
+        }
+
+        // A analyses the game, also one that ended without mate; S saves the analysis as PGN
+        if (event.type == Event::KeyPressed && event.key.code == Keyboard::A)
+        {
+            game->startAnalysis();
+        }
+        if (event.type == Event::KeyPressed && event.key.code == Keyboard::S)
+        {
+            game->saveAnalysis("analysis.pgn");
         }
     }
 }
@@ -1404,10 +1513,8 @@ void loadResources(map<string, Texture> &textures, map<string, Font> &fonts)
     }
 }
 
-void drawMenu(RenderWindow &window, map<string, Texture> &textures, map<string, Font> &fonts)
+void drawMenuScreen(RenderTarget &window, map<string, Texture> &textures, map<string, Font> &fonts)
 {
-    window.clear();
-
     // Draw background
     Sprite background;
     background.setTexture(textures["menuBackground"]);
@@ -1472,12 +1579,233 @@ void drawMenu(RenderWindow &window, map<string, Texture> &textures, map<string,
     exitText.setStyle(Text::Bold);
     exitText.setPosition(circleCenterX - buttonWidth / 4.0f, exitButtonY + buttonHeight / 4.0f);
     window.draw(exitText);
+}
+
+// Game::draw for every microbenchmark position, rendered into an offscreen texture
+vector<MicroBenchmark> renderBenchmarks(map<string, Texture> &textures, map<string, Font> &fonts)
+{
+    vector<MicroBenchmark> benchmarks;
+    auto target = make_shared<RenderTexture>();
+    if (!target->create(WINDOW_WIDTH, WINDOW_HEIGHT))
+    {
+        cerr << "Error: cannot create an offscreen render target, skipping Game::draw" << endl;
+        return benchmarks;
+    }
+    for (auto &[name, fen] : MICROBENCH_POSITIONS)
+    {
+        auto game = make_shared<Game>(textures);
+        game->loadPosition(fen);
+        game->currentState = PLAYING;
+        benchmarks.push_back({"Game::draw/" + name, [game, target, &textures, &fonts](uint64_t n)
+                              {
+                                  for (uint64_t i = 0; i < n; i++)
+                                  {
+                                      target->clear();
+                                      game->draw(*target, textures, fonts);
+                                      target->display();
+                                  }
+                              }});
+    }
+    return benchmarks;
+}
+
+// "chess playback <input.log> [--repetitions 1] [--expect checksum]": plays a recorded input log against a game
+// that renders into an offscreen texture, timing every frame. The checksums let CI check that the same input
+// still leads to the same game and the same picture.
+int runInputPlayback(const CommandArgs &args)
+{
+    int repetitions = args.getInt("repetitions", 1, 1);
+    if (args.positional.empty() || !args.isValid())
+    {
+        cerr << "Usage: chess playback <input.log> [--repetitions 1] [--expect checksum]" << endl;
+        return 1;
+    }
+    vector<RecordedEvent> events;
+    if (!loadInputLog(args.positional[0], events))
+        return 1;
+    map<string, Texture> textures;
+    map<string, Font> fonts;
+    loadResources(textures, fonts);
+    RenderTexture target;
+    if (!target.create(WINDOW_WIDTH, WINDOW_HEIGHT))
+    {
+        cerr << "Error: cannot create an offscreen render target" << endl;
+        return 1;
+    }
+
+    vector<int64_t> frameNs; // Handling the frame's events plus drawing it
+    uint64_t positionChecksum = 0, frameChecksum = 0;
+    string finalFen;
+    size_t finalMoves = 0;
+    auto start = chrono::steady_clock::now();
+    for (int repetition = 0; repetition < repetitions; repetition++)
+    {
+        Game game(textures);
+        game.openExplorer("Database/explorer.idx"); // Same sidebar as the recorded session
+        for (size_t i = 0; i < events.size() && game.currentState != EXIT;) // Frames without input are skipped
+        {
+            auto frameStart = chrono::steady_clock::now();
+            uint64_t frame = events[i].frame;
+            for (; i < events.size() && events[i].frame == frame; i++)
+                handleEvent(&game, events[i].event, textures);
+            target.clear();
+            game.draw(target, textures, fonts); // Capture and render on this thread, so frames stay deterministic
+            target.display();
+            frameNs.push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - frameStart).count());
+        }
+
+        finalFen = game.positionFen();
+        vector<string> moves = game.playedMoves();
+        finalMoves = moves.size();
+        positionChecksum = fnv1a(finalFen.data(), finalFen.size());
+        for (const string &move : moves)
+            positionChecksum = fnv1a(move.data(), move.size() + 1, positionChecksum); // Includes the terminator as a separator
+        Image image = target.getTexture().copyToImage(); // Also waits for the GPU to finish the last frame
+        frameChecksum = image.getPixelsPtr() ? fnv1a(image.getPixelsPtr(), 4 * image.getSize().x * image.getSize().y) : 0;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<int64_t> sorted = frameNs;
+    sort(sorted.begin(), sorted.end());
+    auto percentileUs = [&](double p)
+    {
+        return sorted.empty() ? 0.0 : sorted[min(sorted.size() - 1, size_t(p * sorted.size()))] / 1000.0;
+    };
+    char position[17], picture[17];
+    snprintf(position, sizeof(position), "%016llx", (unsigned long long)positionChecksum);
+    snprintf(picture, sizeof(picture), "%016llx", (unsigned long long)frameChecksum);
+    cout << fixed << setprecision(1) << events.size() << " events in " << frameNs.size() / repetitions << " frames, "
+         << repetitions << " repetitions, " << seconds << " s\n"
+         << "frame us: p50 " << percentileUs(0.50) << ", p90 " << percentileUs(0.90) << ", p99 " << percentileUs(0.99)
+         << ", max " << percentileUs(1.0) << "\n"
+         << "final position: " << finalFen << " after " << finalMoves << " plies\n"
+         << "position checksum: " << position << "\n"
+         << "frame checksum: " << picture << endl;
+
+    if (args.has("expect") && args.getString("expect", "") != position)
+    {
+        cerr << "Error: position checksum " << position << " does not match the expected " << args.getString("expect", "") << endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Positional integer argument of a headless subcommand; false after printing the error and usage
+bool readIntArgument(const vector<string> &args, size_t index, const char *name, long long minimum, long long &value)
+{
+    if (index >= args.size() || parseIntArgument(name, args[index], minimum, INT_MAX, value))
+        return true;
+    cerr << "Usage: chess " << args[0] << (args[0] == "host" ? " [games] [plies] [threads] [journal]" : " [depth]") << endl;
+    return false;
+}
 
-    window.display();
+int runCommand(const vector<string> &args) // Headless subcommands, e.g. "chess ordering 5"
+{
+    if (args[0] == "ordering" || args[0] == "quiescence" || args[0] == "selective")
+    {
+        long long depth = args[0] == "selective" ? 6 : 5;
+        if (!readIntArgument(args, 1, "depth", 1, depth))
+            return 1;
+        return args[0] == "ordering" ? runOrderingBench(depth) : args[0] == "quiescence" ? runQuiescenceBench(depth) : runSelectivityBench(depth);
+    }
+    if (args[0] == "perft")
+        return runPerftBench();
+    if (args[0] == "bench")
+        return runSearchBench(CommandArgs(vector<string>(args.begin() + 1, args.end())));
+    if (args[0] == "host")
+    {
+        long long games = 2000, plies = 40, threads = max(1u, thread::hardware_concurrency());
+        if (!readIntArgument(args, 1, "games", 1, games) || !readIntArgument(args, 2, "plies", 1, plies) ||
+            !readIntArgument(args, 3, "threads", 1, threads))
+            return 1;
+        return runHostBench(games, plies, threads, args.size() > 4 ? args[4] : "");
+    }
+    if (args[0] == "match")
+        return runMatch(CommandArgs(vector<string>(args.begin() + 1, args.end())));
+    if (args[0] == "pgn2db")
+        return runPgnToDb(CommandArgs(vector<string>(args.begin() + 1, args.end())));
+    if (args[0] == "db2pgn")
+        return runDbToPgn(CommandArgs(vector<string>(args.begin() + 1, args.end())));
+    if (args[0] == "microbench")
+    {
+        CommandArgs options(vector<string>(args.begin() + 1, args.end()));
+        vector<MicroBenchmark> benchmarks = rulesBenchmarks();
+        vector<MicroBenchmark> engine = positionBenchmarks();
+        benchmarks.insert(benchmarks.end(), engine.begin(), engine.end());
+        map<string, Texture> textures;
+        map<string, Font> fonts;
+        if (!options.has("no-render")) // Needs the textures, fonts and a graphics context
+        {
+            loadResources(textures, fonts);
+            vector<MicroBenchmark> render = renderBenchmarks(textures, fonts);
+            benchmarks.insert(benchmarks.end(), render.begin(), render.end());
+        }
+        return runMicroBenchmarks(options, benchmarks);
+    }
+    if (args[0] == "explorer")
+        return runExplorer(CommandArgs(vector<string>(args.begin() + 1, args.end())));
+    if (args[0] == "replay")
+        return runReplayBench(CommandArgs(vector<string>(args.begin() + 1, args.end())));
+    if (args[0] == "playback")
+        return runInputPlayback(CommandArgs(vector<string>(args.begin() + 1, args.end())));
+    if (args[0] == "mate")
+        return runMateSolver(CommandArgs(vector<string>(args.begin() + 1, args.end())));
+    if (args[0] == "analyze")
+        return runAnalyze(CommandArgs(vector<string>(args.begin() + 1, args.end())));
+    if (args[0] == "datagen")
+        return runDatagen(CommandArgs(vector<string>(args.begin() + 1, args.end())));
+    if (args[0] == "spectate")
+    {
+        map<string, Texture> textures;
+        map<string, Font> fonts;
+        loadResources(textures, fonts);
+        return runSpectator(CommandArgs(vector<string>(args.begin() + 1, args.end())), textures);
+    }
+#ifdef __linux__
+    if (args[0] == "server")
+        return runServer(CommandArgs(vector<string>(args.begin() + 1, args.end())));
+    if (args[0] == "loadtest")
+        return runLoadTest(CommandArgs(vector<string>(args.begin() + 1, args.end())));
+    if (args[0] == "coordinate")
+        return runMatchCoordinator(CommandArgs(vector<string>(args.begin() + 1, args.end())));
+    if (args[0] == "work")
+        return runMatchWorker(vector<string>(args.begin() + 1, args.end())); // Kept raw so the worker can restart itself
+#endif
+
+    cerr << "Unknown command: " << args[0] << endl;
+    return 1;
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+    // "chess connect [host] [port] [game id] [white|black]" opens the board against an opponent on a server
+    bool isOnline = argc > 1 && string(argv[1]) == "connect";
+    // "chess engine [white|black] [move time ms]" plays against the engine, which takes black by default
+    bool isEngineGame = argc > 1 && string(argv[1]) == "engine";
+    bool isRecording = argc > 1 && string(argv[1]) == "record";
+    if (argc > 1 && !isOnline && !isEngineGame && !isRecording)
+    {
+        int status = runCommand(vector<string>(argv + 1, argv + argc));
+        TRACE_DUMP();
+        return status;
+    }
+
+    long long port = DEFAULT_SERVER_PORT, gameId = 0, moveTimeMs = 1000;
+    if (isOnline && ((argc > 3 && !parseIntArgument("port", argv[3], 1, 65535, port)) ||
+                     (argc > 4 && !parseIntArgument("game id", argv[4], 0, LLONG_MAX, gameId))))
+    {
+        cerr << "Usage: chess connect [host] [port] [game id] [white|black]" << endl;
+        return 1;
+    }
+    if (isEngineGame && argc > 3 && !parseIntArgument("move time", argv[3], 1, INT_MAX, moveTimeMs))
+    {
+        cerr << "Usage: chess engine [white|black] [move time ms]" << endl;
+        return 1;
+    }
+    RemoteOpponent remote;
+    if (isOnline && !remote.connect(argc > 2 ? argv[2] : "127.0.0.1", port, gameId, argc > 5 ? argv[5] : ""))
+        return 1;
+
     // Create window with the required size
     RenderWindow window(VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT), "Chess Game");
 
@@ -1488,10 +1816,70 @@ int main()
 
     // Initialize the game object and pass the textures map
     Game *game = new Game(textures); // Global game instance
+    game->openExplorer("Database/explorer.idx");
+
+    // Local games are journaled move by move, and a game the last session left unfinished, e.g.
+    // after a crash, comes back. Online games are kept by the server; recorded sessions must
+    // start from the standard position to play back.
+    GameJournal journal;
+    vector<JournalGame> unfinished;
+    if (!isOnline && !isRecording && journal.open("game.journal", unfinished))
+    {
+        for (size_t i = 0; i + 1 < unfinished.size(); i++)
+            journal.append(journalEndGame(unfinished[i].id)); // Only the latest one is resumed
+        game->setJournal(&journal);
+        if (!unfinished.empty() && game->resumeJournalGame(unfinished.back()))
+        {
+            cout << "Resumed the unfinished game from game.journal (" << unfinished.back().moves.size() << " moves)" << endl;
+            game->currentState = PLAYING;
+        }
+    }
+    if (isOnline)
+    {
+        game->setRemote(&remote);
+        game->currentState = PLAYING;
+    }
+    if (isEngineGame)
+    {
+        game->setEngine(argc > 2 && string(argv[2]) == "white", moveTimeMs);
+        game->currentState = PLAYING;
+    }
+
+    // "chess record <input.log>" plays normally and writes every input to the log for "chess playback"
+    InputRecorder recorder;
+    if (isRecording && !recorder.open(argc > 2 ? argv[2] : "input.log"))
+        return 1;
+    uint64_t frame = 0;
+
+    // Drawing runs on its own thread and only ever sees the snapshots published below, so a slow
+    // rules check after a move holds up the next snapshot, not the frames in between
+    Mailbox<FrameSnapshot> frames;
+    atomic<bool> isRunning{true};
+    window.setActive(false); // The render thread takes the OpenGL context
+    thread renderThread([&]
+                        {
+        window.setActive(true);
+        FrameRenderer renderer;
+        while (isRunning)
+        {
+            if (!frames.receive())
+            {
+                this_thread::sleep_for(chrono::milliseconds(1)); // Nothing new to show
+                continue;
+            }
+            TRACE_SCOPE("frame");
+            window.clear();
+            renderer.draw(window, frames.read(), textures, fonts);
+            window.display();
+            TRACE_PRESENTED("input to highlight");
+        }
+        window.setActive(false); });
 
-    // Main game loop
-    while (window.isOpen())
+    // Input and game loop
+    while (isRunning)
     {
+        auto tickStart = chrono::steady_clock::now();
+        TRACE_SCOPE("update");
         Event event;
 
         // Poll events
@@ -1500,39 +1888,37 @@ int main()
             // Handle window close event
             if (event.type == Event::Closed)
             {
-                window.close();
+                game->currentState = EXIT;
             }
 
-            // Handle different game states
-            if (currentState == MENU)
-            {
-                handleMenuInput(window, event, game); // Handle menu interactions
-            }
-            else if (currentState == PLAYING)
-            {
-                game->handleLMB(window, textures); // Handle gameplay interactions
-                game->handleRMB(window, event);    // Right mouse button for arrows
-            }
+            recorder.record(frame, event);
+            handleEvent(game, event, textures);
         }
+        frame++;
 
-        // Rendering based on the current state
-        if (currentState == MENU)
-        {
-            // Render the main menu
-            drawMenu(window, textures, fonts);
-        }
-        else if (currentState == PLAYING)
+        if (game->currentState == PLAYING)
         {
-            // Render the game
-            window.clear();
-            game->draw(window, textures, fonts);
-            window.display();
+            game->pollRemote();
+            game->pollEngine();
+            game->pollAnalysis();
         }
-        else if (currentState == EXIT)
+        else if (game->currentState == EXIT)
         {
-            window.close(); // Exit the game
+            isRunning = false; // Exit the game
+            break;
         }
+
+        // Hand the new state to the render thread
+        game->captureFrame(frames.writeSlot());
+        frames.publish();
+        TRACE_FRAME_COUNTERS();
+        this_thread::sleep_until(tickStart + LOGIC_TICK);
     }
+    renderThread.join();
+    window.close();
+    game->endJournalGame(); // Closed on purpose, so it is not resumed next time
+    journal.close();
 
+    TRACE_DUMP();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+inline bool parseInteger(const string &text, long long &value) // The whole text must be the number
+{
+    char *end = nullptr;
+    errno = 0;
+    value = strtoll(text.c_str(), &end, 10);
+    return !text.empty() && end == text.c_str() + text.size() && errno == 0;
+}
+
+inline bool parseNumber(const string &text, double &value)
+{
+    char *end = nullptr;
+    errno = 0;
+    value = strtod(text.c_str(), &end);
+    return !text.empty() && end == text.c_str() + text.size() && errno == 0;
+}
+
+// Reads an integer argument in [minimum, maximum]; prints the error and returns false if it is
+// malformed or out of range
+inline bool parseIntArgument(const string &name, const string &text, long long minimum, long long maximum, long long &value)
+{
+    if (!parseInteger(text, value))
+    {
+        cerr << "Error: " << name << " expects an integer, not \"" << text << "\"" << endl;
+        return false;
+    }
+    if (value < minimum || value > maximum)
+    {
+        cerr << "Error: " << name << " must be between " << minimum << " and " << maximum << ", not " << text << endl;
+        return false;
+    }
+    return true;
+}
+
+class CommandArgs // Splits "--name value" flags from positional arguments
+{
+public:
+    vector<string> positional;
+
+    explicit CommandArgs(const vector<string> &args)
+    {
+        for (size_t i = 0; i < args.size(); i++)
+        {
+            if (args[i].rfind("--", 0) == 0)
+            {
+                string name = args[i].substr(2);
+                bool hasValue = i + 1 < args.size() && args[i + 1].rfind("--", 0) != 0;
+                flags[name] = hasValue ? args[++i] : "1";
+            }
+            else
+                positional.push_back(args[i]);
+        }
+    }
+
+    bool has(const string &name) const
+    {
+        return flags.count(name) > 0;
+    }
+
+    string getString(const string &name, const string &fallback) const
+    {
+        auto it = flags.find(name);
+        return it == flags.end() ? fallback : it->second;
+    }
+
+    // A malformed or out of range value prints an error, returns the fallback and clears isValid()
+    int getInt(const string &name, int fallback, int minimum = INT_MIN, int maximum = INT_MAX) const
+    {
+        auto it = flags.find(name);
+        long long value;
+        if (it == flags.end())
+            return fallback;
+        if (!parseIntArgument("--" + name, it->second, minimum, maximum, value))
+        {
+            valid = false;
+            return fallback;
+        }
+        return int(value);
+    }
+
+    double getDouble(const string &name, double fallback) const
+    {
+        auto it = flags.find(name);
+        double value;
+        if (it == flags.end())
+            return fallback;
+        if (!parseNumber(it->second, value))
+        {
+            cerr << "Error: --" << name << " expects a number, not \"" << it->second << "\"" << endl;
+            valid = false;
+            return fallback;
+        }
+        return value;
+    }
+
+    bool isValid() const // False once a numeric flag failed to parse; check it after reading the flags
+    {
+        return valid;
+    }
+
+private:
+    map<string, string> flags;
+    mutable bool valid = true;
+};
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "commandLine.h"
+#include "search.h"
+
+using namespace std;
+
+// Training data for evaluation tuning: quiet positions from shallow self-play, each with the
+// search score and the final game result, in fixed-size records that can be read back with
+// one read per block and no parsing.
+
+enum PackedResult : uint8_t
+{
+    PACKED_BLACK_WINS = 0,
+    PACKED_DRAW = 1,
+    PACKED_WHITE_WINS = 2
+};
+
+struct PackedPosition // 32 bytes
+{
+    uint64_t occupied;  // Squares with a piece, in Position square order (a8 = 0)
+    uint8_t pieces[16]; // One nibble per occupied square in ascending order, Position piece codes
+    int16_t score;      // Search score in centipawns from white's point of view
+    uint8_t result;     // PackedResult
+    uint8_t flags;      // Bit 0 side to move (1 = black), bits 1-4 castling rights
+    uint8_t epSquare;   // NO_SQUARE if none
+    uint8_t rule50;
+    uint16_t fullmove;
+};
+
+static_assert(sizeof(PackedPosition) == 32, "PackedPosition must stay 32 bytes");
+
+inline PackedPosition packPosition(const Position &pos, int whiteScore, PackedResult result)
+{
+    PackedPosition packed = {};
+    packed.occupied = pos.occupied();
+    Bitboard occ = packed.occupied;
+    for (int i = 0; occ; i++)
+    {
+        int sq = popLsb(occ);
+        packed.pieces[i / 2] |= uint8_t(pos.pieceOn(sq) << (4 * (i & 1)));
+    }
+    packed.score = int16_t(max(-32000, min(32000, whiteScore)));
+    packed.result = result;
+    packed.flags = uint8_t(pos.sideToMove | (pos.castlingRights << 1));
+    packed.epSquare = uint8_t(pos.epSquare);
+    packed.rule50 = uint8_t(min(pos.rule50, 255));
+    packed.fullmove = uint16_t(pos.gamePly / 2 + 1);
+    return packed;
+}
+
+inline string packedToFen(const PackedPosition &packed)
+{
+    int board[64];
+    fill(board, board + 64, NO_PIECE);
+    Bitboard occ = packed.occupied;
+    for (int i = 0; occ; i++)
+        board[popLsb(occ)] = (packed.pieces[i / 2] >> (4 * (i & 1))) & 15;
+
+    string fen;
+    for (int y = 0; y < 8; y++)
+    {
+        int empty = 0;
+        for (int x = 0; x < 8; x++)
+        {
+            int piece = board[y * 8 + x];
+            if (piece == NO_PIECE)
+            {
+                empty++;
+                continue;
+            }
+            if (empty)
+                fen += char('0' + empty);
+            empty = 0;
+            char c = "PNBRQK"[pieceType(piece)];
+            fen += pieceColor(piece) == WHITE ? c : char(tolower(c));
+        }
+        if (empty)
+            fen += char('0' + empty);
+        if (y < 7)
+            fen += '/';
+    }
+    int castling = packed.flags >> 1;
+    string rights;
+    if (castling & WHITE_OO)
+        rights += 'K';
+    if (castling & WHITE_OOO)
+        rights += 'Q';
+    if (castling & BLACK_OO)
+        rights += 'k';
+    if (castling & BLACK_OOO)
+        rights += 'q';
+    fen += (packed.flags & 1) ? " b " : " w ";
+    fen += rights.empty() ? "-" : rights;
+    fen += " " + (packed.epSquare == NO_SQUARE ? string("-") : squareName(packed.epSquare));
+    fen += " " + to_string(packed.rule50) + " " + to_string(packed.fullmove);
+    return fen;
+}
+
+class PackedReader // Streams records from a training data file in large blocks
+{
+public:
+    explicit PackedReader(const string &path) : in(path, ios::binary)
+    {
+        if (!in)
+            cerr << "Error: cannot open " << path << endl;
+    }
+
+    bool isOpen() const
+    {
+        return bool(in);
+    }
+
+    bool next(PackedPosition &record)
+    {
+        if (position == buffer.size())
+        {
+            buffer.resize(BLOCK_RECORDS);
+            in.read((char *)buffer.data(), buffer.size() * sizeof(PackedPosition));
+            buffer.resize(in.gcount() / sizeof(PackedPosition));
+            position = 0;
+            if (buffer.empty())
+                return false;
+        }
+        record = buffer[position++];
+        return true;
+    }
+
+private:
+    static const size_t BLOCK_RECORDS = 1 << 15;
+    ifstream in;
+    vector<PackedPosition> buffer;
+    size_t position = 0;
+};
+
+struct DatagenSettings
+{
+    string outPath;
+    uint64_t positions = 1000000; // Stop once this many have been written
+    unsigned threads = 1;
+    int depth = 6;           // Search depth per move
+    int randomPlies = 8;     // Random moves at the start of each game, so games differ
+    int minPly = 16;         // Skip the opening phase when sampling
+    int maxScore = 2000;     // Skip positions that are already decided
+    int adjudicateScore = 2500;
+    uint64_t seed = 1;
+};
+
+class DataGenerator
+{
+public:
+    explicit DataGenerator(const DatagenSettings &settings) : settings(settings) {}
+
+    bool run()
+    {
+        out.open(settings.outPath, ios::binary | ios::trunc);
+        if (!out)
+        {
+            cerr << "Error: cannot write " << settings.outPath << endl;
+            return false;
+        }
+        auto start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (unsigned t = 0; t < settings.threads; t++)
+            workers.emplace_back(&DataGenerator::work, this, t);
+
+        while (generated < settings.positions && !failed) // Progress once per second
+        {
+            this_thread::sleep_for(chrono::milliseconds(200));
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (seconds - lastReport >= 1.0)
+            {
+                lastReport = seconds;
+                cout << "\r" << generated << " positions, " << games << " games, " << fixed << setprecision(0)
+                     << generated / seconds << " positions/s" << flush;
+            }
+        }
+        for (thread &worker : workers)
+            worker.join();
+        out.flush();
+
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "\rWrote " << written << " positions from " << games << " games to " << settings.outPath << " in " << fixed
+             << setprecision(1) << seconds << " s (" << setprecision(0) << written / seconds << " positions/s, "
+             << settings.threads << " threads)" << endl;
+        return !failed && bool(out);
+    }
+
+private:
+    static const size_t FLUSH_RECORDS = 1 << 14; // 512 KB per thread between writes
+
+    DatagenSettings settings;
+    ofstream out;
+    mutex outMutex; // Only held while a full thread buffer is written
+    atomic<uint64_t> written{0};
+    atomic<uint64_t> generated{0}; // Sampled so far, including what still sits in thread buffers
+    atomic<uint64_t> games{0};
+    atomic<bool> failed{false};
+    double lastReport = 0;
+
+    bool writeBuffer(vector<PackedPosition> &buffer) // False once enough positions were written
+    {
+        lock_guard<mutex> lock(outMutex);
+        uint64_t room = settings.positions - min<uint64_t>(written, settings.positions);
+        size_t count = min<uint64_t>(buffer.size(), room);
+        out.write((const char *)buffer.data(), count * sizeof(PackedPosition));
+        if (!out)
+            failed = true;
+        written += count;
+        buffer.clear();
+        return written < settings.positions && !failed;
+    }
+
+    void work(unsigned index)
+    {
+        mt19937_64 rng(settings.seed * 0x9E3779B97F4A7C15ULL + index);
+        Search search;
+        vector<PackedPosition> buffer;
+        buffer.reserve(FLUSH_RECORDS);
+        vector<PackedPosition> sampled; // Positions of the current game, waiting for its result
+
+        while (generated < settings.positions && !failed)
+        {
+            Position pos;
+            if (!playRandomOpening(pos, rng))
+                continue;
+            sampled.clear();
+            PackedResult result = playGame(pos, search, sampled);
+            games++;
+            generated += sampled.size();
+            for (PackedPosition &record : sampled)
+            {
+                record.result = result;
+                buffer.push_back(record);
+            }
+            if (buffer.size() >= FLUSH_RECORDS && !writeBuffer(buffer))
+                return;
+        }
+        if (!buffer.empty())
+            writeBuffer(buffer);
+    }
+
+    bool playRandomOpening(Position &pos, mt19937_64 &rng)
+    {
+        for (int ply = 0; ply < settings.randomPlies; ply++)
+        {
+            MoveList list;
+            pos.generateLegal(list);
+            if (list.size == 0)
+                return false; // Mated or stalemated already, try another
+            pos.makeMove(list.moves[rng() % list.size].move);
+        }
+        MoveList list;
+        pos.generateLegal(list);
+        return list.size > 0;
+    }
+
+    PackedResult playGame(Position &pos, Search &search, vector<PackedPosition> &sampled)
+    {
+        int winningPlies = 0, lastSign = 0;
+        for (int ply = 0; ply < 400; ply++)
+        {
+            MoveList list;
+            pos.generateLegal(list);
+            if (list.size == 0)
+                return pos.inCheck() ? (pos.sideToMove == WHITE ? PACKED_BLACK_WINS : PACKED_WHITE_WINS) : PACKED_DRAW;
+            if (pos.isDraw())
+                return PACKED_DRAW;
+
+            SearchLimits limits;
+            limits.depth = settings.depth;
+            SearchResult result = search.think(pos, limits);
+            int whiteScore = pos.sideToMove == WHITE ? result.score : -result.score;
+
+            // Adjudicate games that are clearly won so time goes into undecided positions
+            int sign = whiteScore >= settings.adjudicateScore ? 1 : whiteScore <= -settings.adjudicateScore ? -1 : 0;
+            winningPlies = sign != 0 && sign == lastSign ? winningPlies + 1 : (sign != 0);
+            lastSign = sign;
+            if (winningPlies >= 6)
+                return sign > 0 ? PACKED_WHITE_WINS : PACKED_BLACK_WINS;
+
+            // Quiet positions only: the score of a position with a capture pending says little about it
+            if (pos.gamePly >= settings.minPly && !pos.inCheck() && !pos.isCaptureOrPromotion(result.bestMove) &&
+                abs(whiteScore) <= settings.maxScore)
+                sampled.push_back(packPosition(pos, whiteScore, PACKED_DRAW)); // Result filled in at the end
+            pos.makeMove(result.bestMove);
+        }
+        return PACKED_DRAW;
+    }
+};
+
+// "chess datagen generate <out.bin> [--positions N] [--threads N] [--depth 6] [--random-plies 8] [--seed 1]"
+// "chess datagen read <file.bin> [--show 10]"
+inline int runDatagen(const CommandArgs &args)
+{
+    if (args.positional.size() < 2 || (args.positional[0] != "generate" && args.positional[0] != "read"))
+    {
+        cerr << "Usage: chess datagen generate <out.bin> [--positions N] [--threads N] [--depth 6] [--random-plies 8] [--seed 1]\n"
+             << "       chess datagen read <file.bin> [--show 10]" << endl;
+        return 1;
+    }
+
+    if (args.positional[0] == "generate")
+    {
+        DatagenSettings settings;
+        settings.outPath = args.positional[1];
+        settings.positions = args.getInt("positions", 1000000, 1);
+        settings.threads = args.getInt("threads", max(1u, thread::hardware_concurrency()), 1);
+        settings.depth = args.getInt("depth", settings.depth, 1, MAX_PLY - 1);
+        settings.randomPlies = args.getInt("random-plies", settings.randomPlies, 0);
+        settings.seed = args.getInt("seed", 1);
+        if (!args.isValid())
+            return 1;
+        DataGenerator generator(settings);
+        return generator.run() ? 0 : 1;
+    }
+
+    int show = args.getInt("show", 10, 0);
+    if (!args.isValid())
+        return 1;
+    PackedReader reader(args.positional[1]);
+    if (!reader.isOpen())
+        return 1;
+    uint64_t count = 0, results[3] = {0, 0, 0};
+    double absScore = 0;
+    PackedPosition record;
+    auto start = chrono::steady_clock::now();
+    while (reader.next(record))
+    {
+        if (count < uint64_t(show))
+            cout << packedToFen(record) << "  score " << record.score << "  result "
+                 << (record.result == PACKED_WHITE_WINS ? "1-0" : record.result == PACKED_BLACK_WINS ? "0-1" : "1/2-1/2") << "\n";
+        results[min<int>(record.result, 2)]++;
+        absScore += abs(record.score);
+        count++;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << count << " positions: white wins " << results[PACKED_WHITE_WINS] << ", draws " << results[PACKED_DRAW]
+         << ", black wins " << results[PACKED_BLACK_WINS] << ", mean |score| " << fixed << setprecision(0)
+         << (count ? absScore / count : 0) << " cp, read at " << count / max(seconds, 1e-9) << " positions/s" << endl;
+    return 0;
+}
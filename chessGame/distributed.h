@@ -0,0 +1,643 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <deque>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "checksum.h"
+#include "loadTest.h"
+#include "match.h"
+
+using namespace std;
+
+// Self-play spread over processes and machines. A coordinator owns the match: it hands out
+// batches of game numbers, and workers play them with the same playMatchGame as "chess match"
+// and stream every finished game back as PGN. A game number fixes the opening and the colors,
+// so a batch whose worker disconnects or goes silent is simply handed to another worker.
+//
+// The coordinator listens on loopback unless --listen names another address. Workers only run
+// a binary the coordinator sends when they were started with --accept-binary and its SHA-256,
+// so nobody who can reach a worker, or poses as its coordinator, can make it run their code.
+//
+// One text line per message, except where a byte count announces raw data after the line:
+//   worker -> coordinator: HELLO <threads> <binary hash> | ALIVE | DONE <batch>
+//                          RESULT <batch> <game> <dev score x2> <bytes>, then the game as PGN,
+//                          whose result and colors must agree with the score
+//   coordinator -> worker: BINARY <bytes> <sha256>, then the executable the workers must run
+//                          CONFIG <tc> <hash MB> <max plies> <base options|-> <dev options|->
+//                          OPENINGS <count>, then one opening per line
+//                          BATCH <batch> <game>... | QUIT
+
+const unsigned short DEFAULT_COORDINATOR_PORT = 5100;
+const size_t MAX_RESULT_BYTES = 1 << 20; // A PGN larger than this closes the connection
+
+inline bool readWholeFile(const string &path, string &data)
+{
+    ifstream in(path, ios::binary);
+    if (!in)
+        return false;
+    data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    return true;
+}
+
+struct DistributedSettings
+{
+    MatchSettings match;
+    string baseOptions, devOptions;    // As given on the command line, for the workers
+    unsigned short port = DEFAULT_COORDINATOR_PORT;
+    string listenAddress = "127.0.0.1"; // Only local workers can connect unless this is changed
+    int batchSize = 8;                 // Games per batch; a worker with more threads gets one game per thread
+    string binaryPath = "/proc/self/exe"; // Workers running anything else are sent this file
+    int timeoutSeconds = 30;           // A worker that sends nothing for this long is given up on
+    int localWorkers = 0;              // Worker processes started on loopback, for testing
+};
+
+class MatchCoordinator
+{
+public:
+    explicit MatchCoordinator(const DistributedSettings &settings) : settings(settings) {}
+
+    ~MatchCoordinator()
+    {
+        for (WorkerLink &worker : workers)
+            close(worker.fd);
+        if (listenFd >= 0)
+            close(listenFd);
+    }
+
+    int run()
+    {
+        if (!readWholeFile(settings.binaryPath, binary))
+        {
+            cerr << "Error: cannot read the worker binary " << settings.binaryPath << endl;
+            return 1;
+        }
+        hash = sha256Hex(binary);
+        if (!results.open(settings.match) || !listen())
+            return 1;
+        for (int g = 0; g < settings.match.games; g++)
+            pending.push_back(g);
+        recorded.assign(settings.match.games, false);
+        cout << "Coordinator on " << settings.listenAddress << ":" << settings.port << ": " << settings.match.games << " games in batches of "
+             << settings.batchSize << ", tc " << settings.match.timeControl.toPgn() << ", worker binary " << hash << ", "
+             << results.boundsText() << endl;
+        startLocalWorkers();
+
+        auto start = chrono::steady_clock::now();
+        while (recordedCount < settings.match.games && !results.isDecided())
+        {
+            vector<pollfd> fds = {{listenFd, POLLIN, 0}};
+            for (WorkerLink &worker : workers)
+                fds.push_back({worker.fd, short(POLLIN | (worker.output.empty() ? 0 : POLLOUT)), 0});
+            if (poll(fds.data(), fds.size(), 500) < 0 && errno != EINTR)
+            {
+                cerr << "Error: poll: " << strerror(errno) << endl;
+                break;
+            }
+            if (fds[0].revents & POLLIN)
+                acceptAll();
+            for (size_t i = 1; i < fds.size(); i++)
+            {
+                WorkerLink &worker = workers[i - 1];
+                if (fds[i].revents & (POLLERR | POLLHUP | POLLIN))
+                    receive(worker);
+                if (!worker.failure.empty())
+                    continue;
+                if (fds[i].revents & POLLOUT)
+                    transmit(worker);
+            }
+            checkTimeouts();
+            dropFailedWorkers();
+            assignBatches();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        for (WorkerLink &worker : workers) // Workers in the middle of a batch notice the closed socket
+        {
+            worker.output += "QUIT\n";
+            transmit(worker);
+        }
+        stopLocalWorkers();
+        results.printSummary();
+        cout << fixed << setprecision(2) << recordedCount / seconds << " games/s over " << seconds << " s, "
+             << workersSeen << " workers, " << reassigned << " games reassigned" << endl;
+        return 0;
+    }
+
+private:
+    struct WorkerLink
+    {
+        int fd = -1;
+        string name;           // Peer address, for the log
+        string input, output;
+        bool isReady = false;  // Runs the right binary and has the match configuration
+        bool closeWhenSent = false;
+        int batch = -1;        // Batch in progress, -1 when idle
+        vector<int> games;     // Its game numbers
+        int played = 0;
+        string resultHeader;   // RESULT line whose PGN is still arriving
+        size_t resultBytes = 0;
+        string failure;        // Set when the worker is given up on
+        chrono::steady_clock::time_point lastHeard;
+    };
+
+    DistributedSettings settings;
+    MatchResults results;
+    string binary, hash;
+    int listenFd = -1;
+    vector<WorkerLink> workers;
+    deque<int> pending;    // Game numbers not handed out, reassigned ones first
+    vector<bool> recorded; // Per game number
+    int recordedCount = 0, nextBatch = 1, workersSeen = 0, reassigned = 0;
+    vector<pid_t> localPids;
+
+    bool listen()
+    {
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        int yes = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(settings.port);
+        if (inet_pton(AF_INET, settings.listenAddress.c_str(), &address.sin_addr) != 1)
+        {
+            cerr << "Error: " << settings.listenAddress << " is not an IPv4 address" << endl;
+            return false;
+        }
+        if (listenFd < 0 || ::bind(listenFd, (sockaddr *)&address, sizeof(address)) != 0 || ::listen(listenFd, SOMAXCONN) != 0)
+        {
+            cerr << "Error: cannot listen on " << settings.listenAddress << ":" << settings.port << ": " << strerror(errno) << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Each runs "chess work 127.0.0.1 <port> --concurrency 1 --accept-binary <hash>" from this executable
+    void startLocalWorkers()
+    {
+        string port = to_string(settings.port);
+        for (int i = 0; i < settings.localWorkers; i++)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                close(listenFd);
+                execl("/proc/self/exe", "chess", "work", "127.0.0.1", port.c_str(), "--concurrency", "1", "--accept-binary",
+                      hash.c_str(), (char *)nullptr);
+                _exit(127);
+            }
+            if (pid > 0)
+                localPids.push_back(pid);
+        }
+    }
+
+    void stopLocalWorkers()
+    {
+        for (pid_t pid : localPids)
+            kill(pid, SIGTERM);
+        for (pid_t pid : localPids)
+            waitpid(pid, nullptr, 0);
+    }
+
+    void acceptAll()
+    {
+        sockaddr_in peer;
+        socklen_t length = sizeof(peer);
+        int fd;
+        while ((fd = accept4(listenFd, (sockaddr *)&peer, &length, SOCK_NONBLOCK)) >= 0)
+        {
+            int yes = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+            WorkerLink worker;
+            worker.fd = fd;
+            worker.name = string(inet_ntoa(peer.sin_addr)) + ":" + to_string(ntohs(peer.sin_port));
+            worker.lastHeard = chrono::steady_clock::now();
+            workers.push_back(worker);
+            length = sizeof(peer);
+        }
+    }
+
+    void receive(WorkerLink &worker)
+    {
+        char buffer[4096];
+        bool isClosed = false; // Lines that arrived before the close are still handled
+        while (true)
+        {
+            ssize_t received = recv(worker.fd, buffer, sizeof(buffer), 0);
+            if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            {
+                isClosed = true;
+                break;
+            }
+            if (received < 0)
+                break;
+            worker.input.append(buffer, received);
+            worker.lastHeard = chrono::steady_clock::now();
+        }
+
+        while (worker.failure.empty())
+        {
+            if (worker.resultBytes)
+            {
+                if (worker.input.size() < worker.resultBytes)
+                    break;
+                string pgn = worker.input.substr(0, worker.resultBytes);
+                worker.input.erase(0, worker.resultBytes);
+                worker.resultBytes = 0;
+                recordResult(worker, pgn);
+                continue;
+            }
+            size_t end = worker.input.find('\n');
+            if (end == string::npos)
+            {
+                if (worker.input.size() > MAX_LINE_LENGTH)
+                    worker.failure = "sent an overlong line";
+                break;
+            }
+            string line = worker.input.substr(0, end);
+            worker.input.erase(0, end + 1);
+            handleLine(worker, line);
+        }
+        if (isClosed && worker.failure.empty())
+            worker.failure = "disconnected";
+    }
+
+    void handleLine(WorkerLink &worker, const string &line)
+    {
+        istringstream in(line);
+        string command;
+        in >> command;
+        if (command == "HELLO")
+        {
+            unsigned threads = 0;
+            string workerHash;
+            in >> threads >> workerHash;
+            if (workerHash != hash)
+            {
+                // The worker stores the executable, restarts into it and connects again
+                cout << "Worker " << worker.name << " runs binary " << workerHash << "; sending " << hash << endl;
+                worker.output += "BINARY " + to_string(binary.size()) + " " + hash + "\n" + binary;
+                worker.closeWhenSent = true;
+                return;
+            }
+            const MatchSettings &match = settings.match;
+            worker.output += "CONFIG " + match.timeControl.toPgn() + " " + to_string(match.hashMb) + " " + to_string(match.maxPlies) +
+                             " " + optionText(settings.baseOptions) + " " + optionText(settings.devOptions) + "\n";
+            worker.output += "OPENINGS " + to_string(match.openings.size()) + "\n";
+            for (const string &opening : match.openings)
+                worker.output += opening + "\n";
+            worker.isReady = true;
+            workersSeen++;
+            cout << "Worker " << worker.name << " joined with " << threads << " threads" << endl;
+        }
+        else if (command == "RESULT")
+        {
+            int batch, game, score2;
+            in >> batch >> game >> score2 >> worker.resultBytes;
+            if (!in || worker.resultBytes == 0 || worker.resultBytes > MAX_RESULT_BYTES)
+                worker.failure = "sent a bad result";
+            worker.resultHeader = line;
+        }
+        else if (command == "DONE")
+        {
+            int batch = -1;
+            in >> batch;
+            if (batch == worker.batch)
+                releaseBatch(worker); // Normally everything is recorded; anything missing goes back to the queue
+        }
+        else if (command != "ALIVE")
+            worker.failure = "sent an unknown command " + command;
+    }
+
+    static string optionText(const string &options)
+    {
+        return options.empty() ? "-" : options;
+    }
+
+    void recordResult(WorkerLink &worker, const string &pgn)
+    {
+        istringstream header(worker.resultHeader), text(pgn);
+        string command;
+        int batch, game, score2;
+        header >> command >> batch >> game >> score2;
+        MatchGame result;
+        if (batch != worker.batch || find(worker.games.begin(), worker.games.end(), game) == worker.games.end() ||
+            !readPgn(text, result.pgn))
+        {
+            worker.failure = "sent a result for a game it was not given";
+            return;
+        }
+
+        // The score comes from the PGN; the worker's own count must agree with it
+        result.devIsWhite = game % 2 == 0; // As playMatchGame assigns the colors
+        const string &outcome = result.pgn.result;
+        int whiteScore2 = outcome == "1-0" ? 2 : outcome == "0-1" ? 0 : outcome == "1/2-1/2" ? 1 : -1;
+        result.devScore2 = result.devIsWhite ? whiteScore2 : 2 - whiteScore2;
+        if (whiteScore2 < 0 || result.devScore2 != score2 || result.pgn.tag("White") != (result.devIsWhite ? "dev" : "base") ||
+            result.pgn.tag("Black") != (result.devIsWhite ? "base" : "dev"))
+        {
+            worker.failure = "sent a result that does not match its PGN";
+            return;
+        }
+        if (recorded[game])
+            return; // Already played by a worker this batch was taken from
+        recorded[game] = true;
+        recordedCount++;
+        worker.played++;
+        result.pgn.setTag("Site", worker.name);
+        results.record(game, result);
+    }
+
+    void releaseBatch(WorkerLink &worker) // Unplayed games of the worker's batch go to the front of the queue
+    {
+        for (auto it = worker.games.rbegin(); it != worker.games.rend(); ++it)
+        {
+            if (!recorded[*it])
+            {
+                pending.push_front(*it);
+                reassigned++;
+            }
+        }
+        worker.batch = -1;
+        worker.games.clear();
+    }
+
+    void transmit(WorkerLink &worker)
+    {
+        while (!worker.output.empty())
+        {
+            ssize_t sent = ::send(worker.fd, worker.output.data(), worker.output.size(), MSG_NOSIGNAL);
+            if (sent < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    worker.failure = "disconnected";
+                return;
+            }
+            worker.output.erase(0, sent);
+        }
+        if (worker.closeWhenSent)
+            worker.failure = "restarting with the new binary";
+    }
+
+    void checkTimeouts()
+    {
+        auto now = chrono::steady_clock::now();
+        for (WorkerLink &worker : workers)
+            if (worker.failure.empty() && now - worker.lastHeard > chrono::seconds(settings.timeoutSeconds))
+                worker.failure = "silent for " + to_string(settings.timeoutSeconds) + " s";
+    }
+
+    void dropFailedWorkers()
+    {
+        for (size_t i = 0; i < workers.size();)
+        {
+            WorkerLink &worker = workers[i];
+            if (worker.failure.empty())
+            {
+                i++;
+                continue;
+            }
+            size_t unplayed = count_if(worker.games.begin(), worker.games.end(), [&](int game)
+                                       { return !recorded[game]; });
+            cout << "Worker " << worker.name << " left (" << worker.failure << ") after " << worker.played << " games";
+            if (unplayed)
+                cout << "; " << unplayed << " games of batch " << worker.batch << " reassigned";
+            cout << endl;
+            releaseBatch(worker);
+            close(worker.fd);
+            workers.erase(workers.begin() + i);
+        }
+    }
+
+    void assignBatches()
+    {
+        for (WorkerLink &worker : workers)
+        {
+            if (!worker.isReady || worker.batch >= 0 || pending.empty())
+                continue;
+            worker.batch = nextBatch++;
+            string line = "BATCH " + to_string(worker.batch);
+            for (int i = 0; i < settings.batchSize && !pending.empty(); i++)
+            {
+                worker.games.push_back(pending.front());
+                line += " " + to_string(pending.front());
+                pending.pop_front();
+            }
+            worker.output += line + "\n";
+            transmit(worker);
+        }
+    }
+};
+
+// "chess work [host] [port] [--concurrency N] [--accept-binary sha256]": plays the batches a coordinator hands out
+inline int runMatchWorker(const vector<string> &rawArgs)
+{
+    CommandArgs args(rawArgs);
+    string hostName = args.positional.size() > 0 ? args.positional[0] : "127.0.0.1";
+    long long port = DEFAULT_COORDINATOR_PORT;
+    unsigned concurrency = args.getInt("concurrency", max(1u, thread::hardware_concurrency()), 1);
+    if ((args.positional.size() > 1 && !parseIntArgument("port", args.positional[1], 1, 65535, port)) || !args.isValid())
+    {
+        cerr << "Usage: chess work [host] [port] [--concurrency N] [--accept-binary sha256]" << endl;
+        return 1;
+    }
+
+    string self;
+    if (!readWholeFile("/proc/self/exe", self))
+    {
+        cerr << "Error: cannot read /proc/self/exe" << endl;
+        return 1;
+    }
+    LoadClient link;
+    for (int attempt = 0; attempt < 40 && (link.fd = connectTo(hostName, port)) < 0; attempt++)
+        this_thread::sleep_for(chrono::milliseconds(250)); // The coordinator may still be starting
+    if (link.fd < 0)
+    {
+        cerr << "Error: cannot connect to the coordinator at " << hostName << ":" << port << endl;
+        return 1;
+    }
+
+    mutex sendMutex; // Game threads, the heartbeat and the main thread all send
+    atomic<bool> isConnected{sendAll(link.fd, "HELLO " + to_string(concurrency) + " " + sha256Hex(self) + "\n")};
+    atomic<bool> isRunning{true};
+    auto sendLine = [&](const string &data)
+    {
+        lock_guard<mutex> lock(sendMutex);
+        if (isConnected && !sendAll(link.fd, data))
+            isConnected = false;
+    };
+    thread heartbeat([&]
+                     {
+        while (isRunning && isConnected)
+        {
+            for (int i = 0; i < 20 && isRunning; i++)
+                this_thread::sleep_for(chrono::milliseconds(100));
+            sendLine("ALIVE\n"); // Long games must not look like a dead worker
+        } });
+
+    MatchSettings settings;
+    int played = 0;
+    string line;
+    while (isConnected && readLineBlocking(link, line))
+    {
+        istringstream in(line);
+        string command;
+        in >> command;
+        if (command == "BINARY")
+        {
+            size_t bytes = 0;
+            string offered, accepted = args.getString("accept-binary", "");
+            in >> bytes >> offered;
+            if (offered != accepted)
+            {
+                isRunning = false;
+                heartbeat.join();
+                close(link.fd);
+                if (accepted.empty())
+                    cerr << "Error: the coordinator runs binary " << offered << "; start the worker with --accept-binary "
+                         << offered << " to run it" << endl;
+                else
+                    cerr << "Error: the coordinator sent binary " << offered << ", but only " << accepted << " is accepted" << endl;
+                return 1;
+            }
+            char buffer[65536];
+            ssize_t received = 1;
+            while (link.input.size() < bytes && (received = recv(link.fd, buffer, sizeof(buffer), 0)) != 0)
+            {
+                if (received > 0)
+                    link.input.append(buffer, received);
+                else if (errno != EINTR)
+                    break;
+            }
+            isRunning = false;
+            heartbeat.join();
+            close(link.fd);
+            if (link.input.size() < bytes || args.has("updated"))
+            {
+                cerr << "Error: " << (args.has("updated") ? "the coordinator sent a new binary again" : "the binary transfer broke off") << endl;
+                return 1;
+            }
+            string executable = link.input.substr(0, bytes);
+            if (sha256Hex(executable) != accepted)
+            {
+                cerr << "Error: the binary received does not match --accept-binary " << accepted << endl;
+                return 1;
+            }
+            string path = "./chess-worker-" + accepted.substr(0, 16);
+            ofstream out(path, ios::binary);
+            out.write(executable.data(), executable.size());
+            out.close();
+            if (!out || chmod(path.c_str(), 0755) != 0)
+            {
+                cerr << "Error: cannot write " << path << endl;
+                return 1;
+            }
+            cout << "Restarting as " << path << endl;
+            vector<string> restartArgs = {path, "work"};
+            restartArgs.insert(restartArgs.end(), rawArgs.begin(), rawArgs.end());
+            restartArgs.push_back("--updated");
+            vector<char *> argv;
+            for (string &arg : restartArgs)
+                argv.push_back(&arg[0]);
+            argv.push_back(nullptr);
+            execv(path.c_str(), argv.data());
+            cerr << "Error: cannot start " << path << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        else if (command == "CONFIG")
+        {
+            string tc, base, dev;
+            in >> tc >> settings.hashMb >> settings.maxPlies >> base >> dev;
+            if (!TimeControl::parse(tc, settings.timeControl))
+            {
+                cerr << "Error: bad time control " << tc << " from the coordinator" << endl;
+                break;
+            }
+            if (!applySearchOptions(settings.baseOptions, base == "-" ? "" : base) ||
+                !applySearchOptions(settings.devOptions, dev == "-" ? "" : dev))
+            {
+                cerr << "Error: unknown search option from the coordinator" << endl;
+                break;
+            }
+        }
+        else if (command == "OPENINGS")
+        {
+            size_t count = 0;
+            in >> count;
+            settings.openings.clear();
+            for (size_t i = 0; i < count && readLineBlocking(link, line); i++)
+                settings.openings.push_back(line);
+        }
+        else if (command == "BATCH")
+        {
+            int batch, game;
+            vector<int> games;
+            in >> batch;
+            while (in >> game)
+                games.push_back(game);
+            if (settings.openings.empty())
+                break;
+
+            atomic<size_t> next{0};
+            vector<thread> threads;
+            for (unsigned t = 0; t < min<size_t>(concurrency, games.size()); t++)
+                threads.emplace_back([&]
+                                     {
+                    Search dev, base;
+                    dev.options = settings.devOptions;
+                    base.options = settings.baseOptions;
+                    dev.transpositionTable().resize(settings.hashMb);
+                    base.transpositionTable().resize(settings.hashMb);
+                    for (size_t i; isConnected && (i = next++) < games.size();)
+                    {
+                        dev.clear();
+                        base.clear();
+                        MatchGame result = playMatchGame(settings, games[i], dev, base);
+                        ostringstream pgn;
+                        writePgn(pgn, result.pgn);
+                        sendLine("RESULT " + to_string(batch) + " " + to_string(games[i]) + " " + to_string(result.devScore2) + " " +
+                                 to_string(pgn.str().size()) + "\n" + pgn.str());
+                    } });
+            for (thread &worker : threads)
+                worker.join();
+            played += games.size();
+            sendLine("DONE " + to_string(batch) + "\n");
+        }
+        else if (command == "QUIT")
+            break;
+    }
+
+    isRunning = false;
+    heartbeat.join();
+    close(link.fd);
+    cout << "Worker finished after " << played << " games" << endl;
+    return 0;
+}
+
+// "chess coordinate [--listen 127.0.0.1] [--port 5100] [--games N] [--batch 8] [--local-workers N] [--binary path] [--timeout 30]"
+// plus the match options of "chess match": --tc, --base, --dev, --openings, --pgn, --hash, --elo0, --elo1
+inline int runMatchCoordinator(const CommandArgs &args)
+{
+    DistributedSettings settings;
+    if (!readMatchSettings(args, settings.match))
+        return 1;
+    settings.baseOptions = args.getString("base", "");
+    settings.devOptions = args.getString("dev", "");
+    settings.listenAddress = args.getString("listen", settings.listenAddress);
+    settings.port = args.getInt("port", settings.port, 1, 65535);
+    settings.batchSize = args.getInt("batch", settings.batchSize, 1);
+    settings.binaryPath = args.getString("binary", settings.binaryPath);
+    settings.timeoutSeconds = args.getInt("timeout", settings.timeoutSeconds, 1);
+    settings.localWorkers = args.getInt("local-workers", 0, 0);
+    if (!args.isValid())
+        return 1;
+    MatchCoordinator coordinator(settings);
+    return coordinator.run();
+}
+
+#endif
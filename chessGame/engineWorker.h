@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "search.h"
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Hands the latest value from one producer thread to one consumer thread through three
+// slots: the producer fills its own slot and swaps it into the middle, the consumer swaps
+// the middle for its slot when something new is there. Neither side ever waits or locks.
+template <typename T>
+class Mailbox
+{
+public:
+    T &writeSlot() // Producer only
+    {
+        return slots[back];
+    }
+
+    void publish() // Producer only; replaces any value the consumer has not taken yet
+    {
+        back = middle.exchange(back | FRESH) & INDEX;
+    }
+
+    bool receive() // Consumer only; true if read() now holds a newer value
+    {
+        if (!(middle.load() & FRESH))
+            return false;
+        front = middle.exchange(front) & INDEX;
+        return true;
+    }
+
+    const T &read() const // Consumer only
+    {
+        return slots[front];
+    }
+
+private:
+    static const int INDEX = 3, FRESH = 4;
+    T slots[3];
+    int back = 0, front = 1;
+    atomic<int> middle{2};
+};
+
+struct EngineReport // One completed search iteration
+{
+    uint64_t generation = 0; // Position the search belongs to
+    int depth = 0;
+    int whiteScore = 0; // Centipawns or mate score, from white's point of view
+    uint64_t nodes = 0;
+    double seconds = 0;
+    Move bestMove = MOVE_NONE;
+    bool isFinal = false; // The search finished on its own (time limit or depth), so bestMove can be played
+    string line;          // Principal variation in SAN
+};
+
+inline string scoreText(int whiteScore) // "+0.35", "-1.20", "M3", "-M2"
+{
+    if (abs(whiteScore) >= VALUE_MATE_IN_MAX_PLY)
+        return string(whiteScore < 0 ? "-M" : "M") + to_string((VALUE_MATE - abs(whiteScore) + 1) / 2);
+    char text[16];
+    snprintf(text, sizeof(text), "%+.2f", whiteScore / 100.0);
+    return text;
+}
+
+// Runs the search on its own thread. Every new position cancels the search in progress;
+// results come back through a Mailbox that the UI polls once per frame.
+class EngineWorker
+{
+public:
+    EngineWorker() = default;
+    EngineWorker(const EngineWorker &) = delete;
+    EngineWorker &operator=(const EngineWorker &) = delete;
+
+    ~EngineWorker()
+    {
+        {
+            lock_guard<mutex> lock(jobMutex);
+            isStopping = true;
+            search.stopRequested = true;
+        }
+        jobReady.notify_one();
+        if (worker.joinable())
+            worker.join();
+    }
+
+    // Starts searching a position, abandoning the previous one. moveTimeMs = 0 searches until cancelled.
+    void analyze(const Position &pos, uint64_t generation, const vector<Move> &rootMoves, int64_t moveTimeMs)
+    {
+        {
+            lock_guard<mutex> lock(jobMutex);
+            job = {pos, generation, rootMoves, moveTimeMs};
+            hasJob = true;
+            search.stopRequested = true; // Cleared by the worker when it takes the job
+            if (!worker.joinable())
+                worker = thread(&EngineWorker::run, this);
+        }
+        jobReady.notify_one();
+    }
+
+    void cancel() // Stops searching until the next analyze()
+    {
+        lock_guard<mutex> lock(jobMutex);
+        hasJob = false;
+        search.stopRequested = true;
+    }
+
+    bool receive(EngineReport &report) // UI thread: copies out the latest report, if there is a new one
+    {
+        if (!mailbox.receive())
+            return false;
+        report = mailbox.read();
+        return true;
+    }
+
+private:
+    struct Job
+    {
+        Position pos;
+        uint64_t generation = 0;
+        vector<Move> rootMoves;
+        int64_t moveTimeMs = 0;
+    };
+
+    Search search;
+    Mailbox<EngineReport> mailbox;
+    thread worker;
+    mutex jobMutex;
+    condition_variable jobReady;
+    Job job;
+    bool hasJob = false;
+    bool isStopping = false;
+
+    void run()
+    {
+#ifdef __linux__
+        setpriority(PRIO_PROCESS, syscall(SYS_gettid), 10); // Rendering goes first when cores are scarce
+#endif
+        while (true)
+        {
+            Job current;
+            {
+                unique_lock<mutex> lock(jobMutex);
+                jobReady.wait(lock, [this]
+                              { return hasJob || isStopping; });
+                if (isStopping)
+                    return;
+                current = job;
+                hasJob = false;
+                search.stopRequested = false; // A newer job sets it again under the same lock
+            }
+
+            SearchLimits limits;
+            limits.rootMoves = current.rootMoves;
+            limits.moveTimeMs = current.moveTimeMs;
+            bool whiteToMove = current.pos.sideToMove == WHITE;
+            auto publish = [&](const SearchResult &result, bool isFinal)
+            {
+                EngineReport &report = mailbox.writeSlot();
+                report.generation = current.generation;
+                report.depth = result.depth;
+                report.whiteScore = whiteToMove ? result.score : -result.score;
+                report.nodes = result.nodes;
+                report.seconds = result.seconds;
+                report.bestMove = result.bestMove;
+                report.isFinal = isFinal;
+                report.line.clear();
+                Position line = current.pos;
+                for (size_t i = 0; i < result.pv.size() && i < 8; i++)
+                {
+                    report.line += (i ? " " : "") + line.moveToSan(result.pv[i]);
+                    line.makeMove(result.pv[i]);
+                }
+                mailbox.publish();
+            };
+            search.onIteration = [&](const SearchResult &result)
+            { publish(result, false); };
+
+            Position pos = current.pos;
+            SearchResult result = search.think(pos, limits);
+            if (!search.stopRequested && result.bestMove != MOVE_NONE)
+                publish(result, true);
+        }
+    }
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "position.h"
+
+using namespace std;
+
+// Material and piece-square evaluation. Tables are laid out like the board (a8 first),
+// written from white's point of view; black squares are mirrored with sq ^ 56.
+const int PIECE_VALUE[6] = {100, 320, 330, 500, 900, 0};
+
+const int PAWN_TABLE[64] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    50, 50, 50, 50, 50, 50, 50, 50,
+    10, 10, 20, 30, 30, 20, 10, 10,
+    5, 5, 10, 25, 25, 10, 5, 5,
+    0, 0, 0, 20, 20, 0, 0, 0,
+    5, -5, -10, 0, 0, -10, -5, 5,
+    5, 10, 10, -20, -20, 10, 10, 5,
+    0, 0, 0, 0, 0, 0, 0, 0};
+
+const int KNIGHT_TABLE[64] = {
+    -50, -40, -30, -30, -30, -30, -40, -50,
+    -40, -20, 0, 0, 0, 0, -20, -40,
+    -30, 0, 10, 15, 15, 10, 0, -30,
+    -30, 5, 15, 20, 20, 15, 5, -30,
+    -30, 0, 15, 20, 20, 15, 0, -30,
+    -30, 5, 10, 15, 15, 10, 5, -30,
+    -40, -20, 0, 5, 5, 0, -20, -40,
+    -50, -40, -30, -30, -30, -30, -40, -50};
+
+const int BISHOP_TABLE[64] = {
+    -20, -10, -10, -10, -10, -10, -10, -20,
+    -10, 0, 0, 0, 0, 0, 0, -10,
+    -10, 0, 5, 10, 10, 5, 0, -10,
+    -10, 5, 5, 10, 10, 5, 5, -10,
+    -10, 0, 10, 10, 10, 10, 0, -10,
+    -10, 10, 10, 10, 10, 10, 10, -10,
+    -10, 5, 0, 0, 0, 0, 5, -10,
+    -20, -10, -10, -10, -10, -10, -10, -20};
+
+const int ROOK_TABLE[64] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    5, 10, 10, 10, 10, 10, 10, 5,
+    -5, 0, 0, 0, 0, 0, 0, -5,
+    -5, 0, 0, 0, 0, 0, 0, -5,
+    -5, 0, 0, 0, 0, 0, 0, -5,
+    -5, 0, 0, 0, 0, 0, 0, -5,
+    -5, 0, 0, 0, 0, 0, 0, -5,
+    0, 0, 0, 5, 5, 0, 0, 0};
+
+const int QUEEN_TABLE[64] = {
+    -20, -10, -10, -5, -5, -10, -10, -20,
+    -10, 0, 0, 0, 0, 0, 0, -10,
+    -10, 0, 5, 5, 5, 5, 0, -10,
+    -5, 0, 5, 5, 5, 5, 0, -5,
+    0, 0, 5, 5, 5, 5, 0, -5,
+    -10, 5, 5, 5, 5, 5, 0, -10,
+    -10, 0, 5, 0, 0, 0, 0, -10,
+    -20, -10, -10, -5, -5, -10, -10, -20};
+
+const int KING_MIDDLEGAME_TABLE[64] = {
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -20, -30, -30, -40, -40, -30, -30, -20,
+    -10, -20, -20, -20, -20, -20, -20, -10,
+    20, 20, 0, 0, 0, 0, 20, 20,
+    20, 30, 10, 0, 0, 10, 30, 20};
+
+const int KING_ENDGAME_TABLE[64] = {
+    -50, -40, -30, -20, -20, -30, -40, -50,
+    -30, -20, -10, 0, 0, -10, -20, -30,
+    -30, -10, 20, 30, 30, 20, -10, -30,
+    -30, -10, 30, 40, 40, 30, -10, -30,
+    -30, -10, 30, 40, 40, 30, -10, -30,
+    -30, -10, 20, 30, 30, 20, -10, -30,
+    -30, -30, 0, 0, 0, 0, -30, -30,
+    -50, -30, -30, -30, -30, -30, -30, -50};
+
+const int *const PIECE_TABLES[5] = {PAWN_TABLE, KNIGHT_TABLE, BISHOP_TABLE, ROOK_TABLE, QUEEN_TABLE};
+
+const int PHASE_WEIGHT[6] = {0, 1, 1, 2, 4, 0}; // Non-pawn material used to blend the king tables
+const int MAX_PHASE = 24;
+
+inline int evaluate(const Position &pos) // Score in centipawns from the side to move's point of view
+{
+    int score[2] = {0, 0};
+    int phase = 0;
+
+    for (int color = WHITE; color <= BLACK; color++)
+    {
+        for (int type = PAWN; type <= QUEEN; type++)
+        {
+            Bitboard pieceSet = pos.pieces(color, type);
+            while (pieceSet)
+            {
+                int sq = popLsb(pieceSet);
+                int tableSq = color == WHITE ? sq : sq ^ 56;
+                score[color] += PIECE_VALUE[type] + PIECE_TABLES[type][tableSq];
+                phase += PHASE_WEIGHT[type];
+            }
+        }
+    }
+
+    phase = min(phase, MAX_PHASE);
+    for (int color = WHITE; color <= BLACK; color++)
+    {
+        int ksq = pos.kingSquare(color);
+        int tableSq = color == WHITE ? ksq : ksq ^ 56;
+        score[color] += (KING_MIDDLEGAME_TABLE[tableSq] * phase + KING_ENDGAME_TABLE[tableSq] * (MAX_PHASE - phase)) / MAX_PHASE;
+    }
+
+    int whiteScore = score[WHITE] - score[BLACK];
+    return pos.sideToMove == WHITE ? whiteScore : -whiteScore;
+}
@@ -0,0 +1,377 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include "gameDb.h"
+
+using namespace std;
+
+// Opening explorer index: every (position, move) pair played in a game database with the
+// results of those games, sorted by position hash so all continuations of a position sit
+// next to each other. File layout: ExplorerHeader, then ExplorerRecord entries sorted by
+// key and move. Queries map the file and binary search it. The keys are only meaningful to a
+// build with the same Zobrist keys, so the header records the format version and the key of
+// the initial position, and an index that does not match has to be rebuilt.
+
+const char EXPLORER_MAGIC[8] = {'C', 'H', 'E', 'S', 'S', 'E', 'X', '1'};
+const uint32_t EXPLORER_VERSION = 2; // Bump when the record layout or the meaning of a key changes
+
+struct ExplorerHeader
+{
+    char magic[8];
+    uint64_t recordCount;
+    uint32_t maxPlies; // Depth the games were indexed to
+    uint32_t version;  // EXPLORER_VERSION of the build that wrote it
+    uint64_t startKey; // Position::key of the initial position, which changes with the Zobrist keys
+};
+
+inline uint64_t explorerStartKey()
+{
+    return Position().key;
+}
+
+struct ExplorerRecord
+{
+    uint64_t key; // Position::key before the move
+    uint16_t move;
+    uint16_t reserved;
+    uint32_t white, draws, black; // Results of the games that played this move here
+
+    bool operator<(const ExplorerRecord &other) const
+    {
+        return key != other.key ? key < other.key : move < other.move;
+    }
+};
+
+struct ExplorerMove
+{
+    Move move;
+    uint32_t white, draws, black;
+
+    uint32_t games() const
+    {
+        return white + draws + black;
+    }
+};
+
+class OpeningExplorer
+{
+public:
+    bool open(const string &path)
+    {
+        records = nullptr;
+        count = 0;
+        if (!file.open(path, true))
+            return false;
+        ExplorerHeader header;
+        if (file.size() < sizeof(header))
+            return fail(path);
+        memcpy(&header, file.data(), sizeof(header));
+        if (memcmp(header.magic, EXPLORER_MAGIC, 8) != 0)
+            return fail(path);
+        if (header.version != EXPLORER_VERSION || header.startKey != explorerStartKey())
+        {
+            cerr << "Error: " << path << " was built by a different version; rebuild it with chess explorer build" << endl;
+            file.close();
+            return false;
+        }
+        if (header.recordCount > (file.size() - sizeof(header)) / sizeof(ExplorerRecord) ||
+            sizeof(header) + header.recordCount * sizeof(ExplorerRecord) != file.size())
+            return fail(path);
+        records = (const ExplorerRecord *)(file.data() + sizeof(header));
+        count = header.recordCount;
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return records != nullptr;
+    }
+
+    size_t recordCount() const
+    {
+        return count;
+    }
+
+    vector<ExplorerMove> query(uint64_t key) const // Continuations of a position, most played first
+    {
+        vector<ExplorerMove> moves;
+        if (!records)
+            return moves;
+        const ExplorerRecord *it = lower_bound(records, records + count, key, [](const ExplorerRecord &r, uint64_t k)
+                                               { return r.key < k; });
+        for (; it != records + count && it->key == key; ++it)
+            moves.push_back({it->move, it->white, it->draws, it->black});
+        sort(moves.begin(), moves.end(), [](const ExplorerMove &a, const ExplorerMove &b)
+             { return a.games() > b.games(); });
+        return moves;
+    }
+
+private:
+    MappedFile file;
+    const ExplorerRecord *records = nullptr;
+    size_t count = 0;
+
+    bool fail(const string &path)
+    {
+        cerr << "Error: " << path << " is not an explorer index" << endl;
+        file.close();
+        return false;
+    }
+};
+
+// Sorts raw (position, move, result) entries and folds equal pairs into records
+inline void aggregateEntries(vector<ExplorerRecord> &entries)
+{
+    sort(entries.begin(), entries.end());
+    size_t out = 0;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (out > 0 && entries[out - 1].key == entries[i].key && entries[out - 1].move == entries[i].move)
+        {
+            entries[out - 1].white += entries[i].white;
+            entries[out - 1].draws += entries[i].draws;
+            entries[out - 1].black += entries[i].black;
+        }
+        else
+            entries[out++] = entries[i];
+    }
+    entries.resize(out);
+}
+
+class RunReader // Buffered sequential reader over one sorted run file
+{
+public:
+    explicit RunReader(const string &path) : in(path, ios::binary) {}
+
+    bool next(ExplorerRecord &record)
+    {
+        if (position == buffer.size())
+        {
+            buffer.resize(4096);
+            in.read((char *)buffer.data(), buffer.size() * sizeof(ExplorerRecord));
+            buffer.resize(in.gcount() / sizeof(ExplorerRecord));
+            position = 0;
+            if (buffer.empty())
+                return false;
+        }
+        record = buffer[position++];
+        return true;
+    }
+
+private:
+    ifstream in;
+    vector<ExplorerRecord> buffer;
+    size_t position = 0;
+};
+
+// Builds an explorer index from a game database with an external sort: worker threads replay
+// their share of the games into a memory-bounded buffer, and every full buffer is sorted,
+// aggregated and written out as a run; the runs are then merged into the final file.
+inline bool buildExplorerIndex(const string &dbPath, const string &outPath, int maxPlies, unsigned threads, size_t memoryBytes)
+{
+    GameDbReader reader;
+    if (!reader.open(dbPath))
+        return false;
+    threads = max(1u, threads);
+    filesystem::path parent = filesystem::path(outPath).parent_path();
+    if (!parent.empty())
+        filesystem::create_directories(parent);
+    size_t bufferEntries = max<size_t>(1024, memoryBytes / threads / sizeof(ExplorerRecord));
+
+    mutex runsMutex;
+    vector<string> runs;
+    atomic<bool> failed{false};
+    auto writeRun = [&](vector<ExplorerRecord> &entries)
+    {
+        aggregateEntries(entries);
+        string path;
+        {
+            lock_guard<mutex> lock(runsMutex);
+            path = outPath + ".run" + to_string(runs.size());
+            runs.push_back(path);
+        }
+        ofstream out(path, ios::binary);
+        out.write((const char *)entries.data(), entries.size() * sizeof(ExplorerRecord));
+        if (!out)
+            failed = true;
+        entries.clear();
+    };
+
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]
+                             {
+            vector<ExplorerRecord> entries;
+            entries.reserve(bufferEntries);
+            Position pos;
+            size_t first = reader.gameCount() * t / threads, last = reader.gameCount() * (t + 1) / threads;
+            for (size_t i = first; i < last; i++)
+            {
+                DbGameView game = reader.view(i);
+                if (game.result == RESULT_UNKNOWN)
+                    continue; // Unfinished games have no result to count
+                if (!pos.setFen(game.startFen ? game.startFen : Position::START_FEN))
+                    continue;
+                int plies = min(game.moveCount, maxPlies);
+                for (int ply = 0; ply < plies; ply++)
+                {
+                    if (!isReplayableMove(pos, game.moves[ply]))
+                        break; // A corrupt record; keep what was played before it
+                    ExplorerRecord entry = {pos.key, game.moves[ply], 0, game.result == RESULT_WHITE_WINS,
+                                            game.result == RESULT_DRAW, game.result == RESULT_BLACK_WINS};
+                    entries.push_back(entry);
+                    if (entries.size() == bufferEntries)
+                        writeRun(entries);
+                    pos.makeMove(game.moves[ply]);
+                }
+            }
+            if (!entries.empty())
+                writeRun(entries); });
+    }
+    for (thread &worker : workers)
+        worker.join();
+
+    // Merge the runs, folding pairs that appear in more than one run
+    vector<unique_ptr<RunReader>> readers;
+    typedef pair<ExplorerRecord, size_t> Head;
+    auto later = [](const Head &a, const Head &b)
+    { return b.first < a.first; };
+    priority_queue<Head, vector<Head>, decltype(later)> heads(later);
+    for (size_t r = 0; r < runs.size(); r++)
+    {
+        readers.push_back(make_unique<RunReader>(runs[r]));
+        ExplorerRecord record;
+        if (readers[r]->next(record))
+            heads.push({record, r});
+    }
+
+    ofstream out(outPath, ios::binary | ios::trunc);
+    ExplorerHeader header = {};
+    memcpy(header.magic, EXPLORER_MAGIC, 8);
+    header.maxPlies = maxPlies;
+    header.version = EXPLORER_VERSION;
+    header.startKey = explorerStartKey();
+    out.write((const char *)&header, sizeof(header));
+
+    vector<ExplorerRecord> pending; // Output buffer
+    pending.reserve(4096);
+    ExplorerRecord current = {};
+    bool hasCurrent = false;
+    auto emit = [&](const ExplorerRecord &record)
+    {
+        pending.push_back(record);
+        header.recordCount++;
+        if (pending.size() == pending.capacity())
+        {
+            out.write((const char *)pending.data(), pending.size() * sizeof(ExplorerRecord));
+            pending.clear();
+        }
+    };
+    while (!heads.empty())
+    {
+        auto [record, r] = heads.top();
+        heads.pop();
+        ExplorerRecord next;
+        if (readers[r]->next(next))
+            heads.push({next, r});
+
+        if (hasCurrent && current.key == record.key && current.move == record.move)
+        {
+            current.white += record.white;
+            current.draws += record.draws;
+            current.black += record.black;
+            continue;
+        }
+        if (hasCurrent)
+            emit(current);
+        current = record;
+        hasCurrent = true;
+    }
+    if (hasCurrent)
+        emit(current);
+    out.write((const char *)pending.data(), pending.size() * sizeof(ExplorerRecord));
+    out.seekp(0);
+    out.write((const char *)&header, sizeof(header));
+    bool ok = bool(out) && !failed;
+
+    readers.clear();
+    for (const string &run : runs)
+        remove(run.c_str());
+    if (!ok)
+        cerr << "Error: failed to write " << outPath << endl;
+    return ok;
+}
+
+// "chess explorer build <games.db> [--out file] [--plies 30] [--threads N] [--memory MB]"
+// "chess explorer query <index> [--fen FEN] [--moves \"e2e4 e7e5\"]"
+inline int runExplorer(const CommandArgs &args)
+{
+    if (args.positional.size() < 2 || (args.positional[0] != "build" && args.positional[0] != "query"))
+    {
+        cerr << "Usage: chess explorer build <games.db> [--out file] [--plies 30] [--threads N] [--memory MB]\n"
+             << "       chess explorer query <index> [--fen FEN] [--moves \"e2e4 e7e5\"]" << endl;
+        return 1;
+    }
+
+    if (args.positional[0] == "build")
+    {
+        string outPath = args.getString("out", "Database/explorer.idx");
+        int plies = args.getInt("plies", 30, 1);
+        unsigned threads = args.getInt("threads", max(1u, thread::hardware_concurrency()), 1);
+        size_t memory = size_t(args.getInt("memory", 512, 1)) << 20;
+        if (!args.isValid())
+            return 1;
+        auto start = chrono::steady_clock::now();
+        if (!buildExplorerIndex(args.positional[1], outPath, plies, threads, memory))
+            return 1;
+        OpeningExplorer explorer;
+        explorer.open(outPath);
+        cout << fixed << setprecision(2) << "Indexed the first " << plies << " plies into " << explorer.recordCount()
+             << " position/move records (" << filesystem::file_size(outPath) / 1e6 << " MB) in "
+             << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s with " << threads << " threads" << endl;
+        return 0;
+    }
+
+    OpeningExplorer explorer;
+    if (!explorer.open(args.positional[1]))
+        return 1;
+    Position pos;
+    if (!pos.setFen(args.getString("fen", Position::START_FEN)))
+    {
+        cerr << "Error: invalid FEN " << args.getString("fen", "") << endl;
+        return 1;
+    }
+    istringstream moves(args.getString("moves", ""));
+    string uci;
+    while (moves >> uci)
+    {
+        Move m = pos.parseUci(uci);
+        if (m == MOVE_NONE)
+        {
+            cerr << "Error: illegal move " << uci << endl;
+            return 1;
+        }
+        pos.makeMove(m);
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<ExplorerMove> found = explorer.query(pos.key);
+    double micros = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+
+    cout << pos.fen() << "\n";
+    for (const ExplorerMove &entry : found)
+    {
+        double games = entry.games();
+        cout << left << setw(8) << pos.moveToSan(entry.move) << right << setw(10) << entry.games() << fixed << setprecision(1)
+             << "   white " << setw(5) << 100 * entry.white / games << "%  draw " << setw(5) << 100 * entry.draws / games
+             << "%  black " << setw(5) << 100 * entry.black / games << "%\n";
+    }
+    cout << found.size() << " moves, query took " << setprecision(1) << micros << " us" << endl;
+    return 0;
+}
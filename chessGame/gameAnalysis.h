@@ -0,0 +1,322 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include "commandLine.h"
+#include "engineWorker.h"
+#include "pgn.h"
+#include "threadPool.h"
+
+using namespace std;
+
+// Post-game analysis: every position of a game is searched to a fixed depth, all of them at
+// once on a thread pool. Each worker keeps its own Search (killers, history, PV), while the
+// transposition table is shared, so neighbouring positions of the game reuse each other's
+// subtrees. Comparing the score before a move with the score after it gives how much the
+// move gave away.
+
+enum MoveQuality
+{
+    MOVE_GOOD,
+    MOVE_INACCURACY,
+    MOVE_MISTAKE,
+    MOVE_BLUNDER
+};
+
+struct PlyAnalysis
+{
+    string san;              // The move played
+    string bestSan;          // The engine's choice in the position before it
+    int bestScore = 0;       // Score of the position before the move, from white's point of view
+    int playedScore = 0;     // Score after the move, from white's point of view
+    int loss = 0;            // Centipawns the mover gave away; 0 when the engine agrees with the move
+    MoveQuality quality = MOVE_GOOD;
+};
+
+inline const char *qualitySuffix(MoveQuality quality) // Appended to the move in the move list
+{
+    static const char *suffixes[] = {"", "?!", "?", "??"};
+    return suffixes[quality];
+}
+
+inline MoveQuality classifyLoss(int loss)
+{
+    return loss >= 300 ? MOVE_BLUNDER : loss >= 100 ? MOVE_MISTAKE : loss >= 50 ? MOVE_INACCURACY : MOVE_GOOD;
+}
+
+inline int clampForLoss(int score) // A decided position counts as 10 pawns, so moving from mate in 3 to mate in 5 is no blunder
+{
+    return max(-1000, min(1000, score));
+}
+
+inline string playedScoreText(const PlyAnalysis &ply) // scoreText, but "mate" after the mating move instead of "M0"
+{
+    return abs(ply.playedScore) == VALUE_MATE ? "mate" : scoreText(ply.playedScore);
+}
+
+struct AnalysisSettings
+{
+    int depth = 10;
+    unsigned threads = thread::hardware_concurrency();
+    size_t hashMegabytes = 64; // Shared by all workers
+};
+
+class GameAnalysis
+{
+public:
+    GameAnalysis(const string &startFen, const vector<string> &sanMoves, const AnalysisSettings &settings)
+        : settings(settings), startFen(startFen), sanMoves(sanMoves), tt(settings.hashMegabytes)
+    {
+    }
+
+    GameAnalysis(const GameAnalysis &) = delete;
+    GameAnalysis &operator=(const GameAnalysis &) = delete;
+
+    ~GameAnalysis()
+    {
+        cancelled = true;
+        for (auto &search : searches)
+            search->stopRequested = true;
+        pool.reset(); // Waits for the searches in progress to stop
+    }
+
+    bool start() // Replays the moves and hands the positions to the workers; false if the FEN or a move does not fit
+    {
+        Position pos;
+        if (!pos.setFen(startFen))
+        {
+            cerr << "Error: invalid start FEN " << startFen << " for analysis" << endl;
+            return false;
+        }
+        positions.push_back(pos);
+        for (size_t i = 0; i < sanMoves.size(); i++)
+        {
+            Move m = pos.parseSan(sanMoves[i]);
+            if (m == MOVE_NONE)
+            {
+                cerr << "Error: cannot replay move " << i + 1 << " (" << sanMoves[i] << ") for analysis" << endl;
+                return false;
+            }
+            played.push_back(m);
+            pos.makeMove(m);
+            positions.push_back(pos);
+        }
+        scores.assign(positions.size(), 0);
+        bestMoves.assign(positions.size(), MOVE_NONE);
+
+        startTime = chrono::steady_clock::now();
+        unsigned threads = max(1u, min<unsigned>(settings.threads, positions.size()));
+        for (unsigned t = 0; t < threads; t++)
+            searches.push_back(make_unique<Search>(tt));
+        pool = make_unique<ThreadPool>(threads);
+        for (unsigned t = 0; t < threads; t++)
+            pool->submit([this, t] { work(*searches[t]); });
+        return true;
+    }
+
+    size_t positionCount() const
+    {
+        return positions.size();
+    }
+
+    bool startsWithWhite() const // Side to move in the start position, once start() succeeded
+    {
+        return positions.empty() || positions[0].sideToMove == WHITE;
+    }
+
+    size_t searchedCount() const
+    {
+        return searched;
+    }
+
+    bool isDone() const
+    {
+        return !positions.empty() && searched == positions.size();
+    }
+
+    void wait()
+    {
+        if (pool)
+            pool->waitIdle();
+    }
+
+    double seconds() const // Wall time from start() until the last position was searched
+    {
+        return finishedNs / 1e9;
+    }
+
+    uint64_t nodes() const
+    {
+        return totalNodes;
+    }
+
+    int depth() const
+    {
+        return settings.depth;
+    }
+
+    vector<PlyAnalysis> results() const // One entry per move, once isDone()
+    {
+        vector<PlyAnalysis> plies;
+        if (!isDone())
+            return plies;
+        for (size_t i = 0; i < played.size(); i++)
+        {
+            Position before = positions[i];
+            PlyAnalysis ply;
+            ply.san = before.moveToSan(played[i]);
+            ply.bestSan = bestMoves[i] == MOVE_NONE ? "" : before.moveToSan(bestMoves[i]);
+            ply.bestScore = scores[i];
+            ply.playedScore = scores[i + 1];
+            int sign = before.sideToMove == WHITE ? 1 : -1;
+            if (played[i] != bestMoves[i])
+                ply.loss = max(0, sign * (clampForLoss(ply.bestScore) - clampForLoss(ply.playedScore)));
+            ply.quality = classifyLoss(ply.loss);
+            plies.push_back(ply);
+        }
+        return plies;
+    }
+
+private:
+    AnalysisSettings settings;
+    string startFen;
+    vector<string> sanMoves;
+    TranspositionTable tt;
+    vector<Position> positions; // Before every move, and the final one
+    vector<Move> played;
+    vector<int> scores;         // White's point of view, written by the worker that searched the position
+    vector<Move> bestMoves;
+    vector<unique_ptr<Search>> searches; // One per worker
+    unique_ptr<ThreadPool> pool;
+    atomic<size_t> nextPosition{0};
+    atomic<size_t> searched{0};
+    atomic<uint64_t> totalNodes{0};
+    atomic<int64_t> finishedNs{0};
+    atomic<bool> cancelled{false};
+    chrono::steady_clock::time_point startTime;
+
+    void work(Search &search)
+    {
+        while (!cancelled)
+        {
+            size_t i = nextPosition++;
+            if (i >= positions.size())
+                return;
+            Position pos = positions[i];
+            MoveList moves;
+            pos.generateLegal(moves);
+            int score;
+            if (moves.size == 0)
+                score = pos.inCheck() ? -VALUE_MATE : VALUE_DRAW; // The game ended here
+            else
+            {
+                SearchLimits limits;
+                limits.depth = settings.depth;
+                SearchResult result = search.think(pos, limits);
+                if (cancelled)
+                    return;
+                score = result.score;
+                bestMoves[i] = result.bestMove;
+                totalNodes += result.nodes;
+            }
+            scores[i] = pos.sideToMove == WHITE ? score : -score;
+            if (++searched == positions.size())
+                finishedNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - startTime).count();
+        }
+    }
+};
+
+// Writes the analysis into a game as PGN annotations: a NAG for inaccuracies ($6), mistakes
+// ($2) and blunders ($4), and a comment with the score after every move, plus the engine's
+// move where it disagreed.
+inline void annotatePgn(PgnGame &game, const vector<PlyAnalysis> &plies, int depth)
+{
+    static const char *nags[] = {"", "$6 ", "$2 ", "$4 "};
+    game.moves.clear();
+    game.annotations.clear();
+    for (const PlyAnalysis &ply : plies)
+    {
+        string comment = playedScoreText(ply);
+        if (ply.quality != MOVE_GOOD)
+            comment += "; best " + ply.bestSan + " " + scoreText(ply.bestScore);
+        game.moves.push_back(ply.san);
+        game.annotations.push_back(nags[ply.quality] + ("{" + comment + "}"));
+    }
+    game.setTag("Annotator", "chess analyze, depth " + to_string(depth));
+}
+
+inline string analysisSummary(const vector<PlyAnalysis> &plies, bool whiteMovedFirst) // "white: 23 cp/move, 1?! 0? 1??"
+{
+    int counts[2][4] = {}, loss[2] = {}, moves[2] = {};
+    for (size_t i = 0; i < plies.size(); i++)
+    {
+        int side = (i % 2 == 0) == whiteMovedFirst ? WHITE : BLACK;
+        counts[side][plies[i].quality]++;
+        loss[side] += plies[i].loss;
+        moves[side]++;
+    }
+    ostringstream out;
+    for (int side = WHITE; side <= BLACK; side++)
+        out << (side == WHITE ? "white: " : ", black: ") << (moves[side] ? loss[side] / moves[side] : 0) << " cp/move, "
+            << counts[side][MOVE_INACCURACY] << "?! " << counts[side][MOVE_MISTAKE] << "? " << counts[side][MOVE_BLUNDER] << "??";
+    return out.str();
+}
+
+// "chess analyze <games.pgn> [--out annotated.pgn] [--depth 10] [--threads N] [--hash 64]"
+inline int runAnalyze(const CommandArgs &args)
+{
+    AnalysisSettings settings;
+    settings.depth = args.getInt("depth", settings.depth, 1, MAX_PLY - 1);
+    settings.threads = args.getInt("threads", max(1u, settings.threads), 1);
+    settings.hashMegabytes = args.getInt("hash", int(settings.hashMegabytes), 1);
+    if (args.positional.empty() || !args.isValid())
+    {
+        cerr << "Usage: chess analyze <games.pgn> [--out annotated.pgn] [--depth 10] [--threads N] [--hash 64]" << endl;
+        return 1;
+    }
+    ifstream in(args.positional[0]);
+    if (!in)
+    {
+        cerr << "Error: cannot open " << args.positional[0] << endl;
+        return 1;
+    }
+    string outPath = args.getString("out", "annotated.pgn");
+    ofstream out(outPath);
+    if (!out)
+    {
+        cerr << "Error: cannot write " << outPath << endl;
+        return 1;
+    }
+
+    PgnGame game;
+    int games = 0;
+    size_t totalPositions = 0;
+    double totalSeconds = 0;
+    while (readPgn(in, game))
+    {
+        games++;
+        GameAnalysis analysis(game.startFen, game.moves, settings);
+        if (!analysis.start())
+        {
+            cerr << "Error: game " << games << " skipped" << endl;
+            continue;
+        }
+        analysis.wait();
+        vector<PlyAnalysis> plies = analysis.results();
+        totalPositions += analysis.positionCount();
+        totalSeconds += analysis.seconds();
+        cout << "Game " << games << ": " << plies.size() << " plies in " << fixed << setprecision(2) << analysis.seconds()
+             << " s, " << analysis.nodes() << " nodes; " << analysisSummary(plies, analysis.startsWithWhite())
+             << endl;
+        annotatePgn(game, plies, settings.depth);
+        writePgn(out, game);
+    }
+    cout << games << " games, " << totalPositions << " positions at depth " << settings.depth << " on " << settings.threads
+         << " threads in " << fixed << setprecision(2) << totalSeconds << " s; annotated games written to " << outPath << endl;
+    return 0;
+}
@@ -0,0 +1,541 @@
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include "commandLine.h"
+#include "mappedFile.h"
+#include "pgn.h"
+
+using namespace std;
+
+// Binary game database, one file (all integers little-endian):
+//   DbFileHeader
+//   records   DbRecordHeader, tags as "key\0value\0" pairs, the start FEN with its '\0' when
+//             the game does not start from the initial position, padding to 2 bytes, then one
+//             16-bit Position Move per ply; padded to 8 bytes
+//   index     gameCount record offsets (uint64)
+//   DbFileFooter
+// Writers only append records. The index and footer are rewritten when the writer closes;
+// a file without a valid footer (the writer died) is re-indexed by walking the records.
+
+const char DB_MAGIC[8] = {'C', 'H', 'E', 'S', 'S', 'D', 'B', '1'};
+const uint16_t DB_RECORD_MARKER = 0x6D67; // Catches a walk that runs past the last whole record
+const uint8_t DB_HAS_START_FEN = 1;
+
+struct DbFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct DbRecordHeader
+{
+    uint32_t size; // Whole record including padding
+    uint16_t marker;
+    uint16_t moveCount;
+    uint16_t tagBytes;
+    uint16_t fenBytes; // Including the '\0'; 0 without a start FEN
+    uint8_t result;    // DbResult
+    uint8_t flags;
+    uint16_t reserved;
+};
+
+struct DbFileFooter
+{
+    uint64_t indexOffset;
+    uint64_t gameCount;
+    char magic[8];
+};
+
+enum DbResult : uint8_t
+{
+    RESULT_UNKNOWN,
+    RESULT_WHITE_WINS,
+    RESULT_BLACK_WINS,
+    RESULT_DRAW
+};
+
+inline uint8_t resultCode(const string &result)
+{
+    if (result == "1-0")
+        return RESULT_WHITE_WINS;
+    if (result == "0-1")
+        return RESULT_BLACK_WINS;
+    if (result == "1/2-1/2")
+        return RESULT_DRAW;
+    return RESULT_UNKNOWN;
+}
+
+inline string resultString(uint8_t code)
+{
+    static const char *names[] = {"*", "1-0", "0-1", "1/2-1/2"};
+    return code <= RESULT_DRAW ? names[code] : "*";
+}
+
+inline size_t roundUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+struct DbGame // A stored game with its moves decoded
+{
+    vector<pair<string, string>> tags;
+    string startFen = Position::START_FEN;
+    vector<Move> moves;
+    string result = "*";
+};
+
+inline bool pgnToDbGame(const PgnGame &pgn, DbGame &game) // False if a move is not legal SAN
+{
+    game = DbGame();
+    game.tags = pgn.tags;
+    game.startFen = pgn.startFen;
+    game.result = pgn.result;
+    Position pos;
+    if (!pos.setFen(pgn.startFen))
+        return false;
+    for (const string &san : pgn.moves)
+    {
+        Move m = pos.parseSan(san);
+        if (m == MOVE_NONE)
+            return false;
+        game.moves.push_back(m);
+        pos.makeMove(m);
+    }
+    return true;
+}
+
+inline bool dbToPgnGame(const DbGame &game, PgnGame &pgn) // False if the start FEN or a move is invalid
+{
+    pgn = PgnGame();
+    pgn.tags = game.tags;
+    pgn.startFen = game.startFen;
+    pgn.result = game.result;
+    Position pos;
+    if (!pos.setFen(game.startFen))
+        return false;
+    for (Move m : game.moves)
+    {
+        if (!pos.isPseudoLegal(m) || !pos.isLegal(m))
+            return false;
+        pgn.moves.push_back(pos.moveToSan(m));
+        pos.makeMove(m);
+    }
+    return true;
+}
+
+// Enough of a check for a move read from a file to keep makeMove within its tables: one of our
+// pieces moves, it does not take our own piece or a king, and the rare special moves must be
+// ones the generator produces. A full legality check would cost the replay half its speed.
+inline bool isReplayableMove(const Position &pos, Move m)
+{
+    int piece = pos.pieceOn(moveFrom(m)), target = pos.pieceOn(moveTo(m));
+    if (piece == NO_PIECE || pieceColor(piece) != pos.sideToMove ||
+        (target != NO_PIECE && (pieceColor(target) == pos.sideToMove || pieceType(target) == KING)))
+        return false;
+    return moveFlag(m) == NORMAL_MOVE || pos.isPseudoLegal(m);
+}
+
+struct DbGameView // One game straight out of the mapped file, without copying
+{
+    const char *tagData = nullptr;
+    uint16_t tagBytes = 0;
+    const char *startFen = nullptr; // nullptr for the initial position
+    const uint16_t *moves = nullptr;
+    int moveCount = 0;
+    uint8_t result = RESULT_UNKNOWN;
+
+    string tag(const string &name) const
+    {
+        const char *p = tagData, *end = tagData + tagBytes;
+        while (p < end)
+        {
+            const char *value = p + strlen(p) + 1;
+            if (name == p)
+                return value;
+            p = value + strlen(value) + 1;
+        }
+        return "";
+    }
+};
+
+class GameDbReader // Random access to the games of a database file
+{
+public:
+    bool open(const string &path, bool randomAccess = false)
+    {
+        offsets.clear();
+        index = nullptr;
+        count = 0;
+        if (!file.open(path, randomAccess))
+            return false;
+        const uint8_t *data = file.data();
+        if (file.size() < sizeof(DbFileHeader) || memcmp(data, DB_MAGIC, 8) != 0)
+        {
+            cerr << "Error: " << path << " is not a game database" << endl;
+            file.close();
+            return false;
+        }
+
+        DbFileFooter footer;
+        bool hasFooter = false;
+        if (file.size() >= sizeof(DbFileHeader) + sizeof(footer))
+        {
+            memcpy(&footer, data + file.size() - sizeof(footer), sizeof(footer));
+            uint64_t indexEnd = file.size() - sizeof(footer);
+            hasFooter = memcmp(footer.magic, DB_MAGIC, 8) == 0;
+            if (hasFooter && footer.indexOffset >= sizeof(DbFileHeader) && footer.indexOffset % 8 == 0 &&
+                footer.indexOffset <= indexEnd && footer.gameCount == (indexEnd - footer.indexOffset) / 8 &&
+                (indexEnd - footer.indexOffset) % 8 == 0)
+            {
+                index = (const uint64_t *)(data + footer.indexOffset);
+                count = footer.gameCount;
+                recordsEnd = footer.indexOffset;
+                size_t i = 0;
+                while (i < count && isValidRecord(index[i], recordsEnd))
+                    i++;
+                if (i == count)
+                    return true;
+            }
+        }
+
+        // No footer, or an index that points outside the records: walk the records and keep every complete one
+        uint64_t offset = sizeof(DbFileHeader);
+        while (isValidRecord(offset, file.size()))
+        {
+            offsets.push_back(offset);
+            offset += ((const DbRecordHeader *)(data + offset))->size;
+        }
+        cerr << "Warning: " << path << (hasFooter ? " has a corrupt index" : " has no index") << ", recovered "
+             << offsets.size() << " games" << endl;
+        index = offsets.data();
+        count = offsets.size();
+        recordsEnd = offset;
+        return true;
+    }
+
+    size_t gameCount() const
+    {
+        return count;
+    }
+
+    uint64_t recordOffset(size_t i) const
+    {
+        return index[i];
+    }
+
+    uint64_t endOfRecords() const // Where a writer appends the next record
+    {
+        return recordsEnd;
+    }
+
+    DbGameView view(size_t i) const
+    {
+        const uint8_t *record = file.data() + index[i];
+        const DbRecordHeader *header = (const DbRecordHeader *)record;
+        DbGameView game;
+        game.tagData = (const char *)record + sizeof(DbRecordHeader);
+        game.tagBytes = header->tagBytes;
+        if (header->flags & DB_HAS_START_FEN)
+            game.startFen = game.tagData + header->tagBytes;
+        game.moves = (const uint16_t *)(record + movesOffset(*header));
+        game.moveCount = header->moveCount;
+        game.result = header->result;
+        return game;
+    }
+
+    DbGame game(size_t i) const
+    {
+        DbGameView view = this->view(i);
+        DbGame game;
+        const char *p = view.tagData, *end = view.tagData + view.tagBytes;
+        while (p < end)
+        {
+            const char *value = p + strlen(p) + 1;
+            game.tags.push_back({p, value});
+            p = value + strlen(value) + 1;
+        }
+        if (view.startFen)
+            game.startFen = view.startFen;
+        game.moves.assign(view.moves, view.moves + view.moveCount);
+        game.result = resultString(view.result);
+        return game;
+    }
+
+    // A record that lies within [header, end) and whose tags, start FEN and moves fit inside it,
+    // with every string terminated, so view() and game() cannot read past it
+    bool isValidRecord(uint64_t offset, uint64_t end) const
+    {
+        if (offset < sizeof(DbFileHeader) || offset % 8 != 0 || offset > end || end - offset < sizeof(DbRecordHeader))
+            return false;
+        const uint8_t *record = file.data() + offset;
+        const DbRecordHeader *header = (const DbRecordHeader *)record;
+        bool hasFen = header->flags & DB_HAS_START_FEN;
+        if (header->marker != DB_RECORD_MARKER || header->size != recordSize(*header) || header->size > end - offset ||
+            hasFen != (header->fenBytes > 0) || header->result > RESULT_DRAW)
+            return false;
+        const char *tags = (const char *)record + sizeof(DbRecordHeader), *tagsEnd = tags + header->tagBytes;
+        for (const char *p = tags; p < tagsEnd;) // Whole "key\0value\0" pairs
+        {
+            for (int part = 0; part < 2; part++)
+            {
+                const char *zero = (const char *)memchr(p, '\0', tagsEnd - p);
+                if (!zero)
+                    return false;
+                p = zero + 1;
+            }
+        }
+        return !hasFen || tagsEnd[header->fenBytes - 1] == '\0';
+    }
+
+    static size_t movesOffset(const DbRecordHeader &header)
+    {
+        return roundUp(sizeof(DbRecordHeader) + header.tagBytes + header.fenBytes, 2);
+    }
+
+    static uint32_t recordSize(const DbRecordHeader &header)
+    {
+        return roundUp(movesOffset(header) + header.moveCount * sizeof(uint16_t), 8);
+    }
+
+private:
+    MappedFile file;
+    const uint64_t *index = nullptr;
+    vector<uint64_t> offsets; // Index rebuilt by walking the records
+    size_t count = 0;
+    uint64_t recordsEnd = sizeof(DbFileHeader);
+};
+
+class GameDbWriter // Appends games to a database file, creating it if needed
+{
+public:
+    ~GameDbWriter()
+    {
+        close();
+    }
+
+    bool open(const string &path)
+    {
+        close();
+        filePath = path;
+        offsets.clear();
+        end = sizeof(DbFileHeader);
+        if (filesystem::exists(path) && filesystem::file_size(path) > 0)
+        {
+            GameDbReader existing;
+            if (!existing.open(path))
+                return false;
+            for (size_t i = 0; i < existing.gameCount(); i++)
+                offsets.push_back(existing.recordOffset(i));
+            end = existing.endOfRecords();
+            file.open(path, ios::binary | ios::in | ios::out);
+        }
+        else
+        {
+            file.open(path, ios::binary | ios::out | ios::trunc);
+            DbFileHeader header = {};
+            memcpy(header.magic, DB_MAGIC, 8);
+            header.version = 1;
+            file.write((const char *)&header, sizeof(header));
+        }
+        if (!file)
+        {
+            cerr << "Error: cannot write " << path << endl;
+            return false;
+        }
+        file.seekp(end);
+        return true;
+    }
+
+    bool append(const DbGame &game)
+    {
+        string tags;
+        for (auto &[key, value] : game.tags)
+        {
+            tags += key;
+            tags += '\0';
+            tags += value;
+            tags += '\0';
+        }
+        bool customStart = game.startFen != Position::START_FEN;
+        if (tags.size() > 0xFFFF || game.moves.size() > 0xFFFF || !file)
+            return false;
+
+        DbRecordHeader header = {};
+        header.marker = DB_RECORD_MARKER;
+        header.moveCount = game.moves.size();
+        header.tagBytes = tags.size();
+        header.fenBytes = customStart ? game.startFen.size() + 1 : 0;
+        header.result = resultCode(game.result);
+        header.flags = customStart ? DB_HAS_START_FEN : 0;
+        header.size = GameDbReader::recordSize(header);
+
+        string record(header.size, '\0');
+        memcpy(&record[0], &header, sizeof(header));
+        memcpy(&record[sizeof(header)], tags.data(), tags.size());
+        if (customStart)
+            memcpy(&record[sizeof(header) + tags.size()], game.startFen.c_str(), header.fenBytes);
+        memcpy(&record[GameDbReader::movesOffset(header)], game.moves.data(), game.moves.size() * sizeof(Move));
+
+        file.write(record.data(), record.size());
+        offsets.push_back(end);
+        end += record.size();
+        return bool(file);
+    }
+
+    bool close() // Writes the index and footer
+    {
+        if (!file.is_open())
+            return true;
+        DbFileFooter footer = {end, offsets.size(), {}};
+        memcpy(footer.magic, DB_MAGIC, 8);
+        file.seekp(end);
+        file.write((const char *)offsets.data(), offsets.size() * sizeof(uint64_t));
+        file.write((const char *)&footer, sizeof(footer));
+        bool ok = bool(file);
+        file.close();
+        uint64_t size = end + offsets.size() * sizeof(uint64_t) + sizeof(footer);
+        if (ok && filesystem::file_size(filePath) != size)
+            filesystem::resize_file(filePath, size); // A shorter index than before left bytes behind
+        return ok;
+    }
+
+    size_t gameCount() const
+    {
+        return offsets.size();
+    }
+
+private:
+    fstream file;
+    string filePath;
+    vector<uint64_t> offsets;
+    uint64_t end = sizeof(DbFileHeader);
+};
+
+// "chess pgn2db games.pgn games.db": appends every game of a PGN file to a database
+inline int runPgnToDb(const CommandArgs &args)
+{
+    if (args.positional.size() < 2)
+    {
+        cerr << "Usage: chess pgn2db <input.pgn> <output.db>" << endl;
+        return 1;
+    }
+    ifstream in(args.positional[0]);
+    if (!in)
+    {
+        cerr << "Error: cannot open " << args.positional[0] << endl;
+        return 1;
+    }
+    GameDbWriter writer;
+    if (!writer.open(args.positional[1]))
+        return 1;
+
+    auto start = chrono::steady_clock::now();
+    PgnGame pgn;
+    DbGame game;
+    size_t converted = 0, skipped = 0;
+    while (readPgn(in, pgn))
+    {
+        if (pgnToDbGame(pgn, game) && writer.append(game))
+            converted++;
+        else
+            skipped++;
+    }
+    if (!writer.close())
+        return 1;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    double pgnBytes = filesystem::file_size(args.positional[0]), dbBytes = filesystem::file_size(args.positional[1]);
+    cout << fixed << setprecision(2) << converted << " games converted, " << skipped << " skipped (illegal moves) in "
+         << seconds << " s\n"
+         << "PGN " << pgnBytes / 1e6 << " MB -> database " << dbBytes / 1e6 << " MB (" << pgnBytes / dbBytes
+         << "x smaller; the database holds " << writer.gameCount() << " games)" << endl;
+    return skipped == 0 ? 0 : 1;
+}
+
+// "chess db2pgn games.db games.pgn": writes the database back out as PGN
+inline int runDbToPgn(const CommandArgs &args)
+{
+    if (args.positional.size() < 2)
+    {
+        cerr << "Usage: chess db2pgn <input.db> <output.pgn>" << endl;
+        return 1;
+    }
+    GameDbReader reader;
+    if (!reader.open(args.positional[0]))
+        return 1;
+    ofstream out(args.positional[1]);
+    PgnGame pgn;
+    for (size_t i = 0; i < reader.gameCount(); i++)
+    {
+        if (dbToPgnGame(reader.game(i), pgn))
+            writePgn(out, pgn);
+        else
+            cerr << "Error: game " << i + 1 << " has an invalid start FEN; skipped" << endl;
+    }
+    cout << reader.gameCount() << " games written to " << args.positional[1] << endl;
+    return out ? 0 : 1;
+}
+
+// "chess replay <file.db|file.pgn>": plays every move of every game and reports the throughput
+inline int runReplayBench(const CommandArgs &args)
+{
+    if (args.positional.empty())
+    {
+        cerr << "Usage: chess replay <games.db|games.pgn>" << endl;
+        return 1;
+    }
+    const string &path = args.positional[0];
+    bool isPgn = path.size() >= 4 && path.compare(path.size() - 4, 4, ".pgn") == 0;
+    size_t games = 0, moves = 0;
+    uint64_t checksum = 0; // Keeps the replay from being optimised away and ties the two formats together
+    Position pos;
+
+    auto start = chrono::steady_clock::now();
+    if (isPgn)
+    {
+        ifstream in(path);
+        PgnGame pgn;
+        while (readPgn(in, pgn))
+        {
+            pos.setFen(pgn.startFen);
+            for (const string &san : pgn.moves)
+            {
+                Move m = pos.parseSan(san);
+                if (m == MOVE_NONE)
+                    break;
+                pos.makeMove(m);
+                moves++;
+            }
+            checksum ^= pos.key;
+            games++;
+        }
+    }
+    else
+    {
+        GameDbReader reader;
+        if (!reader.open(path))
+            return 1;
+        for (size_t i = 0; i < reader.gameCount(); i++)
+        {
+            DbGameView game = reader.view(i);
+            if (!pos.setFen(game.startFen ? game.startFen : Position::START_FEN))
+                continue;
+            int ply = 0;
+            for (; ply < game.moveCount && isReplayableMove(pos, game.moves[ply]); ply++)
+                pos.makeMove(game.moves[ply]); // Stops at a corrupt move, as the PGN replay stops at one it cannot parse
+            checksum ^= pos.key;
+            moves += ply;
+            games++;
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << fixed << setprecision(2) << games << " games, " << moves << " moves in " << seconds << " s: "
+         << setprecision(0) << games / seconds << " games/s, " << moves / seconds << " moves/s (checksum "
+         << hex << checksum << dec << ")" << endl;
+    return 0;
+}
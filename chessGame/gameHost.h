@@ -0,0 +1,369 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <shared_mutex>
+#include <unordered_map>
+#include "chessBoard.h"
+#include "gameJournal.h"
+#include "position.h"
+#include "threadPool.h"
+
+using namespace std;
+
+struct MoveResult
+{
+    uint64_t sessionId = 0;
+    bool accepted = false; // False if the session is finished or the move breaks the ChessBoard rules
+    string notation;       // Move in the same notation the sidebar shows, e.g. "Nxe5+"
+    bool gameOver = false;
+    size_t ply = 0;        // Index of the accepted move in the session's move list
+    bool journalFailed = false; // Accepted, but the journal could not make it durable
+    int64_t latencyNs = 0; // From submitMove to the end of validation, or until the move is journaled
+};
+
+struct MoveRequest
+{
+    int fromX, fromY, toX, toY;
+    function<void(const MoveResult &)> onDone;
+    chrono::steady_clock::time_point submitted;
+};
+
+class GameSession // One independent game: its own board, side to move and move list
+{
+public:
+    const uint64_t id;
+    ChessBoard board;
+    bool isWhiteTurn = true;
+    vector<string> moves;
+
+    explicit GameSession(uint64_t id) : id(id) {}
+
+    bool isGameOver() const
+    {
+        return board.lastMove.find("#") != string::npos;
+    }
+
+private:
+    friend class GameHost;
+    mutex stateMutex;          // Held while a move is applied or the state is read
+    mutex queueMutex;          // Guards pending and scheduled
+    deque<MoveRequest> pending; // Submitted moves waiting for this session's turn on the pool
+    bool scheduled = false;    // A drain task for this session is queued or running
+};
+
+// Owns many game sessions and validates their moves on a thread pool. Moves for the same
+// session are applied one at a time in submission order; different sessions run in parallel.
+// With a journal, every accepted move is logged and only answered once it is on disk.
+class GameHost
+{
+public:
+    explicit GameHost(unsigned threads = thread::hardware_concurrency()) : pool(threads) {}
+
+    void setJournal(GameJournal *gameJournal) // Set before the first session; the journal must outlive the host's work
+    {
+        journal = gameJournal;
+    }
+
+    uint64_t createSession()
+    {
+        uint64_t id;
+        {
+            unique_lock<shared_mutex> lock(sessionsMutex);
+            do
+                id = nextId++;
+            while (!sessions.emplace(id, make_shared<GameSession>(id)).second); // Skips ids a restored session holds
+        }
+        if (journal)
+            journal->append(journalNewGame(id, ""));
+        return id;
+    }
+
+    bool restoreSession(const JournalGame &game) // Recreates a session from a journal, with its id and moves; false if they do not fit
+    {
+        auto session = make_shared<GameSession>(game.id);
+        for (const BoardMove &m : game.moves)
+        {
+            if (!session->board.applyMove(m[0], m[1], m[2], m[3]))
+            {
+                cerr << "Error: journaled game " << game.id << " does not replay at move " << session->moves.size() + 1 << endl;
+                return false;
+            }
+            session->moves.push_back(session->board.lastMove);
+            session->isWhiteTurn = !session->isWhiteTurn;
+        }
+        unique_lock<shared_mutex> lock(sessionsMutex);
+        if (!sessions.emplace(game.id, session).second)
+        {
+            cerr << "Error: journaled game " << game.id << " has the id of a session that already exists" << endl;
+            return false;
+        }
+        if (nextId <= game.id)
+            nextId = game.id + 1;
+        return true;
+    }
+
+    bool closeSession(uint64_t id)
+    {
+        bool isClosed;
+        {
+            unique_lock<shared_mutex> lock(sessionsMutex);
+            isClosed = sessions.erase(id) > 0;
+        }
+        if (isClosed && journal)
+            journal->append(journalEndGame(id));
+        return isClosed;
+    }
+
+    size_t sessionCount()
+    {
+        shared_lock<shared_mutex> lock(sessionsMutex);
+        return sessions.size();
+    }
+
+    // Queues a move; onDone runs on a pool thread once the move has been validated, or on the
+    // journal's flusher thread once an accepted move is on disk or the journal has failed. Returns false if there is no such session.
+    bool submitMove(uint64_t id, int fromX, int fromY, int toX, int toY, function<void(const MoveResult &)> onDone)
+    {
+        shared_ptr<GameSession> session = find(id);
+        if (!session)
+            return false;
+
+        bool needsDrain = false;
+        {
+            lock_guard<mutex> lock(session->queueMutex);
+            session->pending.push_back({fromX, fromY, toX, toY, std::move(onDone), chrono::steady_clock::now()});
+            if (!session->scheduled)
+            {
+                session->scheduled = true;
+                needsDrain = true;
+            }
+        }
+        if (needsDrain)
+            pool.submit([this, session] { drain(session); });
+        return true;
+    }
+
+    vector<string> moveList(uint64_t id) // Snapshot of a session's moves so far
+    {
+        shared_ptr<GameSession> session = find(id);
+        if (!session)
+            return {};
+        lock_guard<mutex> lock(session->stateMutex);
+        return session->moves;
+    }
+
+    void waitIdle()
+    {
+        pool.waitIdle();
+    }
+
+    size_t threadCount() const
+    {
+        return pool.size();
+    }
+
+private:
+    shared_mutex sessionsMutex;
+    unordered_map<uint64_t, shared_ptr<GameSession>> sessions;
+    atomic<uint64_t> nextId{1};
+    GameJournal *journal = nullptr;
+    ThreadPool pool; // Declared last so workers stop before the sessions go away
+
+    shared_ptr<GameSession> find(uint64_t id)
+    {
+        shared_lock<shared_mutex> lock(sessionsMutex);
+        auto it = sessions.find(id);
+        return it == sessions.end() ? nullptr : it->second;
+    }
+
+    // Applies one pending move, then requeues the session if more arrived, so a busy
+    // session cannot starve the others
+    void drain(shared_ptr<GameSession> session)
+    {
+        MoveRequest request;
+        {
+            lock_guard<mutex> lock(session->queueMutex);
+            request = std::move(session->pending.front());
+            session->pending.pop_front();
+        }
+
+        MoveResult result = play(*session, request);
+        if (journal && result.accepted)
+        {
+            // Later moves of the session are appended after this one, so they also become durable after it
+            string record = journalMove(session->id, result.ply, request.fromX, request.fromY, request.toX, request.toY);
+            if (result.gameOver)
+                record += journalEndGame(session->id);
+            journal->append(record, [result, onDone = std::move(request.onDone), submitted = request.submitted](bool isDurable) mutable
+                            {
+                                result.journalFailed = !isDurable;
+                                result.latencyNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - submitted).count();
+                                if (onDone)
+                                    onDone(result); });
+        }
+        else if (request.onDone)
+            request.onDone(result);
+
+        bool more = false;
+        {
+            lock_guard<mutex> lock(session->queueMutex);
+            more = !session->pending.empty();
+            if (!more)
+                session->scheduled = false;
+        }
+        if (more)
+            pool.submit([this, session] { drain(session); });
+    }
+
+    MoveResult play(GameSession &session, const MoveRequest &request)
+    {
+        MoveResult result;
+        result.sessionId = session.id;
+        {
+            lock_guard<mutex> lock(session.stateMutex);
+            ChessBoard &board = session.board;
+            if (!session.isGameOver() && board.isValidTile(request.fromX, request.fromY) && board.isValidTile(request.toX, request.toY))
+            {
+                Piece &piece = board.getSquare(request.fromY, request.fromX).piece;
+                if (!piece.isEmpty() && piece.isWhite == session.isWhiteTurn &&
+                    board.applyMove(request.fromX, request.fromY, request.toX, request.toY))
+                {
+                    session.moves.push_back(board.lastMove);
+                    session.isWhiteTurn = !session.isWhiteTurn;
+                    result.accepted = true;
+                    result.ply = session.moves.size() - 1;
+                    result.notation = board.lastMove;
+                }
+            }
+            result.gameOver = session.isGameOver();
+        }
+        result.latencyNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - request.submitted).count();
+        return result;
+    }
+};
+
+// Random games that both the engine and ChessBoard accept, used to drive load tests
+inline vector<vector<BoardMove>> buildScriptedGames(int count, int plies, uint32_t seed)
+{
+    mt19937 rng(seed);
+    vector<vector<BoardMove>> games;
+    for (int g = 0; g < count; g++)
+    {
+        Position pos;
+        ChessBoard board;
+        bool isWhiteTurn = true;
+        vector<BoardMove> script;
+        for (int ply = 0; ply < plies && board.lastMove.find("#") == string::npos; ply++)
+        {
+            MoveList list;
+            pos.generateLegal(list);
+            vector<Move> candidates;
+            for (int i = 0; i < list.size; i++)
+                if (moveFlag(list.moves[i].move) != PROMOTION || movePromotion(list.moves[i].move) == QUEEN)
+                    candidates.push_back(list.moves[i].move); // ChessBoard always promotes to a queen
+            shuffle(candidates.begin(), candidates.end(), rng);
+
+            bool played = false;
+            for (Move m : candidates)
+            {
+                BoardMove bm = {squareX(moveFrom(m)), squareY(moveFrom(m)), squareX(moveTo(m)), squareY(moveTo(m))};
+                Piece &piece = board.getSquare(bm[1], bm[0]).piece;
+                if (piece.isWhite == isWhiteTurn && board.applyMove(bm[0], bm[1], bm[2], bm[3]))
+                {
+                    pos.makeMove(m);
+                    script.push_back(bm);
+                    isWhiteTurn = !isWhiteTurn;
+                    played = true;
+                    break;
+                }
+            }
+            if (!played)
+                break;
+        }
+        games.push_back(script);
+    }
+    return games;
+}
+
+// Plays scripted games in many concurrent sessions. Each session behaves like a client that
+// sends its next move as soon as the previous one is answered. With a journal path, every move
+// is journaled and answered once it is on disk.
+inline int runHostBench(int gameCount, int plies, unsigned threads, const string &journalPath = "")
+{
+    vector<vector<BoardMove>> scripts = buildScriptedGames(32, plies, 2024);
+    GameJournal journal; // Outlives the host, whose workers append to it
+    vector<JournalGame> unfinished;
+    if (!journalPath.empty() && !journal.open(journalPath, unfinished))
+        return 1;
+    GameHost host(threads);
+    if (journal.isOpen())
+        host.setJournal(&journal);
+
+    struct Client
+    {
+        uint64_t sessionId;
+        const vector<BoardMove> *script;
+        size_t next = 0;
+    };
+    vector<Client> clients(gameCount);
+    size_t totalMoves = 0;
+    for (int i = 0; i < gameCount; i++)
+    {
+        clients[i].sessionId = host.createSession();
+        clients[i].script = &scripts[i % scripts.size()];
+        totalMoves += clients[i].script->size();
+    }
+
+    vector<int64_t> latencies(totalMoves);
+    atomic<size_t> completed{0};
+    atomic<size_t> rejected{0};
+
+    function<void(Client &)> sendNext = [&](Client &client)
+    {
+        if (client.next >= client.script->size())
+            return;
+        const BoardMove &bm = (*client.script)[client.next++];
+        host.submitMove(client.sessionId, bm[0], bm[1], bm[2], bm[3], [&, clientPtr = &client](const MoveResult &result)
+                        {
+                            latencies[completed++] = result.latencyNs;
+                            if (!result.accepted)
+                                rejected++;
+                            sendNext(*clientPtr); });
+    };
+
+    cout << "Game host bench: " << gameCount << " sessions, " << totalMoves << " moves, " << host.threadCount() << " threads\n";
+    auto start = chrono::steady_clock::now();
+    for (Client &client : clients)
+        sendNext(client);
+    do // Answers from the journal send the next moves, which go back to the pool
+    {
+        host.waitIdle();
+        if (journal.isOpen())
+            journal.flush();
+    } while (completed < totalMoves);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    sort(latencies.begin(), latencies.end());
+    auto percentileUs = [&](double p)
+    {
+        return latencies.empty() ? 0.0 : latencies[min(latencies.size() - 1, size_t(p * latencies.size()))] / 1000.0;
+    };
+    cout << fixed << setprecision(1)
+         << "moves/s: " << totalMoves / seconds << " (" << rejected << " rejected, " << seconds << " s)\n"
+         << "latency us: p50 " << percentileUs(0.50) << ", p90 " << percentileUs(0.90)
+         << ", p99 " << percentileUs(0.99) << ", max " << percentileUs(1.0) << "\n";
+    if (journal.isOpen())
+    {
+        cout << "journal: " << journal.recordCount() << " records in " << journal.syncCount() << " syncs ("
+             << double(journal.recordCount()) / max<uint64_t>(1, journal.syncCount()) << " records per sync)\n";
+        for (Client &client : clients)
+            host.closeSession(client.sessionId); // Nothing is left to recover next time
+    }
+    return 0;
+}
@@ -0,0 +1,409 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Append-only journal of committed moves, so games in progress survive a crash. Records are
+// small and binary:
+//
+//   "CHJ1"                                   file header
+//   length:u8 body checksum:u32              one record; length covers the body
+//   body = type:u8 gameId:varint ...
+//     NEW   fenLength:varint fen             empty fen for the standard start
+//     MOVE  ply:varint move:u16              from | to << 6 in ChessBoard squares (y * 8 + x)
+//     END                                    finished, closed or abandoned; not recovered
+//
+// Appends go to a buffer, and one flusher thread writes and syncs whatever has piled up while
+// the previous sync ran, so all games committing moves at the same time share one fsync. A
+// torn record at the end, from a crash in the middle of a write, fails its checksum and ends
+// the recovery. Opening a journal rewrites it with only the unfinished games. After a failed
+// write or sync nothing more is written, so a torn record can only be the last one; appends
+// and flushes from then on report the failure.
+
+typedef array<int, 4> BoardMove; // fromX, fromY, toX, toY
+
+enum JournalRecordType : uint8_t
+{
+    JOURNAL_NEW = 1,
+    JOURNAL_MOVE = 2,
+    JOURNAL_END = 3
+};
+
+struct JournalGame // An unfinished game read back from a journal
+{
+    uint64_t id = 0;
+    string startFen; // Empty for the standard start
+    vector<BoardMove> moves;
+    bool isEnded = false;
+};
+
+inline void writeVarint(string &out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out += char((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+inline bool readVarint(const string &data, size_t &offset, size_t end, uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; offset < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = data[offset++];
+        value |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+inline uint32_t journalChecksum(const char *data, size_t size) // 32-bit FNV-1a
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ uint8_t(data[i])) * 16777619u;
+    return hash;
+}
+
+inline string journalRecord(const string &body) // Frames a body with its length and checksum
+{
+    string record(1, char(body.size()));
+    record += body;
+    uint32_t check = journalChecksum(record.data(), record.size());
+    for (int i = 0; i < 4; i++)
+        record += char(check >> (8 * i));
+    return record;
+}
+
+inline string journalNewGame(uint64_t gameId, const string &startFen)
+{
+    string body(1, char(JOURNAL_NEW));
+    writeVarint(body, gameId);
+    writeVarint(body, startFen.size());
+    body += startFen;
+    return journalRecord(body);
+}
+
+inline string journalMove(uint64_t gameId, size_t ply, int fromX, int fromY, int toX, int toY)
+{
+    string body(1, char(JOURNAL_MOVE));
+    writeVarint(body, gameId);
+    writeVarint(body, ply);
+    uint16_t move = uint16_t((fromY * 8 + fromX) | (toY * 8 + toX) << 6);
+    body += char(move & 0xFF);
+    body += char(move >> 8);
+    return journalRecord(body);
+}
+
+inline string journalEndGame(uint64_t gameId)
+{
+    string body(1, char(JOURNAL_END));
+    writeVarint(body, gameId);
+    return journalRecord(body);
+}
+
+inline bool syncToDisk(FILE *file) // Flushes the stdio buffer, then the OS cache
+{
+    if (fflush(file) != 0)
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#elif defined(__linux__)
+    return fdatasync(fileno(file)) == 0; // The size changes with every append, which fdatasync still syncs
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+class GameJournal
+{
+public:
+    GameJournal() = default;
+    GameJournal(const GameJournal &) = delete;
+    GameJournal &operator=(const GameJournal &) = delete;
+
+    ~GameJournal()
+    {
+        close();
+    }
+
+    // Reads the unfinished games back, compacts the file down to them and opens it for appending
+    bool open(const string &filePath, vector<JournalGame> &recovered)
+    {
+        path = filePath;
+        recovered.clear();
+        if (!recover(recovered) || !compact(recovered))
+            return false;
+        file = fopen(path.c_str(), "ab");
+        if (!file)
+        {
+            cerr << "Error: cannot append to " << path << endl;
+            return false;
+        }
+        stopping = false;
+        flusher = thread(&GameJournal::flushLoop, this);
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return file != nullptr;
+    }
+
+    // Queues a record; onDurable runs on the flusher thread once it is on disk, in append order,
+    // with false if the journal failed before the record got there. False if it has failed already.
+    bool append(const string &record, function<void(bool isDurable)> onDurable = nullptr)
+    {
+        {
+            lock_guard<mutex> lock(bufferMutex);
+            if (!failed)
+            {
+                pending += record;
+                if (onDurable)
+                    callbacks.push_back(std::move(onDurable));
+                appended++;
+                wakeFlusher.notify_one();
+                return true;
+            }
+        }
+        if (onDurable)
+            onDurable(false);
+        return false;
+    }
+
+    // Waits until everything appended so far is on disk and its callbacks have run; false if
+    // some of it never will be
+    bool flush()
+    {
+        unique_lock<mutex> lock(bufferMutex);
+        uint64_t target = appended;
+        flushed.wait(lock, [&]
+                     { return durable >= target || failed || !file; });
+        return !failed && durable >= target;
+    }
+
+    bool hasFailed() const
+    {
+        return failed;
+    }
+
+    void close() // Syncs what is pending and stops the flusher
+    {
+        if (!flusher.joinable())
+            return;
+        {
+            lock_guard<mutex> lock(bufferMutex);
+            stopping = true;
+            wakeFlusher.notify_one();
+        }
+        flusher.join();
+        fclose(file);
+        file = nullptr;
+        flushed.notify_all();
+    }
+
+    uint64_t nextGameId() // Higher than any game id in the journal
+    {
+        return nextId++;
+    }
+
+    uint64_t recordCount() const
+    {
+        return durable;
+    }
+
+    uint64_t syncCount() const
+    {
+        return syncs;
+    }
+
+private:
+    string path;
+    FILE *file = nullptr;
+    thread flusher;
+    mutex bufferMutex;                 // Guards everything the flusher swaps out
+    condition_variable wakeFlusher, flushed;
+    string pending;                    // Records not yet written
+    vector<function<void(bool)>> callbacks; // For the records in pending
+    uint64_t appended = 0;
+    atomic<uint64_t> durable{0};
+    atomic<uint64_t> syncs{0};
+    atomic<uint64_t> nextId{1};
+    bool stopping = false;
+    atomic<bool> failed{false}; // A write or sync failed; nothing is written after it
+
+    void flushLoop()
+    {
+        unique_lock<mutex> lock(bufferMutex);
+        while (true)
+        {
+            wakeFlusher.wait(lock, [&]
+                             { return !pending.empty() || stopping; });
+            if (pending.empty())
+                return;
+            string batch;
+            batch.swap(pending);
+            vector<function<void(bool)>> done;
+            done.swap(callbacks);
+            uint64_t batchEnd = appended;
+            lock.unlock();
+
+            // Appends arriving during the write and sync wait in pending for the next batch
+            bool isWritten = fwrite(batch.data(), 1, batch.size(), file) == batch.size() && syncToDisk(file);
+            syncs++;
+            if (!isWritten)
+            {
+                cerr << "Error: cannot write the game journal " << path << "; moves are no longer journaled" << endl;
+                lock.lock();
+                failed = true; // Later appends fail at once, so pending stays empty
+                pending.clear();
+                done.insert(done.end(), make_move_iterator(callbacks.begin()), make_move_iterator(callbacks.end()));
+                callbacks.clear();
+                lock.unlock();
+            }
+            for (auto &callback : done)
+                callback(isWritten);
+
+            lock.lock();
+            if (isWritten)
+                durable = batchEnd;
+            flushed.notify_all();
+        }
+    }
+
+    bool recover(vector<JournalGame> &recovered)
+    {
+        ifstream in(path, ios::binary);
+        if (!in)
+            return true; // A new journal
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        if (data.empty())
+            return true;
+        if (data.compare(0, 4, "CHJ1") != 0)
+        {
+            cerr << "Error: " << path << " is not a game journal" << endl;
+            return false;
+        }
+
+        vector<JournalGame> games;
+        unordered_map<uint64_t, size_t> index; // Game id -> games
+        size_t offset = 4;
+        uint64_t records = 0;
+        while (offset < data.size())
+        {
+            size_t length = uint8_t(data[offset]);
+            size_t end = offset + 1 + length;
+            if (length == 0 || end + 4 > data.size())
+                break;
+            uint32_t check = 0;
+            for (int i = 0; i < 4; i++)
+                check |= uint32_t(uint8_t(data[end + i])) << (8 * i);
+            if (check != journalChecksum(data.data() + offset, 1 + length))
+                break;
+
+            size_t at = offset + 1;
+            uint8_t type = data[at++];
+            uint64_t id, value;
+            if (!readVarint(data, at, end, id))
+                break;
+            nextId = max<uint64_t>(nextId.load(), id + 1);
+            if (type == JOURNAL_NEW && readVarint(data, at, end, value) && at + value == end)
+            {
+                index[id] = games.size();
+                games.push_back(JournalGame());
+                games.back().id = id;
+                games.back().startFen = data.substr(at, value);
+            }
+            else if (type == JOURNAL_MOVE && readVarint(data, at, end, value) && at + 2 == end && index.count(id))
+            {
+                JournalGame &game = games[index[id]];
+                uint16_t move = uint8_t(data[at]) | uint8_t(data[at + 1]) << 8;
+                if (value > game.moves.size())
+                    break; // A ply the game never reached: the file is damaged
+                game.moves.resize(value); // A move after a takeback replaces the moves that were taken back
+                game.moves.push_back({move & 7, (move >> 3) & 7, (move >> 6) & 7, (move >> 9) & 7});
+            }
+            else if (type == JOURNAL_END && at == end && index.count(id))
+                games[index[id]].isEnded = true;
+            else
+                break;
+            offset = end + 4;
+            records++;
+        }
+        if (offset < data.size())
+            cout << "Game journal: ignored " << data.size() - offset << " bytes after the last complete record" << endl;
+
+        for (JournalGame &game : games)
+            if (!game.isEnded)
+                recovered.push_back(std::move(game));
+        cout << "Game journal: " << records << " records, " << recovered.size() << " unfinished games in " << path << endl;
+        return true;
+    }
+
+    bool compact(const vector<JournalGame> &games) // Writes the unfinished games to a new file and swaps it in
+    {
+        string data = "CHJ1";
+        for (const JournalGame &game : games)
+        {
+            data += journalNewGame(game.id, game.startFen);
+            for (size_t ply = 0; ply < game.moves.size(); ply++)
+            {
+                const BoardMove &m = game.moves[ply];
+                data += journalMove(game.id, ply, m[0], m[1], m[2], m[3]);
+            }
+        }
+
+        string temporary = path + ".tmp";
+        FILE *out = fopen(temporary.c_str(), "wb");
+        if (!out || fwrite(data.data(), 1, data.size(), out) != data.size() || !syncToDisk(out))
+        {
+            cerr << "Error: cannot write " << temporary << endl;
+            if (out)
+                fclose(out);
+            return false;
+        }
+        fclose(out);
+
+        error_code error;
+        filesystem::rename(temporary, path, error); // Atomic, so a crash leaves either the old or the new journal
+        if (error)
+        {
+            cerr << "Error: cannot replace " << path << ": " << error.message() << endl;
+            return false;
+        }
+#ifndef _WIN32
+        string directory = filesystem::absolute(path).parent_path().string();
+        int fd = ::open(directory.c_str(), O_RDONLY); // The rename itself is only durable once the directory is synced
+        if (fd >= 0)
+        {
+            fsync(fd);
+            ::close(fd);
+        }
+#endif
+        return true;
+    }
+};
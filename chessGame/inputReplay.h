@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "checksum.h"
+
+using namespace std;
+
+// Recorded input for the playback benchmark. The log is plain text, one event per line,
+// prefixed with the frame that handled it so playback groups events the same way:
+//
+//   chess-input 1
+//   12 press 0 212 388      button x y (0 left, 1 right)
+//   13 move 215 380         x y
+//   15 release 0 220 290
+//   40 key 71               SFML key code
+//   52 wheel -1 600 120     delta x y
+//   60 resize 784 512       width height
+//
+// Only the events the board reacts to are written; everything else is left out.
+
+struct RecordedEvent
+{
+    uint64_t frame;
+    sf::Event event;
+};
+
+inline bool formatInputEvent(const sf::Event &event, string &text) // False for events playback does not need
+{
+    ostringstream out;
+    switch (event.type)
+    {
+    case sf::Event::MouseButtonPressed:
+    case sf::Event::MouseButtonReleased:
+        out << (event.type == sf::Event::MouseButtonPressed ? "press " : "release ") << int(event.mouseButton.button) << " "
+            << event.mouseButton.x << " " << event.mouseButton.y;
+        break;
+    case sf::Event::MouseMoved:
+        out << "move " << event.mouseMove.x << " " << event.mouseMove.y;
+        break;
+    case sf::Event::KeyPressed:
+        out << "key " << int(event.key.code);
+        break;
+    case sf::Event::MouseWheelScrolled:
+        out << "wheel " << event.mouseWheelScroll.delta << " " << event.mouseWheelScroll.x << " " << event.mouseWheelScroll.y;
+        break;
+    case sf::Event::Resized:
+        out << "resize " << event.size.width << " " << event.size.height;
+        break;
+    default:
+        return false;
+    }
+    text = out.str();
+    return true;
+}
+
+inline bool parseInputEvent(const string &line, RecordedEvent &recorded)
+{
+    istringstream in(line);
+    string kind;
+    if (!(in >> recorded.frame >> kind))
+        return false;
+    sf::Event &event = recorded.event;
+    event = sf::Event();
+    int a = 0, b = 0, c = 0;
+    if (kind == "press" || kind == "release")
+    {
+        event.type = kind == "press" ? sf::Event::MouseButtonPressed : sf::Event::MouseButtonReleased;
+        if (!(in >> a >> b >> c))
+            return false;
+        event.mouseButton.button = sf::Mouse::Button(a);
+        event.mouseButton.x = b;
+        event.mouseButton.y = c;
+    }
+    else if (kind == "move")
+    {
+        event.type = sf::Event::MouseMoved;
+        if (!(in >> event.mouseMove.x >> event.mouseMove.y))
+            return false;
+    }
+    else if (kind == "key")
+    {
+        event.type = sf::Event::KeyPressed;
+        if (!(in >> a))
+            return false;
+        event.key.code = sf::Keyboard::Key(a);
+    }
+    else if (kind == "wheel")
+    {
+        event.type = sf::Event::MouseWheelScrolled;
+        event.mouseWheelScroll.wheel = sf::Mouse::VerticalWheel;
+        if (!(in >> event.mouseWheelScroll.delta >> event.mouseWheelScroll.x >> event.mouseWheelScroll.y))
+            return false;
+    }
+    else if (kind == "resize")
+    {
+        event.type = sf::Event::Resized;
+        if (!(in >> event.size.width >> event.size.height))
+            return false;
+    }
+    else
+        return false;
+    return true;
+}
+
+class InputRecorder // Appends every handled event to a log while the game is played
+{
+public:
+    bool open(const string &path)
+    {
+        out.open(path, ios::trunc);
+        if (!out)
+        {
+            cerr << "Error: cannot write " << path << endl;
+            return false;
+        }
+        out << "chess-input 1\n";
+        return true;
+    }
+
+    void record(uint64_t frame, const sf::Event &event)
+    {
+        string text;
+        if (out.is_open() && formatInputEvent(event, text))
+            out << frame << " " << text << "\n";
+    }
+
+private:
+    ofstream out;
+};
+
+inline bool loadInputLog(const string &path, vector<RecordedEvent> &events)
+{
+    ifstream in(path);
+    string line;
+    if (!in || !getline(in, line) || line != "chess-input 1")
+    {
+        cerr << "Error: " << path << " is not an input log" << endl;
+        return false;
+    }
+    for (int lineNumber = 2; getline(in, line); lineNumber++)
+    {
+        if (line.empty())
+            continue;
+        RecordedEvent recorded;
+        if (!parseInputEvent(line, recorded))
+        {
+            cerr << "Error: " << path << ":" << lineNumber << ": cannot parse \"" << line << "\"" << endl;
+            return false;
+        }
+        events.push_back(recorded);
+    }
+    return true;
+}
@@ -0,0 +1,331 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <netdb.h>
+#include "server.h"
+
+using namespace std;
+
+struct LoadClient // One simulated client connection with its unread input
+{
+    int fd = -1;
+    string input;
+};
+
+inline int connectTo(const string &hostName, unsigned short port) // Blocking connect; -1 on failure
+{
+    addrinfo hints = {}, *found = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(hostName.c_str(), to_string(port).c_str(), &hints, &found) != 0 || !found)
+        return -1;
+    int fd = socket(found->ai_family, found->ai_socktype, 0);
+    if (fd >= 0 && connect(fd, found->ai_addr, found->ai_addrlen) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(found);
+    if (fd >= 0)
+    {
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    }
+    return fd;
+}
+
+inline bool sendAll(int fd, const string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t written = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        sent += written;
+    }
+    return true;
+}
+
+inline bool takeLine(LoadClient &client, string &line) // Pops one buffered line, if complete
+{
+    size_t end = client.input.find('\n');
+    if (end == string::npos)
+        return false;
+    line = client.input.substr(0, end);
+    client.input.erase(0, end + 1);
+    return true;
+}
+
+inline bool readLineBlocking(LoadClient &client, string &line)
+{
+    char buffer[512];
+    while (!takeLine(client, line))
+    {
+        ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        client.input.append(buffer, received);
+    }
+    return true;
+}
+
+inline bool readAvailable(LoadClient &client) // Non-blocking drain; false once the server closed the socket
+{
+    char buffer[4096];
+    while (true)
+    {
+        ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (received > 0)
+            client.input.append(buffer, received);
+        else if (received == 0)
+            return false;
+        else if (errno == EINTR)
+            continue;
+        else
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+// Opens many idle connections to a server and then plays scripted games over a few more,
+// measuring the round trip of each move. Finally checks the idle connections still answer.
+inline int runLoadTest(const CommandArgs &args)
+{
+    string hostName = args.getString("host", "127.0.0.1");
+    unsigned short port = args.getInt("port", DEFAULT_SERVER_PORT, 1, 65535);
+    int idleCount = args.getInt("idle", 10000, 0);
+    int gameCount = args.getInt("games", 200, 0);
+    int plies = args.getInt("plies", 40, 1);
+    bool spawn = args.has("spawn");
+    if (!args.isValid())
+        return 1;
+
+    rlim_t needed = idleCount + 2 * gameCount + 64;
+    if (!raiseFileLimit(spawn ? 2 * needed : needed))
+        cerr << "Warning: the descriptor limit is too low for " << idleCount << " connections" << endl;
+
+    unique_ptr<ChessServer> server;
+    thread serverThread;
+    if (spawn) // Runs the server in this process, which needs descriptors for both ends
+    {
+        server = make_unique<ChessServer>();
+        if (!server->listen(port))
+            return 1;
+        serverThread = thread([&] { server->run(); });
+    }
+
+    cout << "Load test against " << hostName << ":" << port << ": " << idleCount << " idle connections, "
+         << gameCount << " games of up to " << plies << " plies" << endl;
+
+    auto start = chrono::steady_clock::now();
+    vector<LoadClient> idle;
+    idle.reserve(idleCount);
+    for (int i = 0; i < idleCount; i++)
+    {
+        int fd = connectTo(hostName, port);
+        if (fd < 0)
+        {
+            cerr << "Error: connection " << i << " failed: " << strerror(errno) << endl;
+            break;
+        }
+        idle.push_back({fd, ""});
+    }
+    cout << fixed << setprecision(2) << "opened " << idle.size() << " idle connections in "
+         << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s" << endl;
+
+    // Seat two clients in every game: white creates it, black joins with the id
+    struct ActiveGame
+    {
+        LoadClient players[2];
+        const vector<BoardMove> *script = nullptr;
+        size_t next = 0;
+        string inFlight; // "MOVED <uci> " expected back for the move just sent
+        chrono::steady_clock::time_point sentAt;
+        bool done = false;
+    };
+    vector<vector<BoardMove>> scripts = buildScriptedGames(32, plies, 2024);
+    vector<ActiveGame> games(gameCount);
+    int failures = 0;
+    for (int g = 0; g < gameCount; g++)
+    {
+        ActiveGame &game = games[g];
+        game.script = &scripts[g % scripts.size()];
+        string line, id;
+        for (LoadClient &player : game.players)
+            player.fd = connectTo(hostName, port);
+        if (game.players[0].fd < 0 || game.players[1].fd < 0 || !sendAll(game.players[0].fd, "NEW\n") ||
+            !readLineBlocking(game.players[0], line) || line.rfind("GAME ", 0) != 0)
+        {
+            game.done = true;
+            failures++;
+            continue;
+        }
+        id = line.substr(5, line.find(' ', 5) - 5);
+        if (!sendAll(game.players[1].fd, "JOIN " + id + "\n") || !readLineBlocking(game.players[1], line) ||
+            !readLineBlocking(game.players[1], line) || !readLineBlocking(game.players[0], line) || line != "START")
+        {
+            game.done = true;
+            failures++;
+        }
+    }
+
+    int epollFd = epoll_create1(0);
+    unordered_map<int, pair<int, int>> owner; // fd -> game index, player
+    for (int g = 0; g < gameCount; g++)
+    {
+        for (int p = 0; p < 2 && !games[g].done; p++)
+        {
+            setNonBlocking(games[g].players[p].fd);
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.fd = games[g].players[p].fd;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, event.data.fd, &event);
+            owner[event.data.fd] = {g, p};
+        }
+    }
+
+    auto sendNext = [&](ActiveGame &game)
+    {
+        if (game.next >= game.script->size())
+        {
+            game.done = true;
+            return;
+        }
+        const BoardMove &bm = (*game.script)[game.next];
+        string uci = boardUci(bm[0], bm[1], bm[2], bm[3]);
+        game.inFlight = "MOVED " + uci + " ";
+        game.sentAt = chrono::steady_clock::now();
+        if (!sendAll(game.players[game.next % 2].fd, "MOVE " + uci + "\n"))
+        {
+            game.done = true;
+            failures++;
+        }
+    };
+
+    vector<int64_t> latencies;
+    int running = 0;
+    start = chrono::steady_clock::now();
+    for (ActiveGame &game : games)
+    {
+        if (!game.done)
+        {
+            sendNext(game);
+            running += !game.done;
+        }
+    }
+
+    epoll_event events[256];
+    while (running > 0)
+    {
+        int ready = epoll_wait(epollFd, events, 256, 10000);
+        if (ready <= 0)
+        {
+            cerr << "Error: no answer from the server for 10 s, " << running << " games unfinished" << endl;
+            failures += running;
+            break;
+        }
+        for (int i = 0; i < ready; i++)
+        {
+            auto [g, p] = owner[events[i].data.fd];
+            ActiveGame &game = games[g];
+            LoadClient &client = game.players[p];
+            bool open = readAvailable(client);
+            string line;
+            while (takeLine(client, line))
+            {
+                if (game.done)
+                    continue;
+                if (line.rfind("MOVED ", 0) == 0)
+                {
+                    if (int(game.next % 2) != p || line.rfind(game.inFlight, 0) != 0)
+                        continue; // The other player's copy of an update
+                    latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - game.sentAt).count());
+                    game.next++;
+                    sendNext(game);
+                }
+                else if (line.rfind("OVER ", 0) == 0)
+                    game.done = true;
+                else
+                {
+                    cerr << "Error: game " << g << " got \"" << line << "\"" << endl;
+                    game.done = true;
+                    failures++;
+                }
+                if (game.done)
+                    running--;
+            }
+            if (!open && !game.done)
+            {
+                game.done = true;
+                failures++;
+                running--;
+            }
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    sort(latencies.begin(), latencies.end());
+    auto percentileUs = [&](double p)
+    {
+        return latencies.empty() ? 0.0 : latencies[min(latencies.size() - 1, size_t(p * latencies.size()))] / 1000.0;
+    };
+    cout << setprecision(1) << "moves/s: " << latencies.size() / seconds << " (" << latencies.size() << " moves, "
+         << failures << " failed games, " << seconds << " s)\n"
+         << "round trip us: p50 " << percentileUs(0.50) << ", p90 " << percentileUs(0.90)
+         << ", p99 " << percentileUs(0.99) << ", max " << percentileUs(1.0) << endl;
+
+    // The idle connections must still be served after sitting through the games
+    for (auto &[fd, index] : owner)
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    for (LoadClient &client : idle)
+    {
+        setNonBlocking(client.fd);
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = client.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, client.fd, &event);
+        owner[client.fd] = {-1, int(&client - idle.data())};
+        sendAll(client.fd, "PING\n");
+    }
+    size_t answered = 0;
+    while (answered < idle.size())
+    {
+        int ready = epoll_wait(epollFd, events, 256, 5000);
+        if (ready <= 0)
+            break;
+        for (int i = 0; i < ready; i++)
+        {
+            auto [g, index] = owner[events[i].data.fd];
+            if (g >= 0)
+                continue;
+            LoadClient &client = idle[index];
+            readAvailable(client);
+            string line;
+            while (takeLine(client, line))
+                answered += line == "PONG";
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, client.fd, nullptr);
+        }
+    }
+    cout << "idle connections answering PING: " << answered << "/" << idle.size() << endl;
+
+    for (LoadClient &client : idle)
+        close(client.fd);
+    for (ActiveGame &game : games)
+        for (LoadClient &player : game.players)
+            if (player.fd >= 0)
+                close(player.fd);
+    close(epollFd);
+    if (spawn)
+    {
+        server->stop();
+        serverThread.join();
+    }
+    return failures == 0 && answered == idle.size() ? 0 : 1;
+}
+
+#endif
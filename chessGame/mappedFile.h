@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Read-only view of a whole file. Uses mmap where available, so opening a large file is
+// instant and only the pages that are touched get read; elsewhere the file is loaded.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(const string &path, bool randomAccess = false) // randomAccess turns off read-ahead
+    {
+        close();
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            cerr << "Error: cannot open " << path << endl;
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        length = info.st_size;
+        if (length > 0)
+        {
+            void *mapped = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+            if (mapped == MAP_FAILED)
+            {
+                cerr << "Error: cannot map " << path << endl;
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            madvise(mapped, length, randomAccess ? MADV_RANDOM : MADV_SEQUENTIAL);
+            bytes = (const uint8_t *)mapped;
+            isMapped = true;
+        }
+        ::close(fd); // The mapping stays valid without the descriptor
+#else
+        (void)randomAccess;
+        ifstream in(path, ios::binary);
+        if (!in)
+        {
+            cerr << "Error: cannot open " << path << endl;
+            return false;
+        }
+        loaded.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        bytes = loaded.data();
+        length = loaded.size();
+#endif
+        isOpen = true;
+        return true;
+    }
+
+    void close()
+    {
+#ifndef _WIN32
+        if (isMapped)
+            munmap((void *)bytes, length);
+#endif
+        loaded.clear();
+        bytes = nullptr;
+        length = 0;
+        isMapped = false;
+        isOpen = false;
+    }
+
+    const uint8_t *data() const
+    {
+        return bytes;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+
+    bool opened() const
+    {
+        return isOpen;
+    }
+
+private:
+    const uint8_t *bytes = nullptr;
+    size_t length = 0;
+    bool isMapped = false;
+    bool isOpen = false;
+    vector<uint8_t> loaded; // Only used without mmap
+};
@@ -0,0 +1,437 @@
+#pragma once
+
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+#include "boardSync.h"
+#include "commandLine.h"
+#include "pgn.h"
+#include "search.h"
+
+using namespace std;
+
+// Short balanced openings as moves from the start position; each is played with both colors
+const vector<string> DEFAULT_OPENINGS = {
+    "e2e4 e7e5 g1f3 b8c6 f1b5 a7a6",
+    "e2e4 e7e5 g1f3 b8c6 f1c4 f8c5",
+    "e2e4 c7c5 g1f3 d7d6 d2d4 c5d4",
+    "e2e4 c7c5 b1c3 b8c6 g2g3 g7g6",
+    "e2e4 e7e6 d2d4 d7d5 b1c3 g8f6",
+    "e2e4 c7c6 d2d4 d7d5 e4e5 c8f5",
+    "e2e4 d7d5 e4d5 d8d5 b1c3 d5a5",
+    "e2e4 g7g6 d2d4 f8g7 b1c3 d7d6",
+    "d2d4 d7d5 c2c4 e7e6 b1c3 g8f6",
+    "d2d4 d7d5 c2c4 c7c6 g1f3 g8f6",
+    "d2d4 g8f6 c2c4 g7g6 b1c3 f8g7",
+    "d2d4 g8f6 c2c4 e7e6 b1c3 f8b4",
+    "d2d4 g8f6 g1f3 d7d5 c1f4 c7c5",
+    "d2d4 f7f5 g2g3 g8f6 f1g2 e7e6",
+    "c2c4 e7e5 b1c3 g8f6 g1f3 b8c6",
+    "c2c4 c7c5 g1f3 b8c6 b1c3 g7g6",
+    "g1f3 d7d5 g2g3 g8f6 f1g2 c7c6",
+    "e2e4 e7e5 f2f4 e5f4 g1f3 g7g5",
+};
+
+struct TimeControl // Base time plus increment per move, written "10+0.1" in seconds
+{
+    int64_t baseMs = 10000;
+    int64_t incrementMs = 100;
+
+    static bool parse(const string &text, TimeControl &tc) // False unless the text is "base" or "base+increment", both at least 0
+    {
+        size_t plus = text.find('+');
+        double base, increment = 0;
+        if (!parseNumber(text.substr(0, plus), base) || (plus != string::npos && !parseNumber(text.substr(plus + 1), increment)) ||
+            !(base >= 0 && increment >= 0 && base + increment < 1e9))
+            return false;
+        tc.baseMs = int64_t(base * 1000);
+        tc.incrementMs = int64_t(increment * 1000);
+        return true;
+    }
+
+    string toPgn() const
+    {
+        ostringstream text;
+        text << baseMs / 1000.0 << "+" << incrementMs / 1000.0;
+        return text.str();
+    }
+};
+
+struct SprtStats // Game results from the point of view of the engine under test
+{
+    int wins = 0, losses = 0, draws = 0;
+
+    int games() const { return wins + losses + draws; }
+
+    double score() const
+    {
+        return games() ? (wins + 0.5 * draws) / games() : 0.5;
+    }
+
+    double variance() const // Per-game variance of the score
+    {
+        double s = score();
+        return games() ? (wins * (1 - s) * (1 - s) + draws * (0.5 - s) * (0.5 - s) + losses * s * s) / games() : 0;
+    }
+
+    static double scoreToElo(double s)
+    {
+        s = min(max(s, 1e-6), 1 - 1e-6);
+        return -400.0 * log10(1.0 / s - 1.0);
+    }
+
+    static double eloToScore(double elo)
+    {
+        return 1.0 / (1.0 + pow(10.0, -elo / 400.0));
+    }
+
+    double elo() const
+    {
+        return scoreToElo(score());
+    }
+
+    double eloMargin() const // Half width of the 95% confidence interval
+    {
+        if (!games())
+            return 0;
+        double deviation = sqrt(variance() / games());
+        return (scoreToElo(score() + 1.96 * deviation) - scoreToElo(score() - 1.96 * deviation)) / 2;
+    }
+
+    // Generalized SPRT log-likelihood ratio of H1 (elo1) against H0 (elo0), normal approximation
+    double llr(double elo0, double elo1) const
+    {
+        double var = variance();
+        if (games() == 0 || var <= 0)
+            return 0;
+        double s0 = eloToScore(elo0), s1 = eloToScore(elo1);
+        return games() * (s1 - s0) * (2 * score() - s0 - s1) / (2 * var);
+    }
+};
+
+struct MatchSettings
+{
+    SearchOptions baseOptions;
+    SearchOptions devOptions;
+    TimeControl timeControl;
+    int games = 1000;
+    unsigned concurrency = thread::hardware_concurrency();
+    size_t hashMb = 8;
+    vector<string> openings = DEFAULT_OPENINGS;
+    string pgnPath = "match.pgn";
+    double elo0 = 0, elo1 = 5, alpha = 0.05, beta = 0.05;
+    int maxPlies = 400; // Adjudicate longer games as draws
+};
+
+struct MatchGame
+{
+    PgnGame pgn;
+    bool devIsWhite = true;
+    int devScore2 = 1; // Twice the dev engine's score: 2 win, 1 draw, 0 loss
+};
+
+// Plays an opening, a FEN or a list of moves such as "e2e4 e7e5", on both boards. False if the
+// FEN is malformed or a move is not legal for ChessBoard and the engine alike.
+inline bool setUpOpening(const string &opening, Position &pos, ChessBoard &board, string &startFen, vector<string> &sanMoves)
+{
+    vector<string> openingMoves;
+    if (opening.find('/') != string::npos) // A FEN rather than a move list
+    {
+        bool isWhiteTurn;
+        if (!pos.setFen(opening) || !board.loadFen(opening, isWhiteTurn))
+            return false;
+    }
+    else
+    {
+        istringstream stream(opening);
+        string uci;
+        while (stream >> uci)
+            openingMoves.push_back(uci);
+    }
+    startFen = pos.fen();
+
+    for (const string &uci : openingMoves)
+    {
+        Move m = pos.parseUci(uci);
+        if (m == MOVE_NONE || !playOnBoard(board, m))
+            return false;
+        sanMoves.push_back(pos.moveToSan(m));
+        pos.makeMove(m);
+    }
+    return true;
+}
+
+// One game of a match: index picks the opening and the colors, so any process can play any
+// game. ChessBoard validates every move and detects checkmate; the engine Position adds the
+// draw rules.
+inline MatchGame playMatchGame(const MatchSettings &settings, int index, Search &dev, Search &base)
+{
+    MatchGame game;
+    game.devIsWhite = index % 2 == 0;
+    const string &opening = settings.openings[(index / 2) % settings.openings.size()];
+
+    Position pos;
+    ChessBoard board;
+    setUpOpening(opening, pos, board, game.pgn.startFen, game.pgn.moves); // Checked by readMatchSettings, on the coordinator for workers
+
+    int64_t clock[2] = {settings.timeControl.baseMs, settings.timeControl.baseMs};
+    string termination;
+    int winner = -1; // WHITE, BLACK or -1 for a draw
+    for (int ply = 0;; ply++)
+    {
+        if (board.lastMove.find("#") != string::npos)
+        {
+            winner = pos.sideToMove ^ 1;
+            termination = "checkmate";
+            break;
+        }
+        vector<Move> moves = boardCompatibleMoves(pos, board);
+        if (moves.empty())
+        {
+            winner = pos.inCheck() ? pos.sideToMove ^ 1 : -1;
+            termination = pos.inCheck() ? "checkmate" : "stalemate";
+            break;
+        }
+        if (pos.repetitionCount() >= 2 || pos.rule50 >= 100 || pos.hasInsufficientMaterial() || ply >= settings.maxPlies)
+        {
+            termination = pos.repetitionCount() >= 2 ? "threefold repetition" : pos.rule50 >= 100 ? "fifty-move rule"
+                                                                          : pos.hasInsufficientMaterial() ? "insufficient material"
+                                                                                                          : "move limit";
+            break;
+        }
+
+        int side = pos.sideToMove;
+        Search &engine = (side == WHITE) == game.devIsWhite ? dev : base;
+        SearchLimits limits;
+        limits.moveTimeMs = max<int64_t>(1, min(clock[side] / 25 + settings.timeControl.incrementMs * 3 / 4, clock[side] - 20));
+        limits.rootMoves = moves;
+
+        auto start = chrono::steady_clock::now();
+        SearchResult result = engine.think(pos, limits);
+        clock[side] -= chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+        if (clock[side] < 0)
+        {
+            winner = side ^ 1;
+            termination = "time forfeit";
+            break;
+        }
+        clock[side] += settings.timeControl.incrementMs;
+
+        Move m = result.bestMove != MOVE_NONE ? result.bestMove : moves[0];
+        string san = pos.moveToSan(m);
+        if (!playOnBoard(board, m))
+        {
+            winner = side ^ 1;
+            termination = "illegal move " + moveToUci(m);
+            break;
+        }
+        game.pgn.moves.push_back(san);
+        pos.makeMove(m);
+    }
+
+    game.pgn.result = winner == WHITE ? "1-0" : winner == BLACK ? "0-1" : "1/2-1/2";
+    bool devWon = winner != -1 && (winner == WHITE) == game.devIsWhite;
+    game.devScore2 = winner == -1 ? 1 : devWon ? 2 : 0;
+
+    time_t now = time(nullptr);
+    char date[16];
+    strftime(date, sizeof(date), "%Y.%m.%d", localtime(&now));
+    game.pgn.setTag("Event", "Self-play match");
+    game.pgn.setTag("Site", "local");
+    game.pgn.setTag("Date", date);
+    game.pgn.setTag("Round", to_string(index + 1));
+    game.pgn.setTag("White", game.devIsWhite ? "dev" : "base");
+    game.pgn.setTag("Black", game.devIsWhite ? "base" : "dev");
+    game.pgn.setTag("TimeControl", settings.timeControl.toPgn());
+    game.pgn.setTag("Termination", termination);
+    return game;
+}
+
+// Collects finished games: appends them to the PGN file, updates the score and stops the
+// match once the SPRT is decided
+class MatchResults
+{
+public:
+    SprtStats stats;
+    string verdict = "inconclusive";
+
+    bool open(const MatchSettings &matchSettings)
+    {
+        settings = matchSettings;
+        pgnFile.open(settings.pgnPath, ios::app);
+        if (!pgnFile)
+        {
+            cerr << "Cannot open " << settings.pgnPath << endl;
+            return false;
+        }
+        lower = log(settings.beta / (1 - settings.alpha));
+        upper = log((1 - settings.beta) / settings.alpha);
+        return true;
+    }
+
+    string boundsText() const
+    {
+        ostringstream text;
+        text << "SPRT elo0 " << settings.elo0 << " elo1 " << settings.elo1 << " bounds [" << fixed << setprecision(2)
+             << lower << ", " << upper << "]";
+        return text.str();
+    }
+
+    bool isDecided() const
+    {
+        return verdict != "inconclusive";
+    }
+
+    bool record(int index, const MatchGame &game) // True once the test is decided
+    {
+        writePgn(pgnFile, game.pgn);
+        pgnFile.flush();
+
+        if (game.devScore2 == 2)
+            stats.wins++;
+        else if (game.devScore2 == 0)
+            stats.losses++;
+        else
+            stats.draws++;
+
+        double llr = stats.llr(settings.elo0, settings.elo1);
+        cout << "Game " << index + 1 << " " << game.pgn.result << " (" << game.pgn.tag("Termination") << ")"
+             << " | dev W-L-D " << stats.wins << "-" << stats.losses << "-" << stats.draws
+             << " | Elo " << fixed << setprecision(1) << stats.elo() << " +- " << stats.eloMargin()
+             << " | LLR " << setprecision(2) << llr << "\n";
+
+        if (!isDecided() && (llr >= upper || llr <= lower))
+            verdict = llr >= upper ? "H1 accepted (dev is stronger)" : "H0 accepted (no gain)";
+        return isDecided();
+    }
+
+    void printSummary() const
+    {
+        cout << "Finished after " << stats.games() << " games: " << stats.wins << "-" << stats.losses << "-" << stats.draws
+             << ", Elo " << fixed << setprecision(1) << stats.elo() << " +- " << stats.eloMargin()
+             << ", LLR " << setprecision(2) << stats.llr(settings.elo0, settings.elo1) << " -> " << verdict << "\n";
+    }
+
+private:
+    MatchSettings settings;
+    ofstream pgnFile;
+    double lower = 0, upper = 0;
+};
+
+// Plays the dev engine against the base engine, one game per worker thread
+class MatchRunner
+{
+public:
+    explicit MatchRunner(const MatchSettings &settings) : settings(settings) {}
+
+    int run()
+    {
+        if (!results.open(settings))
+            return 1;
+        cout << "Match: " << settings.games << " games, " << settings.concurrency << " concurrent, tc "
+             << settings.timeControl.toPgn() << ", " << results.boundsText() << "\n";
+
+        vector<thread> workers;
+        for (unsigned i = 0; i < max(settings.concurrency, 1u); i++)
+            workers.emplace_back([this] { workerLoop(); });
+        for (thread &worker : workers)
+            worker.join();
+
+        results.printSummary();
+        return 0;
+    }
+
+private:
+    const MatchSettings settings;
+    atomic<int> nextGame{0};
+    atomic<bool> stopping{false};
+    mutex resultsMutex; // Guards results
+    MatchResults results;
+
+    void workerLoop()
+    {
+        Search dev, base;
+        dev.options = settings.devOptions;
+        base.options = settings.baseOptions;
+        dev.transpositionTable().resize(settings.hashMb);
+        base.transpositionTable().resize(settings.hashMb);
+
+        while (!stopping)
+        {
+            int index = nextGame++;
+            if (index >= settings.games)
+                break;
+            dev.clear();
+            base.clear();
+            MatchGame game = playMatchGame(settings, index, dev, base);
+            lock_guard<mutex> lock(resultsMutex);
+            if (results.record(index, game))
+                stopping = true; // Games in flight still finish and are recorded
+        }
+    }
+};
+
+// Reads the options "chess match" and "chess coordinate" share
+inline bool readMatchSettings(const CommandArgs &args, MatchSettings &settings)
+{
+    if (!applySearchOptions(settings.baseOptions, args.getString("base", "")) ||
+        !applySearchOptions(settings.devOptions, args.getString("dev", "")))
+    {
+        cerr << "Unknown search option in --base/--dev" << endl;
+        return false;
+    }
+    if (!TimeControl::parse(args.getString("tc", "10+0.1"), settings.timeControl))
+    {
+        cerr << "Error: --tc expects seconds plus increment, e.g. 10+0.1, not " << args.getString("tc", "") << endl;
+        return false;
+    }
+    settings.games = args.getInt("games", settings.games, 1);
+    settings.concurrency = args.getInt("concurrency", settings.concurrency, 1);
+    settings.hashMb = args.getInt("hash", int(settings.hashMb), 1);
+    settings.pgnPath = args.getString("pgn", settings.pgnPath);
+    settings.elo0 = args.getDouble("elo0", settings.elo0);
+    settings.elo1 = args.getDouble("elo1", settings.elo1);
+    if (!args.isValid())
+        return false;
+
+    if (args.has("openings"))
+    {
+        ifstream file(args.getString("openings", ""));
+        vector<string> openings;
+        string line;
+        while (getline(file, line))
+            if (!line.empty() && line[0] != '#')
+                openings.push_back(line);
+        if (openings.empty())
+        {
+            cerr << "No openings read from " << args.getString("openings", "") << endl;
+            return false;
+        }
+        settings.openings = openings;
+    }
+    for (const string &opening : settings.openings)
+    {
+        Position pos;
+        ChessBoard board;
+        string startFen;
+        vector<string> sanMoves;
+        if (!setUpOpening(opening, pos, board, startFen, sanMoves))
+        {
+            cerr << "Opening cannot be played: " << opening << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+inline int runMatch(const CommandArgs &args)
+{
+    MatchSettings settings;
+    if (!readMatchSettings(args, settings))
+        return 1;
+    MatchRunner runner(settings);
+    return runner.run();
+}
@@ -0,0 +1,476 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include "commandLine.h"
+#include "position.h"
+
+using namespace std;
+
+// Mate finding with depth-first proof-number search (df-pn). Instead of scoring every move
+// like alpha-beta, each node keeps a proof number (how many leaves still have to be shown
+// to be mates) and a disproof number (how many to refute it), and the search always goes
+// down the most promising branch. Forced mates with few defender replies are found after a
+// small fraction of the nodes a full-width search needs.
+//
+// The attacker is the side to move at the root. Nodes where the attacker moves are OR
+// nodes (one mating move is enough), defender nodes are AND nodes (every reply must lose).
+// Each search is bounded to a number of plies; the bound is part of the table key, so
+// results for different bounds never mix. Searching 1, 2, 3 ... moves deep gives the
+// shortest mate.
+
+enum MateStatus
+{
+    MATE_FOUND,
+    NO_MATE,     // Proven: no mate within the requested number of moves
+    MATE_UNKNOWN // The node limit ran out first
+};
+
+struct MateResult
+{
+    MateStatus status = MATE_UNKNOWN;
+    int mateIn = 0;    // Moves, when a mate was found
+    vector<Move> line; // Mating line with the longest defence
+    uint64_t nodes = 0;
+    double seconds = 0;
+};
+
+class MateSolver
+{
+public:
+    explicit MateSolver(size_t megabytes = 64)
+    {
+        resize(megabytes);
+    }
+
+    void resize(size_t megabytes) // Bounded node table; two entries per bucket, the one with less work behind it is replaced
+    {
+        size_t count = 2;
+        while (count * 2 * sizeof(ProofEntry) <= megabytes * 1024 * 1024)
+            count *= 2;
+        table.assign(count, ProofEntry());
+        mask = count - 1;
+    }
+
+    void clear()
+    {
+        fill(table.begin(), table.end(), ProofEntry());
+    }
+
+    atomic<bool> stopRequested{false}; // Makes solve() return MATE_UNKNOWN as soon as possible
+
+    MateResult solve(const Position &root, int maxMoves, uint64_t maxNodes = 0)
+    {
+        auto start = chrono::steady_clock::now();
+        MateResult result;
+        nodes = 0;
+        nodeLimit = maxNodes;
+        Position pos = root;
+        result.status = NO_MATE;
+        for (int moves = 1; moves <= maxMoves; moves++)
+        {
+            uint32_t pn, dn;
+            search(pos, 2 * moves - 1, true, INF, INF, pn, dn);
+            if (pn == 0)
+            {
+                result.status = MATE_FOUND;
+                result.mateIn = moves;
+                nodeLimit = 0; // The proof is in the table; reading out the line must not stop halfway
+                result.line = provenLine(pos, 2 * moves - 1);
+                break;
+            }
+            if (dn != 0) // Neither proven nor disproven: out of nodes or stopped
+            {
+                result.status = MATE_UNKNOWN;
+                break;
+            }
+        }
+        result.nodes = nodes;
+        result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+private:
+    struct ProofEntry
+    {
+        uint64_t key = 0;
+        uint32_t pn = 0, dn = 0;
+        uint64_t work = 0; // Nodes searched below this entry, for replacement
+    };
+
+    static constexpr uint32_t INF = 1u << 30;
+    vector<ProofEntry> table;
+    size_t mask = 0;
+    uint64_t nodes = 0;
+    uint64_t nodeLimit = 0;
+
+    static uint64_t nodeKey(const Position &pos, int remaining)
+    {
+        return pos.key ^ (uint64_t(remaining + 1) * 0x9E3779B97F4A7C15ULL);
+    }
+
+    bool lookup(uint64_t key, uint32_t &pn, uint32_t &dn) const
+    {
+        const ProofEntry *bucket = &table[key & mask & ~size_t(1)];
+        for (int i = 0; i < 2; i++)
+        {
+            if (bucket[i].key == key)
+            {
+                pn = bucket[i].pn;
+                dn = bucket[i].dn;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void store(uint64_t key, uint32_t pn, uint32_t dn, uint64_t work)
+    {
+        ProofEntry *bucket = &table[key & mask & ~size_t(1)];
+        ProofEntry *slot = bucket[0].key == key ? &bucket[0] : bucket[1].key == key ? &bucket[1]
+                                                         : bucket[0].work <= bucket[1].work ? &bucket[0]
+                                                                                          : &bucket[1];
+        *slot = {key, pn, dn, work};
+    }
+
+    bool isOutOfNodes() const
+    {
+        return (nodeLimit && nodes >= nodeLimit) || stopRequested.load(memory_order_relaxed);
+    }
+
+    // Searches until the node's proof number reaches thpn or its disproof number thdn.
+    // remaining counts the plies left; the defender must be mated when it reaches 0.
+    void search(Position &pos, int remaining, bool isOr, uint32_t thpn, uint32_t thdn, uint32_t &pn, uint32_t &dn)
+    {
+        uint64_t startNodes = nodes++;
+        uint64_t key = nodeKey(pos, remaining);
+        MoveList list;
+        pos.generateLegal(list);
+        if (list.size == 0) // Mate is a proof only when the defender is the one without moves
+        {
+            bool isMate = !isOr && pos.inCheck();
+            pn = isMate ? 0 : INF;
+            dn = isMate ? INF : 0;
+            store(key, pn, dn, 0);
+            return;
+        }
+        if (remaining == 0 || pos.isDraw())
+        {
+            pn = INF;
+            dn = 0;
+            store(key, pn, dn, 0);
+            return;
+        }
+
+        // Children start from the table, or from a guess that tries checks first
+        uint32_t childPn[256], childDn[256];
+        for (int i = 0; i < list.size; i++)
+        {
+            Move m = list.moves[i].move;
+            pos.makeMove(m);
+            if (!lookup(nodeKey(pos, remaining - 1), childPn[i], childDn[i]))
+            {
+                childPn[i] = isOr && !pos.inCheck() ? 3 : 1;
+                childDn[i] = 1;
+            }
+            pos.unmakeMove();
+        }
+
+        while (true)
+        {
+            // OR: pn = min, dn = sum. AND: pn = sum, dn = min.
+            uint32_t best = INF, second = INF, sum = 0;
+            int bestIndex = 0;
+            for (int i = 0; i < list.size; i++)
+            {
+                uint32_t value = isOr ? childPn[i] : childDn[i];
+                sum = min(INF, sum + (isOr ? childDn[i] : childPn[i]));
+                if (value < best)
+                {
+                    second = best;
+                    best = value;
+                    bestIndex = i;
+                }
+                else if (value < second)
+                    second = value;
+            }
+            pn = isOr ? best : sum;
+            dn = isOr ? sum : best;
+            if (pn >= thpn || dn >= thdn || isOutOfNodes())
+                break;
+
+            uint32_t childThpn, childThdn;
+            if (isOr)
+            {
+                childThpn = min(thpn, second + 1);
+                childThdn = thdn - dn + childDn[bestIndex];
+            }
+            else
+            {
+                childThpn = thpn - pn + childPn[bestIndex];
+                childThdn = min(thdn, second + 1);
+            }
+            Move m = list.moves[bestIndex].move;
+            pos.makeMove(m);
+            search(pos, remaining - 1, !isOr, childThpn, childThdn, childPn[bestIndex], childDn[bestIndex]);
+            pos.unmakeMove();
+        }
+        store(key, pn, dn, nodes - startNodes);
+    }
+
+    bool proves(Position &pos, int remaining, bool isOr)
+    {
+        uint32_t pn, dn;
+        search(pos, remaining, isOr, INF, INF, pn, dn);
+        return pn == 0;
+    }
+
+    // Walks the proof: the attacker plays any move that still mates in time, the defender
+    // the reply that postpones the mate longest.
+    vector<Move> provenLine(Position &pos, int remaining)
+    {
+        vector<Move> line;
+        while (remaining > 0)
+        {
+            MoveList list;
+            pos.generateLegal(list);
+            Move chosen = MOVE_NONE;
+            for (int i = 0; i < list.size && chosen == MOVE_NONE; i++)
+            {
+                pos.makeMove(list.moves[i].move);
+                if (proves(pos, remaining - 1, false))
+                    chosen = list.moves[i].move;
+                pos.unmakeMove();
+            }
+            if (chosen == MOVE_NONE)
+                break;
+            line.push_back(chosen);
+            pos.makeMove(chosen);
+
+            MoveList replies;
+            pos.generateLegal(replies);
+            if (replies.size == 0)
+                break; // Mate
+            Move longest = MOVE_NONE;
+            int longestRemaining = -1;
+            for (int i = 0; i < replies.size; i++)
+            {
+                pos.makeMove(replies.moves[i].move);
+                int needed = 1;
+                while (needed < remaining - 2 && !proves(pos, needed, true))
+                    needed += 2;
+                if (needed > longestRemaining)
+                {
+                    longestRemaining = needed;
+                    longest = replies.moves[i].move;
+                }
+                pos.unmakeMove();
+            }
+            line.push_back(longest);
+            pos.makeMove(longest);
+            remaining = longestRemaining;
+        }
+        for (size_t i = line.size(); i-- > 0;)
+            pos.unmakeMove();
+        return line;
+    }
+};
+
+inline string mateLineSan(Position pos, const vector<Move> &line)
+{
+    string text;
+    for (Move m : line)
+    {
+        text += (text.empty() ? "" : " ") + pos.moveToSan(m);
+        pos.makeMove(m);
+    }
+    return text;
+}
+
+inline string mateResultText(const Position &pos, const MateResult &result, int maxMoves) // "Mate in 3: Qh7+ Kf8 Qh8#"
+{
+    if (result.status == MATE_FOUND)
+        return "Mate in " + to_string(result.mateIn) + ": " + mateLineSan(pos, result.line);
+    if (result.status == NO_MATE)
+        return "No mate in " + to_string(maxMoves);
+    return "Unknown (node limit)";
+}
+
+// Solves one position at a time on a worker thread for the board, so the window keeps
+// drawing while it runs. A new request stops the one in progress.
+class MateWorker
+{
+public:
+    struct Answer
+    {
+        uint64_t generation = 0; // Position the answer belongs to
+        string text;
+    };
+
+    MateWorker(int maxMoves, uint64_t maxNodes) : maxMoves(maxMoves), maxNodes(maxNodes) {}
+    MateWorker(const MateWorker &) = delete;
+    MateWorker &operator=(const MateWorker &) = delete;
+
+    ~MateWorker()
+    {
+        {
+            lock_guard<mutex> lock(requestMutex);
+            isStopping = true;
+            solver.stopRequested = true;
+        }
+        requestReady.notify_one();
+        if (worker.joinable())
+            worker.join();
+    }
+
+    void request(const Position &pos, uint64_t generation)
+    {
+        {
+            lock_guard<mutex> lock(requestMutex);
+            pending = pos;
+            pendingGeneration = generation;
+            hasPending = true;
+            solver.stopRequested = true; // Cleared by the worker when it takes the request
+            if (!worker.joinable())
+                worker = thread(&MateWorker::run, this);
+        }
+        requestReady.notify_one();
+    }
+
+    shared_ptr<const Answer> answer(uint64_t generation) const // Null until the position is solved
+    {
+        shared_ptr<const Answer> current = atomic_load(&published);
+        return current && current->generation == generation ? current : nullptr;
+    }
+
+private:
+    MateSolver solver{16};
+    int maxMoves;
+    uint64_t maxNodes;
+    thread worker;
+    mutex requestMutex;
+    condition_variable requestReady;
+    Position pending;
+    uint64_t pendingGeneration = 0;
+    bool hasPending = false;
+    bool isStopping = false;
+    shared_ptr<const Answer> published; // Only accessed with atomic_load/atomic_store
+
+    void run()
+    {
+        while (true)
+        {
+            Position pos;
+            auto answer = make_shared<Answer>();
+            {
+                unique_lock<mutex> lock(requestMutex);
+                requestReady.wait(lock, [this]
+                                  { return hasPending || isStopping; });
+                if (isStopping)
+                    return;
+                pos = pending;
+                answer->generation = pendingGeneration;
+                hasPending = false;
+                solver.stopRequested = false;
+            }
+            MateResult result = solver.solve(pos, maxMoves, maxNodes);
+            if (solver.stopRequested)
+                continue; // Abandoned for a newer position
+            answer->text = mateResultText(pos, result, maxMoves);
+            atomic_store(&published, shared_ptr<const Answer>(answer));
+        }
+    }
+};
+
+// Splits an EPD or FEN line into the position and an optional "dm N" (direct mate) opcode
+inline bool parseMatePuzzle(const string &line, string &fen, int &expectedMate)
+{
+    istringstream stream(line);
+    vector<string> fields;
+    string token;
+    while (stream >> token && fields.size() < 4)
+        fields.push_back(token);
+    if (fields.size() < 4)
+        return false;
+    fen = fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3];
+    expectedMate = 0;
+    string rest = token + " " + string(istreambuf_iterator<char>(stream), {});
+    size_t dm = rest.find("dm ");
+    if (dm != string::npos)
+        expectedMate = atoi(rest.c_str() + dm + 3);
+    else if (isdigit((unsigned char)token[0])) // Plain FEN with move counters
+        fen += " " + rest.substr(0, rest.find(';'));
+    return true;
+}
+
+// "chess mate <FEN | puzzles.epd> [--moves 8] [--nodes 0] [--hash 64]"
+inline int runMateSolver(const CommandArgs &args)
+{
+    int maxMoves = args.getInt("moves", 8, 1);
+    uint64_t maxNodes = args.getInt("nodes", 0, 0);
+    size_t hashMb = args.getInt("hash", 64, 1);
+    if (args.positional.empty() || !args.isValid())
+    {
+        cerr << "Usage: chess mate <FEN | puzzles.epd> [--moves 8] [--nodes 0] [--hash 64]" << endl;
+        return 1;
+    }
+    MateSolver solver(hashMb);
+
+    vector<string> lines;
+    ifstream file(args.positional[0]);
+    if (args.positional.size() == 1 && file)
+    {
+        string line;
+        while (getline(file, line))
+            if (!line.empty() && line[0] != '#')
+                lines.push_back(line);
+    }
+    else
+    {
+        string fen;
+        for (const string &part : args.positional) // An unquoted FEN arrives in pieces
+            fen += (fen.empty() ? "" : " ") + part;
+        lines.push_back(fen);
+    }
+
+    int solved = 0, failed = 0;
+    uint64_t totalNodes = 0;
+    double totalSeconds = 0;
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        string fen;
+        int expected;
+        Position pos;
+        if (!parseMatePuzzle(lines[i], fen, expected) || !pos.setFen(fen))
+        {
+            cerr << "Error: cannot read position " << i + 1 << ": " << lines[i] << endl;
+            failed++;
+            continue;
+        }
+        solver.clear();
+        MateResult result = solver.solve(pos, expected ? max(expected, maxMoves) : maxMoves, maxNodes);
+        totalNodes += result.nodes;
+        totalSeconds += result.seconds;
+        bool isCorrect = expected ? result.status == MATE_FOUND && result.mateIn == expected : result.status != MATE_UNKNOWN;
+        (isCorrect ? solved : failed)++;
+        if (lines.size() > 1)
+            cout << i + 1 << ". ";
+        cout << mateResultText(pos, result, maxMoves) << "  (" << result.nodes << " nodes, " << fixed << setprecision(1)
+             << result.seconds * 1000 << " ms)";
+        if (expected)
+            cout << (isCorrect ? "" : "  expected mate in " + to_string(expected));
+        cout << "\n";
+    }
+    if (lines.size() > 1)
+        cout << "Solved " << solved << "/" << lines.size() << ", " << totalNodes << " nodes in " << fixed << setprecision(2)
+             << totalSeconds << " s (" << setprecision(0) << totalNodes / max(totalSeconds, 1e-9) << " nodes/s)" << endl;
+    return failed ? 1 : 0;
+}
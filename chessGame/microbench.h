@@ -0,0 +1,368 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include "boardSync.h"
+#include "commandLine.h"
+#include "movePrecompute.h"
+
+using namespace std;
+
+// Small benchmark harness in the spirit of Google Benchmark: every benchmark is a function
+// that runs its operation a given number of times. The harness grows the count until a run
+// takes long enough to time, repeats it, and reports the median time per operation.
+
+struct MicroBenchmark
+{
+    string name;
+    function<void(uint64_t iterations)> run;
+};
+
+struct MicroResult
+{
+    string name;
+    uint64_t iterations;
+    double realNs; // Per operation, median of the repetitions
+    double cpuNs;
+};
+
+inline volatile uint64_t benchmarkSink = 0; // Results are folded in here so the work cannot be optimised away
+
+// Fixed positions the rules benchmarks run over, one per game phase plus one in check
+const vector<pair<string, string>> MICROBENCH_POSITIONS = {
+    {"opening", "r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R b KQkq - 3 3"},
+    {"middlegame", "r2q1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP2BPPP/R2Q1RK1 w - - 0 10"},
+    {"endgame", "8/5pk1/6p1/3R4/7P/6P1/r4PK1/8 w - - 0 40"},
+    {"check", "r1bqk2r/pppp1Bpp/2n2n2/2b1p3/4P3/5N2/PPPP1PPP/RNBQK2R b KQkq - 0 4"},
+};
+
+struct BenchPosition // A position loaded into a ChessBoard with the moves both rule sets accept
+{
+    string name;
+    ChessBoard board;
+    bool isWhiteTurn = true;
+    vector<array<int, 4>> moves;     // fromX, fromY, toX, toY; en passant is left out because it changes the board
+    vector<array<int, 4>> lineMoves; // Moves along a rank, file or diagonal, the only ones isPathClear handles
+};
+
+inline vector<BenchPosition> loadBenchPositions()
+{
+    vector<BenchPosition> positions;
+    for (auto &[name, fen] : MICROBENCH_POSITIONS)
+    {
+        BenchPosition p;
+        p.name = name;
+        p.board.loadFen(fen, p.isWhiteTurn);
+        Position pos;
+        pos.setFen(fen);
+        for (Move m : boardCompatibleMoves(pos, p.board))
+        {
+            array<int, 4> bm = {squareX(moveFrom(m)), squareY(moveFrom(m)), squareX(moveTo(m)), squareY(moveTo(m))};
+            if (moveFlag(m) == EN_PASSANT)
+                continue;
+            p.moves.push_back(bm);
+            if (bm[0] == bm[2] || bm[1] == bm[3] || abs(bm[0] - bm[2]) == abs(bm[1] - bm[3]))
+                p.lineMoves.push_back(bm);
+        }
+        positions.push_back(p);
+    }
+    return positions;
+}
+
+inline vector<MicroBenchmark> rulesBenchmarks() // ChessBoard hot paths over every bench position
+{
+    vector<MicroBenchmark> benchmarks;
+    for (BenchPosition &p : loadBenchPositions())
+    {
+        auto position = make_shared<BenchPosition>(p);
+        string suffix = "/" + p.name;
+
+        benchmarks.push_back({"ChessBoard::isValidMove" + suffix, [position](uint64_t n)
+                              {
+                                  ChessBoard &board = position->board;
+                                  uint64_t valid = 0;
+                                  for (uint64_t i = 0; i < n; i++)
+                                  {
+                                      auto &m = position->moves[i % position->moves.size()];
+                                      valid += board.isValidMove(m[0], m[1], m[2], m[3]);
+                                  }
+                                  benchmarkSink += valid;
+                              }});
+
+        // What a drag start costs: the highlight pass Game::onMousePress and the move precomputer run
+        benchmarks.push_back({"Game::onMousePress highlights" + suffix, [position](uint64_t n)
+                              {
+                                  ChessBoard &board = position->board;
+                                  uint64_t valid = 0;
+                                  for (uint64_t i = 0; i < n; i++)
+                                  {
+                                      auto &m = position->moves[i % position->moves.size()];
+                                      valid += popCount(highlightTargets(board, m[0], m[1]));
+                                  }
+                                  benchmarkSink += valid;
+                              }});
+
+        benchmarks.push_back({"ChessBoard::isKingInCheck" + suffix, [position](uint64_t n)
+                              {
+                                  uint64_t checks = 0;
+                                  for (uint64_t i = 0; i < n; i++)
+                                      checks += position->board.isKingInCheck(position->isWhiteTurn);
+                                  benchmarkSink += checks;
+                              }});
+
+        benchmarks.push_back({"ChessBoard::isCheckmate" + suffix, [position](uint64_t n)
+                              {
+                                  uint64_t mates = 0;
+                                  for (uint64_t i = 0; i < n; i++)
+                                      mates += position->board.isCheckmate(position->isWhiteTurn);
+                                  benchmarkSink += mates;
+                              }});
+
+        benchmarks.push_back({"ChessBoard::detectAmbiguity" + suffix, [position](uint64_t n)
+                              {
+                                  ChessBoard &board = position->board;
+                                  uint64_t ambiguous = 0;
+                                  for (uint64_t i = 0; i < n; i++)
+                                  {
+                                      auto &m = position->moves[i % position->moves.size()];
+                                      Piece &piece = board.getSquare(m[1], m[0]).piece;
+                                      pair<bool, bool> result = board.detectAmbiguity(m[0], m[1], m[2], m[3], piece.type[0], piece.isWhite);
+                                      ambiguous += result.first + result.second;
+                                  }
+                                  benchmarkSink += ambiguous;
+                              }});
+
+        benchmarks.push_back({"ChessBoard::isPathClear" + suffix, [position](uint64_t n)
+                              {
+                                  ChessBoard &board = position->board;
+                                  uint64_t clear = 0;
+                                  for (uint64_t i = 0; i < n; i++)
+                                  {
+                                      auto &m = position->lineMoves[i % position->lineMoves.size()];
+                                      clear += board.isPathClear(m[0], m[1], m[2], m[3]);
+                                  }
+                                  benchmarkSink += clear;
+                              }});
+
+        // movePiece changes the board, so every iteration works on a fresh copy; the copy
+        // alone is measured separately
+        benchmarks.push_back({"ChessBoard copy" + suffix, [position](uint64_t n)
+                              {
+                                  for (uint64_t i = 0; i < n; i++)
+                                  {
+                                      ChessBoard copy = position->board;
+                                      benchmarkSink += copy.lastMove.size();
+                                  }
+                              }});
+
+        benchmarks.push_back({"ChessBoard::movePiece" + suffix, [position](uint64_t n)
+                              {
+                                  for (uint64_t i = 0; i < n; i++)
+                                  {
+                                      auto &m = position->moves[i % position->moves.size()];
+                                      ChessBoard copy = position->board;
+                                      copy.movePiece(m[0], m[1], m[2], m[3]);
+                                      benchmarkSink += copy.lastMove.size();
+                                  }
+                              }});
+    }
+    return benchmarks;
+}
+
+inline vector<MicroBenchmark> positionBenchmarks() // Engine move generation and make/unmake over the same positions
+{
+    vector<MicroBenchmark> benchmarks;
+    for (auto &[name, fen] : MICROBENCH_POSITIONS)
+    {
+        auto pos = make_shared<Position>();
+        pos->setFen(fen);
+        auto moves = make_shared<MoveList>();
+        pos->generateLegal(*moves);
+        string suffix = "/" + name;
+
+        benchmarks.push_back({"Position::generateLegal" + suffix, [pos](uint64_t n)
+                              {
+                                  uint64_t count = 0;
+                                  for (uint64_t i = 0; i < n; i++)
+                                  {
+                                      MoveList list;
+                                      pos->generateLegal(list);
+                                      count += list.size;
+                                  }
+                                  benchmarkSink += count;
+                              }});
+
+        benchmarks.push_back({"Position::makeMove+unmakeMove" + suffix, [pos, moves](uint64_t n)
+                              {
+                                  for (uint64_t i = 0; i < n; i++)
+                                  {
+                                      pos->makeMove(moves->moves[i % moves->size].move);
+                                      benchmarkSink += pos->key;
+                                      pos->unmakeMove();
+                                  }
+                              }});
+
+        // The same attacked-square set, one square at a time and with the batched slider fill
+        benchmarks.push_back({"Position::isSquareAttacked x64" + suffix, [pos](uint64_t n)
+                              {
+                                  for (uint64_t i = 0; i < n; i++)
+                                  {
+                                      Bitboard attacked = 0;
+                                      for (int sq = 0; sq < 64; sq++)
+                                          if (pos->isSquareAttacked(sq, pos->sideToMove ^ 1))
+                                              attacked |= squareBB(sq);
+                                      benchmarkSink += attacked;
+                                  }
+                              }});
+
+        benchmarks.push_back({"Position::attackMap" + suffix, [pos](uint64_t n)
+                              {
+                                  for (uint64_t i = 0; i < n; i++)
+                                      benchmarkSink += pos->attackMap(pos->sideToMove ^ 1, pos->occupied());
+                              }});
+
+        benchmarks.push_back({"perft 3" + suffix, [pos](uint64_t n)
+                              {
+                                  for (uint64_t i = 0; i < n; i++)
+                                      benchmarkSink += perft(*pos, 3);
+                              }});
+    }
+    return benchmarks;
+}
+
+inline MicroResult measure(const MicroBenchmark &benchmark, double minSeconds, int repetitions)
+{
+    auto timeRun = [&](uint64_t iterations, double &cpuSeconds)
+    {
+        clock_t cpuStart = clock();
+        auto start = chrono::steady_clock::now();
+        benchmark.run(iterations);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cpuSeconds = double(clock() - cpuStart) / CLOCKS_PER_SEC;
+        return seconds;
+    };
+
+    // Grow the iteration count until one run is long enough to time reliably
+    uint64_t iterations = 1;
+    double cpuSeconds, seconds = timeRun(iterations, cpuSeconds);
+    while (seconds < minSeconds)
+    {
+        double factor = seconds > 0 ? min(10.0, max(1.5, 1.2 * minSeconds / seconds)) : 10.0;
+        iterations = uint64_t(iterations * factor) + 1;
+        seconds = timeRun(iterations, cpuSeconds);
+    }
+
+    vector<pair<double, double>> samples; // real, cpu per operation in ns
+    samples.push_back({seconds * 1e9 / iterations, cpuSeconds * 1e9 / iterations});
+    for (int r = 1; r < repetitions; r++)
+    {
+        seconds = timeRun(iterations, cpuSeconds);
+        samples.push_back({seconds * 1e9 / iterations, cpuSeconds * 1e9 / iterations});
+    }
+    sort(samples.begin(), samples.end());
+    pair<double, double> median = samples[samples.size() / 2];
+    return {benchmark.name, iterations, median.first, median.second};
+}
+
+inline string jsonEscape(const string &text)
+{
+    string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+// Writes the results in the Google Benchmark JSON layout, one benchmark per line, so its
+// comparison tools work on them too
+inline void writeBenchmarkJson(ostream &out, const vector<MicroResult> &results)
+{
+    time_t now = time(nullptr);
+    char date[32];
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    out << "{\n  \"context\": {\"date\": \"" << date << "\", \"num_cpus\": " << thread::hardware_concurrency()
+        << ", \"library_build_type\": \"chess microbench\"},\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const MicroResult &r = results[i];
+        out << "    {\"name\": \"" << jsonEscape(r.name) << "\", \"run_type\": \"iteration\", \"iterations\": " << r.iterations
+            << fixed << setprecision(2) << ", \"real_time\": " << r.realNs << ", \"cpu_time\": " << r.cpuNs
+            << ", \"time_unit\": \"ns\"}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+inline map<string, double> readBenchmarkJson(const string &path) // name -> real_time, from writeBenchmarkJson output
+{
+    map<string, double> times;
+    ifstream in(path);
+    string line;
+    while (getline(in, line))
+    {
+        size_t name = line.find("\"name\": \""), time = line.find("\"real_time\": ");
+        if (name == string::npos || time == string::npos)
+            continue;
+        name += 9;
+        string key;
+        for (size_t i = name; i < line.size() && line[i] != '"'; i++)
+            key += line[i] == '\\' ? line[++i] : line[i];
+        times[key] = stod(line.substr(time + 13));
+    }
+    return times;
+}
+
+// "chess microbench [--filter text] [--min-time 0.2] [--repetitions 3] [--json file] [--baseline file] [--threshold 10]"
+inline int runMicroBenchmarks(const CommandArgs &args, const vector<MicroBenchmark> &benchmarks)
+{
+    string filter = args.getString("filter", "");
+    double minSeconds = args.getDouble("min-time", 0.2);
+    int repetitions = args.getInt("repetitions", 3, 1);
+    double threshold = args.getDouble("threshold", 10); // Percent slower than the baseline that counts as a regression
+    if (!args.isValid())
+        return 1;
+    map<string, double> baseline;
+    if (args.has("baseline"))
+        baseline = readBenchmarkJson(args.getString("baseline", ""));
+
+    vector<MicroResult> results;
+    int regressions = 0;
+    cout << left << setw(48) << "Benchmark" << right << setw(14) << "Time" << setw(14) << "CPU" << setw(12) << "Iterations"
+         << (baseline.empty() ? "" : "   vs baseline") << "\n";
+    for (const MicroBenchmark &benchmark : benchmarks)
+    {
+        if (benchmark.name.find(filter) == string::npos)
+            continue;
+        MicroResult r = measure(benchmark, minSeconds, repetitions);
+        results.push_back(r);
+        cout << left << setw(48) << r.name << right << fixed << setprecision(1) << setw(11) << r.realNs << " ns"
+             << setw(11) << r.cpuNs << " ns" << setw(12) << r.iterations;
+        auto old = baseline.find(r.name);
+        if (old != baseline.end())
+        {
+            double change = 100 * (r.realNs - old->second) / old->second;
+            cout << "   " << showpos << change << "%" << noshowpos << (change > threshold ? "  slower" : "");
+            regressions += change > threshold;
+        }
+        cout << endl;
+    }
+
+    if (args.has("json"))
+    {
+        ofstream out(args.getString("json", ""));
+        writeBenchmarkJson(out, results);
+    }
+    if (!baseline.empty())
+        cout << regressions << " benchmarks more than " << threshold << "% slower than the baseline" << endl;
+    return regressions == 0 ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "chessBoard.h"
+
+using namespace std;
+
+// Squares a piece may be dragged to, as one bit per square (y * 8 + x). This is the rule the
+// board highlights use: a legal move that does not give check or mate. A slider's candidates
+// come from one Kogge-Stone fill, so only the squares it reaches go through isValidMove.
+inline uint64_t highlightTargets(ChessBoard &board, int fromX, int fromY)
+{
+    uint64_t targets = 0;
+    uint64_t candidates = ~uint64_t(0); // Every square for the other pieces
+    board.sliderTargets(fromX, fromY, candidates);
+    for (; candidates; candidates &= candidates - 1)
+    {
+        int square = lsb(candidates);
+        bool putsOpponentInCheck = false;
+        bool putsInCheckmate = false;
+        if (board.isValidMove(fromX, fromY, square % SIZE, square / SIZE, putsOpponentInCheck, putsInCheckmate, false, false, true) &&
+            !putsOpponentInCheck && !putsInCheckmate)
+            targets |= uint64_t(1) << square;
+    }
+    return targets;
+}
+
+struct LegalMoveTable // Drag targets of every piece of the side to move in one position
+{
+    uint64_t generation = 0; // Position the table was computed for
+    array<uint64_t, SIZE * SIZE> targets = {};
+};
+
+// Computes the LegalMoveTable of the latest position on a worker thread, so the UI only has
+// to look it up when a piece is picked up. A newer request abandons the one in progress.
+class MovePrecomputer
+{
+public:
+    MovePrecomputer() = default;
+    MovePrecomputer(const MovePrecomputer &) = delete;
+    MovePrecomputer &operator=(const MovePrecomputer &) = delete;
+
+    ~MovePrecomputer()
+    {
+        {
+            lock_guard<mutex> lock(requestMutex);
+            isStopping = true;
+        }
+        requestReady.notify_one();
+        if (worker.joinable())
+            worker.join();
+    }
+
+    void request(const ChessBoard &board, bool isWhiteTurn, uint64_t generation) // Call after every change to the board
+    {
+        {
+            lock_guard<mutex> lock(requestMutex);
+            pendingBoard = board;
+            pendingIsWhiteTurn = isWhiteTurn;
+            pendingGeneration = generation;
+            hasPending = true;
+            latestGeneration = generation;
+            if (!worker.joinable())
+                worker = thread(&MovePrecomputer::run, this); // Started on first use
+        }
+        requestReady.notify_one();
+    }
+
+    shared_ptr<const LegalMoveTable> table(uint64_t generation) const // Null until the table for this position is ready
+    {
+        shared_ptr<const LegalMoveTable> current = atomic_load(&published);
+        return current && current->generation == generation ? current : nullptr;
+    }
+
+private:
+    thread worker;
+    mutex requestMutex;
+    condition_variable requestReady;
+    ChessBoard pendingBoard;
+    bool pendingIsWhiteTurn = true;
+    uint64_t pendingGeneration = 0;
+    bool hasPending = false;
+    bool isStopping = false;
+    atomic<uint64_t> latestGeneration{0};
+    shared_ptr<const LegalMoveTable> published; // Only accessed with atomic_load/atomic_store
+
+    void run()
+    {
+        while (true)
+        {
+            ChessBoard board;
+            bool isWhiteTurn;
+            auto table = make_shared<LegalMoveTable>();
+            {
+                unique_lock<mutex> lock(requestMutex);
+                requestReady.wait(lock, [this]
+                                  { return hasPending || isStopping; });
+                if (isStopping)
+                    return;
+                board = pendingBoard;
+                isWhiteTurn = pendingIsWhiteTurn;
+                table->generation = pendingGeneration;
+                hasPending = false;
+            }
+
+            bool isStale = false;
+            for (int y = 0; y < SIZE && !isStale; y++)
+            {
+                for (int x = 0; x < SIZE; x++)
+                {
+                    Piece &piece = board.getSquare(y, x).piece;
+                    if (!piece.isEmpty() && piece.isWhite == isWhiteTurn)
+                        table->targets[y * SIZE + x] = highlightTargets(board, x, y);
+                }
+                isStale = latestGeneration.load(memory_order_relaxed) != table->generation;
+            }
+            if (!isStale)
+                atomic_store(&published, shared_ptr<const LegalMoveTable>(table));
+        }
+    }
+};
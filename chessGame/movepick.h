@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cstdlib>
+#include "position.h"
+#include "evaluate.h"
+
+using namespace std;
+
+struct OrderingOptions // Each heuristic can be switched off to measure what it buys
+{
+    bool ttMove = true;   // Try the transposition table move first
+    bool captures = true; // Captures in their own stage, sorted by MVV-LVA
+    bool killers = true;  // Quiet moves that caused a cutoff at the same ply
+    bool history = true;  // Sort quiets by butterfly history scores
+    bool see = true;      // Try captures that lose material (SEE < 0) after the quiets
+};
+
+struct HistoryTable // Butterfly history: how often a quiet [from][to] move caused a cutoff
+{
+    int scores[2][64][64];
+
+    HistoryTable()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        for (auto &side : scores)
+            for (auto &from : side)
+                for (auto &score : from)
+                    score = 0;
+    }
+
+    int get(int color, Move m) const
+    {
+        return scores[color][moveFrom(m)][moveTo(m)];
+    }
+
+    void update(int color, Move m, int bonus) // History gravity keeps scores within +-MAX_HISTORY
+    {
+        const int MAX_HISTORY = 16384;
+        bonus = max(-MAX_HISTORY, min(MAX_HISTORY, bonus));
+        int &score = scores[color][moveFrom(m)][moveTo(m)];
+        score += bonus - score * abs(bonus) / MAX_HISTORY;
+    }
+};
+
+// Staged move picker: hands out pseudo-legal moves one at a time, generating each group
+// only when the previous one is exhausted, so a cutoff skips the remaining work.
+class MovePicker
+{
+public:
+    enum Stage
+    {
+        TT_MOVE,
+        CAPTURE_INIT,
+        CAPTURES,
+        KILLER_1,
+        KILLER_2,
+        QUIET_INIT,
+        QUIETS,
+        BAD_CAPTURES,
+        DONE,
+        QS_TT_MOVE,
+        QS_CAPTURE_INIT,
+        QS_CAPTURES
+    };
+
+    MovePicker(const Position &pos, Move ttMove, const Move *killers, const HistoryTable &history, const OrderingOptions &options)
+        : pos(pos), history(history), options(options)
+    {
+        this->ttMove = options.ttMove && pos.isPseudoLegal(ttMove) ? ttMove : MOVE_NONE;
+        killer[0] = killer[1] = MOVE_NONE;
+        if (options.killers && killers)
+        {
+            killer[0] = killers[0];
+            killer[1] = killers[1];
+        }
+        stage = TT_MOVE;
+    }
+
+    // Quiescence search: only captures and queen promotions, unless in check
+    MovePicker(const Position &pos, Move ttMove, const HistoryTable &history, const OrderingOptions &options, bool inCheck)
+        : MovePicker(pos, ttMove, nullptr, history, options)
+    {
+        if (!inCheck)
+        {
+            if (this->ttMove != MOVE_NONE && !pos.isCaptureOrPromotion(this->ttMove))
+                this->ttMove = MOVE_NONE;
+            stage = QS_TT_MOVE;
+        }
+    }
+
+    Move nextMove()
+    {
+        while (true)
+        {
+            switch (stage)
+            {
+            case TT_MOVE:
+                stage = CAPTURE_INIT;
+                if (ttMove != MOVE_NONE)
+                    return ttMove;
+                break;
+
+            case CAPTURE_INIT:
+                if (!options.captures) // Captures then share the final stage with the quiets
+                {
+                    stage = KILLER_1;
+                    break;
+                }
+                moves.size = 0;
+                pos.generateCaptures(moves);
+                scoreCaptures();
+                current = 0;
+                stage = CAPTURES;
+                break;
+
+            case CAPTURES:
+                while (current < moves.size)
+                {
+                    Move m = pickBest(current++);
+                    if (m == ttMove)
+                        continue;
+                    if (options.see && badCaptureCount < 64 && pos.see(m) < 0)
+                    {
+                        badCaptures[badCaptureCount++] = m; // Postponed until after the quiets
+                        continue;
+                    }
+                    return m;
+                }
+                stage = KILLER_1;
+                break;
+
+            case KILLER_1:
+            case KILLER_2:
+            {
+                int index = stage - KILLER_1;
+                Move m = killer[index];
+                stage = Stage(stage + 1);
+                if (m != MOVE_NONE && m != ttMove && m != playedKiller[0] && !pos.isCaptureOrPromotion(m) && pos.isPseudoLegal(m))
+                    return playedKiller[index] = m;
+                break;
+            }
+
+            case QUIET_INIT:
+                moves.size = 0;
+                if (options.captures)
+                    pos.generateQuiets(moves);
+                else
+                    pos.generatePseudoLegal(moves);
+                scoreQuiets();
+                current = 0;
+                stage = QUIETS;
+                break;
+
+            case QUIETS:
+                while (current < moves.size)
+                {
+                    Move m = moves.moves[current++].move;
+                    if (m != ttMove && m != playedKiller[0] && m != playedKiller[1]) // A killer the stage skipped still comes up here
+                        return m;
+                }
+                current = 0;
+                stage = BAD_CAPTURES;
+                break;
+
+            case BAD_CAPTURES:
+                if (current < badCaptureCount)
+                    return badCaptures[current++];
+                stage = DONE;
+                break;
+
+            case DONE:
+                return MOVE_NONE;
+
+            case QS_TT_MOVE:
+                stage = QS_CAPTURE_INIT;
+                if (ttMove != MOVE_NONE)
+                    return ttMove;
+                break;
+
+            case QS_CAPTURE_INIT:
+                moves.size = 0;
+                pos.generateCaptures(moves);
+                scoreCaptures();
+                current = 0;
+                stage = QS_CAPTURES;
+                break;
+
+            case QS_CAPTURES:
+                while (current < moves.size)
+                {
+                    Move m = pickBest(current++);
+                    if (m != ttMove)
+                        return m;
+                }
+                stage = DONE;
+                break;
+            }
+        }
+    }
+
+    Stage stage;
+
+private:
+    const Position &pos;
+    const HistoryTable &history;
+    const OrderingOptions &options;
+    Move ttMove;
+    Move killer[2];
+    Move playedKiller[2] = {MOVE_NONE, MOVE_NONE}; // Killers the killer stages returned
+    MoveList moves;
+    int current = 0;
+    Move badCaptures[64];
+    int badCaptureCount = 0;
+
+    void scoreCaptures() // MVV-LVA: most valuable victim first, least valuable attacker breaks ties
+    {
+        for (int i = 0; i < moves.size; i++)
+        {
+            Move m = moves.moves[i].move;
+            int attacker = pieceType(pos.pieceOn(moveFrom(m)));
+            int victim = moveFlag(m) == EN_PASSANT ? PAWN : (pos.pieceOn(moveTo(m)) == NO_PIECE ? NO_PIECE_TYPE : pieceType(pos.pieceOn(moveTo(m))));
+            int score = victim == NO_PIECE_TYPE ? 0 : 8 * PIECE_VALUE[victim] - attacker;
+            if (moveFlag(m) == PROMOTION)
+                score += PIECE_VALUE[movePromotion(m)];
+            moves.moves[i].score = score;
+        }
+    }
+
+    void scoreQuiets()
+    {
+        for (int i = 0; i < moves.size; i++)
+        {
+            Move m = moves.moves[i].move;
+            if (options.history)
+                moves.moves[i].score = history.get(pos.sideToMove, m);
+            else // Raster order, the way ChessBoard's probe loops visit squares
+                moves.moves[i].score = -(moveFrom(m) * 64 + moveTo(m));
+        }
+
+        // Insertion sort: lists are short and ties keep generation order
+        for (int i = 1; i < moves.size; i++)
+        {
+            ExtMove tmp = moves.moves[i];
+            int j = i - 1;
+            for (; j >= 0 && moves.moves[j].score < tmp.score; j--)
+                moves.moves[j + 1] = moves.moves[j];
+            moves.moves[j + 1] = tmp;
+        }
+    }
+
+    Move pickBest(int index) // Selection step: cheap when a cutoff comes after a few captures
+    {
+        int best = index;
+        for (int i = index + 1; i < moves.size; i++)
+            if (moves.moves[i].score > moves.moves[best].score)
+                best = i;
+        swap(moves.moves[index], moves.moves[best]);
+        return moves.moves[index].move;
+    }
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "position.h"
+
+using namespace std;
+
+struct PgnGame
+{
+    vector<pair<string, string>> tags; // In output order; Result is kept in sync with result
+    string startFen = Position::START_FEN;
+    vector<string> moves; // SAN
+    vector<string> annotations; // Optional, per move: NAGs and {comments} written after it
+    string result = "*";  // "1-0", "0-1", "1/2-1/2" or "*"
+
+    string tag(const string &name) const
+    {
+        for (auto &[key, value] : tags)
+            if (key == name)
+                return value;
+        return "";
+    }
+
+    void setTag(const string &name, const string &value)
+    {
+        for (auto &[key, existing] : tags)
+        {
+            if (key == name)
+            {
+                existing = value;
+                return;
+            }
+        }
+        tags.push_back({name, value});
+    }
+};
+
+inline string pgnTagValue(const string &value) // Quoted, with '"' and '\\' escaped as PGN requires
+{
+    string quoted = "\"";
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+inline void writePgn(ostream &out, const PgnGame &game)
+{
+    bool customStart = game.startFen != Position::START_FEN;
+    for (auto &[key, value] : game.tags)
+        if (key != "Result" && key != "FEN" && key != "SetUp")
+            out << "[" << key << " " << pgnTagValue(value) << "]\n";
+    out << "[Result " << pgnTagValue(game.result) << "]\n";
+    if (customStart)
+        out << "[SetUp \"1\"]\n[FEN " << pgnTagValue(game.startFen) << "]\n";
+    out << "\n";
+
+    Position start; // Only for the move numbers; an invalid FEN numbers them from the initial position
+    start.setFen(game.startFen);
+    int moveNumber = start.gamePly / 2 + 1;
+    bool whiteToMove = start.sideToMove == WHITE;
+    string line;
+    auto emit = [&](const string &token)
+    {
+        if (!line.empty() && line.size() + 1 + token.size() > 79)
+        {
+            out << line << "\n";
+            line.clear();
+        }
+        line += (line.empty() ? "" : " ") + token;
+    };
+
+    for (size_t i = 0; i < game.moves.size(); i++)
+    {
+        if (whiteToMove)
+            emit(to_string(moveNumber) + ".");
+        else if (i == 0 || (i - 1 < game.annotations.size() && !game.annotations[i - 1].empty()))
+            emit(to_string(moveNumber) + "..."); // Black's move after a comment gets its number again
+        emit(game.moves[i]);
+        if (i < game.annotations.size())
+        {
+            istringstream words(game.annotations[i]); // Split so long comments wrap like moves
+            string word;
+            while (words >> word)
+                emit(word);
+        }
+        if (!whiteToMove)
+            moveNumber++;
+        whiteToMove = !whiteToMove;
+    }
+    emit(game.result);
+    out << line << "\n\n";
+}
+
+// Reads the next game; comments, variations and NAGs are skipped. Returns false once no
+// game is left. Moves stay in SAN; Position::parseSan turns them into moves.
+inline bool readPgn(istream &in, PgnGame &game)
+{
+    game = PgnGame();
+    bool found = false;
+    int variationDepth = 0;
+    char c;
+    while (in.get(c))
+    {
+        if (c == '[' && variationDepth == 0)
+        {
+            string tagLine;
+            bool inString = false;
+            while (in.get(c) && c != '\n' && (c != ']' || inString)) // A ']' inside the value does not end the tag
+            {
+                tagLine += c;
+                if (c == '"')
+                    inString = !inString;
+                else if (c == '\\' && inString && in.get(c))
+                    tagLine += c; // An escaped quote does not end the value
+            }
+            size_t space = tagLine.find(' ');
+            size_t open = tagLine.find('"'), close = tagLine.rfind('"');
+            if (space == string::npos || open == string::npos || close <= open)
+                continue;
+            string key = tagLine.substr(0, space), value;
+            for (size_t i = open + 1; i < close; i++)
+            {
+                if (tagLine[i] == '\\' && i + 1 < close)
+                    i++; // Escaped quote or backslash
+                value += tagLine[i];
+            }
+            found = true;
+            if (key == "FEN")
+                game.startFen = value;
+            else if (key == "Result")
+                game.result = value;
+            else if (key != "SetUp")
+                game.setTag(key, value);
+            continue;
+        }
+        if (c == '{')
+        {
+            in.ignore(numeric_limits<streamsize>::max(), '}');
+            continue;
+        }
+        if (c == ';')
+        {
+            in.ignore(numeric_limits<streamsize>::max(), '\n');
+            continue;
+        }
+        if (c == '(' || c == ')')
+        {
+            variationDepth += c == '(' ? 1 : -1;
+            continue;
+        }
+        if (isspace((unsigned char)c))
+            continue;
+
+        string token(1, c);
+        while (in.peek() != EOF && !isspace(in.peek()) && string("{}();[").find(char(in.peek())) == string::npos)
+            token += char(in.get());
+        if (variationDepth > 0 || token[0] == '$')
+            continue;
+        found = true;
+        if (token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*")
+        {
+            game.result = token;
+            return true;
+        }
+        size_t moveStart = token.find_first_not_of("0123456789.");
+        if (moveStart == string::npos)
+            continue; // A bare move number such as "12." or "12..."
+        if (moveStart > 0 && token[moveStart - 1] != '.')
+            moveStart = 0; // Not a move number prefix, e.g. "0-0"
+        game.moves.push_back(token.substr(moveStart));
+    }
+    return found;
+}
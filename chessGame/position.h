@@ -0,0 +1,1280 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cctype>
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Squares use the same layout as ChessBoard: index = y * 8 + x with y = 0 being rank 8,
+// so a8 = 0, h8 = 7, a1 = 56, h1 = 63.
+typedef uint64_t Bitboard;
+typedef uint16_t Move; // bits 0-5 from, 6-11 to, 12-13 flag, 14-15 promotion (N, B, R, Q)
+
+const int WHITE = 0;
+const int BLACK = 1;
+const int NO_SQUARE = 64;
+
+enum PieceType
+{
+    PAWN,
+    KNIGHT,
+    BISHOP,
+    ROOK,
+    QUEEN,
+    KING,
+    NO_PIECE_TYPE
+};
+
+const int NO_PIECE = 12; // Pieces are encoded as color * 6 + type
+
+enum MoveFlag
+{
+    NORMAL_MOVE = 0,
+    PROMOTION = 1,
+    EN_PASSANT = 2,
+    CASTLING = 3
+};
+
+enum CastlingRight
+{
+    WHITE_OO = 1,
+    WHITE_OOO = 2,
+    BLACK_OO = 4,
+    BLACK_OOO = 8
+};
+
+const Move MOVE_NONE = 0;
+const Move MOVE_NULL = 65;
+
+const Bitboard FILE_A_BB = 0x0101010101010101ULL;
+const Bitboard FILE_H_BB = FILE_A_BB << 7;
+const Bitboard RANK_8_BB = 0xFFULL;       // y = 0
+const Bitboard RANK_1_BB = 0xFFULL << 56; // y = 7
+
+inline int pieceColor(int piece) { return piece / 6; }
+inline int pieceType(int piece) { return piece % 6; }
+constexpr int makePiece(int color, int type) { return color * 6 + type; }
+inline int squareX(int sq) { return sq & 7; }
+inline int squareY(int sq) { return sq >> 3; }
+inline Bitboard squareBB(int sq) { return 1ULL << sq; }
+
+inline Move encodeMove(int from, int to, int flag = NORMAL_MOVE, int promotion = KNIGHT)
+{
+    return Move(from | (to << 6) | (flag << 12) | ((promotion - KNIGHT) << 14));
+}
+inline int moveFrom(Move m) { return m & 63; }
+inline int moveTo(Move m) { return (m >> 6) & 63; }
+inline int moveFlag(Move m) { return (m >> 12) & 3; }
+inline int movePromotion(Move m) { return ((m >> 14) & 3) + KNIGHT; }
+
+inline int popCount(Bitboard b)
+{
+#ifdef _MSC_VER
+    return (int)__popcnt64(b);
+#else
+    return __builtin_popcountll(b);
+#endif
+}
+
+inline int lsb(Bitboard b) // Index of the least significant set bit (b must be non-zero)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, b);
+    return (int)index;
+#else
+    return __builtin_ctzll(b);
+#endif
+}
+
+inline int msb(Bitboard b) // Index of the most significant set bit (b must be non-zero)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, b);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(b);
+#endif
+}
+
+inline int popLsb(Bitboard &b)
+{
+    int sq = lsb(b);
+    b &= b - 1;
+    return sq;
+}
+
+inline string squareName(int sq) // Same notation as ChessBoard::toAlgebraic
+{
+    return string(1, char('a' + squareX(sq))) + to_string(8 - squareY(sq));
+}
+
+inline string moveToUci(Move m)
+{
+    if (m == MOVE_NONE)
+        return "0000";
+    string uci = squareName(moveFrom(m)) + squareName(moveTo(m));
+    if (moveFlag(m) == PROMOTION)
+        uci += "nbrq"[movePromotion(m) - KNIGHT];
+    return uci;
+}
+
+struct ExtMove // A move together with its ordering score
+{
+    Move move;
+    int score;
+};
+
+struct MoveList
+{
+    ExtMove moves[256];
+    int size = 0;
+
+    void add(Move m) { moves[size++] = {m, 0}; }
+    bool contains(Move m) const
+    {
+        for (int i = 0; i < size; i++)
+            if (moves[i].move == m)
+                return true;
+        return false;
+    }
+};
+
+// Precomputed attack tables and Zobrist keys, built once on first use
+struct AttackTables
+{
+    // Ray directions: N, S, E, W, NE, SW, NW, SE as (dx, dy) with y growing towards rank 1.
+    // Opposite directions differ only in the lowest bit (d ^ 1).
+    static constexpr int DX[8] = {0, 0, 1, -1, 1, -1, -1, 1};
+    static constexpr int DY[8] = {-1, 1, 0, 0, -1, 1, -1, 1};
+
+    Bitboard rays[8][64];
+    Bitboard knight[64];
+    Bitboard king[64];
+    Bitboard pawn[2][64];
+    Bitboard between[64][64]; // Squares strictly between two aligned squares
+    Bitboard line[64][64];    // Full line through two aligned squares
+
+    uint64_t pieceKeys[12][64];
+    uint64_t castlingKeys[16];
+    uint64_t epKeys[8];
+    uint64_t sideKey;
+
+    AttackTables()
+    {
+        for (int sq = 0; sq < 64; sq++)
+        {
+            int x = squareX(sq), y = squareY(sq);
+            for (int d = 0; d < 8; d++)
+            {
+                rays[d][sq] = 0;
+                for (int tx = x + DX[d], ty = y + DY[d]; onBoard(tx, ty); tx += DX[d], ty += DY[d])
+                    rays[d][sq] |= squareBB(ty * 8 + tx);
+            }
+
+            knight[sq] = king[sq] = pawn[WHITE][sq] = pawn[BLACK][sq] = 0;
+            const int knightSteps[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+            for (auto &step : knightSteps)
+                if (onBoard(x + step[0], y + step[1]))
+                    knight[sq] |= squareBB((y + step[1]) * 8 + x + step[0]);
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++)
+                    if ((dx || dy) && onBoard(x + dx, y + dy))
+                        king[sq] |= squareBB((y + dy) * 8 + x + dx);
+            for (int dx = -1; dx <= 1; dx += 2)
+            {
+                if (onBoard(x + dx, y - 1))
+                    pawn[WHITE][sq] |= squareBB((y - 1) * 8 + x + dx);
+                if (onBoard(x + dx, y + 1))
+                    pawn[BLACK][sq] |= squareBB((y + 1) * 8 + x + dx);
+            }
+        }
+
+        for (int a = 0; a < 64; a++)
+        {
+            for (int b = 0; b < 64; b++)
+            {
+                between[a][b] = line[a][b] = 0;
+                for (int d = 0; d < 8; d++)
+                {
+                    if (rays[d][a] & squareBB(b))
+                    {
+                        between[a][b] = rays[d][a] & ~rays[d][b] & ~squareBB(b);
+                        line[a][b] = rays[d][a] | rays[d ^ 1][a] | squareBB(a);
+                    }
+                }
+            }
+        }
+
+        uint64_t seed = 0x9E3779B97F4A7C15ULL; // Fixed seed so hashes are reproducible between runs
+        for (auto &keys : pieceKeys)
+            for (auto &key : keys)
+                key = nextRandom(seed);
+        for (auto &key : castlingKeys)
+            key = nextRandom(seed);
+        for (auto &key : epKeys)
+            key = nextRandom(seed);
+        sideKey = nextRandom(seed);
+    }
+
+    static bool onBoard(int x, int y) { return x >= 0 && x < 8 && y >= 0 && y < 8; }
+
+    static uint64_t nextRandom(uint64_t &state) // xorshift64*
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 2685821657736338717ULL;
+    }
+};
+
+inline const AttackTables &tables()
+{
+    static const AttackTables instance;
+    return instance;
+}
+
+// Sliding attacks along one ray, stopping at (and including) the first blocker
+inline Bitboard rayAttacks(int dir, int sq, Bitboard occupied)
+{
+    const AttackTables &t = tables();
+    Bitboard attacks = t.rays[dir][sq];
+    Bitboard blockers = attacks & occupied;
+    if (blockers)
+    {
+        // S, E, SW and SE grow the square index, so their nearest blocker is the lowest bit
+        bool increasing = (dir == 1 || dir == 2 || dir == 5 || dir == 7);
+        int blocker = increasing ? lsb(blockers) : msb(blockers);
+        attacks ^= t.rays[dir][blocker];
+    }
+    return attacks;
+}
+
+inline Bitboard rookAttacks(int sq, Bitboard occupied)
+{
+    return rayAttacks(0, sq, occupied) | rayAttacks(1, sq, occupied) | rayAttacks(2, sq, occupied) | rayAttacks(3, sq, occupied);
+}
+
+inline Bitboard bishopAttacks(int sq, Bitboard occupied)
+{
+    return rayAttacks(4, sq, occupied) | rayAttacks(5, sq, occupied) | rayAttacks(6, sq, occupied) | rayAttacks(7, sq, occupied);
+}
+
+// Kogge-Stone fill: floods every slider of one direction through the empty squares in
+// three doubling steps, however many sliders there are. shift > 0 moves towards higher
+// square indices; wrapMask drops the squares a step cannot reach without leaving the board.
+inline Bitboard koggeStoneAttacks(Bitboard sliders, Bitboard empty, int shift, Bitboard wrapMask)
+{
+    auto step = [shift](Bitboard b, int times)
+    { return shift > 0 ? b << (shift * times) : b >> (-shift * times); };
+    Bitboard propagate = empty & wrapMask;
+    sliders |= propagate & step(sliders, 1);
+    propagate &= step(propagate, 1);
+    sliders |= propagate & step(sliders, 2);
+    propagate &= step(propagate, 2);
+    sliders |= propagate & step(sliders, 4);
+    return step(sliders, 1) & wrapMask;
+}
+
+// Union of the attacks of all straight (rook, queen) and diagonal (bishop, queen) sliders.
+// With AVX2 each half of the eight directions is one vector, one direction per lane.
+inline Bitboard slidingAttacks(Bitboard straight, Bitboard diagonal, Bitboard occupied)
+{
+    Bitboard empty = ~occupied;
+#ifdef __AVX2__
+    const __m256i shifts = _mm256_setr_epi64x(1, 8, 9, 7);
+    const __m256i upMasks = _mm256_setr_epi64x(~FILE_A_BB, ~0ULL, ~FILE_A_BB, ~FILE_H_BB);   // +1, +8, +9, +7
+    const __m256i downMasks = _mm256_setr_epi64x(~FILE_H_BB, ~0ULL, ~FILE_H_BB, ~FILE_A_BB); // -1, -8, -9, -7
+    const __m256i sliders = _mm256_setr_epi64x(straight, straight, diagonal, diagonal);
+    const __m256i emptySquares = _mm256_set1_epi64x(empty);
+
+    __m256i up = sliders, down = sliders;
+    __m256i upPropagate = _mm256_and_si256(emptySquares, upMasks);
+    __m256i downPropagate = _mm256_and_si256(emptySquares, downMasks);
+    __m256i distance = shifts;
+    for (int i = 0; i < 3; i++)
+    {
+        up = _mm256_or_si256(up, _mm256_and_si256(upPropagate, _mm256_sllv_epi64(up, distance)));
+        down = _mm256_or_si256(down, _mm256_and_si256(downPropagate, _mm256_srlv_epi64(down, distance)));
+        upPropagate = _mm256_and_si256(upPropagate, _mm256_sllv_epi64(upPropagate, distance));
+        downPropagate = _mm256_and_si256(downPropagate, _mm256_srlv_epi64(downPropagate, distance));
+        distance = _mm256_add_epi64(distance, distance);
+    }
+    __m256i attacks = _mm256_or_si256(_mm256_and_si256(_mm256_sllv_epi64(up, shifts), upMasks),
+                                      _mm256_and_si256(_mm256_srlv_epi64(down, shifts), downMasks));
+    __m128i lanes = _mm_or_si128(_mm256_castsi256_si128(attacks), _mm256_extracti128_si256(attacks, 1));
+    return Bitboard(_mm_cvtsi128_si64(lanes)) | Bitboard(_mm_extract_epi64(lanes, 1));
+#else
+    return koggeStoneAttacks(straight, empty, 1, ~FILE_A_BB) | koggeStoneAttacks(straight, empty, -1, ~FILE_H_BB) |
+           koggeStoneAttacks(straight, empty, 8, ~0ULL) | koggeStoneAttacks(straight, empty, -8, ~0ULL) |
+           koggeStoneAttacks(diagonal, empty, 9, ~FILE_A_BB) | koggeStoneAttacks(diagonal, empty, 7, ~FILE_H_BB) |
+           koggeStoneAttacks(diagonal, empty, -7, ~FILE_A_BB) | koggeStoneAttacks(diagonal, empty, -9, ~FILE_H_BB);
+#endif
+}
+
+// Every square one side attacks, from its piece sets: one batched fill for the sliders
+// instead of a lookup per piece
+inline Bitboard attackedSquares(int color, Bitboard pawns, Bitboard knights, Bitboard diagonal, Bitboard straight,
+                                Bitboard kings, Bitboard occupied)
+{
+    const AttackTables &t = tables();
+    Bitboard attacks = color == WHITE ? ((pawns >> 9) & ~FILE_H_BB) | ((pawns >> 7) & ~FILE_A_BB)
+                                      : ((pawns << 7) & ~FILE_H_BB) | ((pawns << 9) & ~FILE_A_BB);
+    while (knights)
+        attacks |= t.knight[popLsb(knights)];
+    while (kings)
+        attacks |= t.king[popLsb(kings)];
+    return attacks | slidingAttacks(straight, diagonal, occupied);
+}
+
+inline Bitboard pieceAttacks(int type, int sq, Bitboard occupied)
+{
+    switch (type)
+    {
+    case KNIGHT:
+        return tables().knight[sq];
+    case BISHOP:
+        return bishopAttacks(sq, occupied);
+    case ROOK:
+        return rookAttacks(sq, occupied);
+    case QUEEN:
+        return bishopAttacks(sq, occupied) | rookAttacks(sq, occupied);
+    case KING:
+        return tables().king[sq];
+    default:
+        return 0;
+    }
+}
+
+// What differs between the two sides, as compile-time constants for the generator and
+// make/unmake, which are instantiated once per color
+template <int Us>
+struct ColorTraits
+{
+    static constexpr int THEM = Us ^ 1;
+    static constexpr int FORWARD = Us == WHITE ? -8 : 8; // One step towards the promotion rank
+    static constexpr int START_Y = Us == WHITE ? 6 : 1;  // Rank the pawns start on and may double step from
+    static constexpr Bitboard PROMOTION_RANK = Us == WHITE ? RANK_8_BB : RANK_1_BB;
+    static constexpr int KING_FROM = Us == WHITE ? 60 : 4;
+    static constexpr int SHORT_RIGHT = Us == WHITE ? WHITE_OO : BLACK_OO;
+    static constexpr int LONG_RIGHT = Us == WHITE ? WHITE_OOO : BLACK_OOO;
+};
+
+struct UndoInfo // Everything makeMove destroys, so unmakeMove can restore it
+{
+    Move move;
+    uint8_t captured;
+    uint8_t castlingRights;
+    uint8_t epSquare;
+    uint8_t rule50;
+    uint64_t key;
+};
+
+class Position // Bitboard position used by the engine; mirrors the rules of ChessBoard
+{
+public:
+    Bitboard byType[6];
+    Bitboard byColor[2];
+    uint8_t board[64];
+    int sideToMove = WHITE;
+    int castlingRights = 0;
+    int epSquare = NO_SQUARE;
+    int rule50 = 0;
+    int gamePly = 0;
+    uint64_t key = 0;
+    vector<UndoInfo> history; // One entry per made move, also used for repetition detection
+
+    static constexpr const char *START_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+    Position()
+    {
+        parseFen(START_FEN);
+    }
+
+    bool setFen(const string &fen) // False for a malformed or impossible FEN, which leaves the position as it was
+    {
+        Position previous = *this;
+        if (parseFen(fen))
+            return true;
+        *this = previous;
+        return false;
+    }
+
+    string fen() const
+    {
+        string result;
+        for (int y = 0; y < 8; y++)
+        {
+            int empty = 0;
+            for (int x = 0; x < 8; x++)
+            {
+                int piece = board[y * 8 + x];
+                if (piece == NO_PIECE)
+                {
+                    empty++;
+                    continue;
+                }
+                if (empty)
+                    result += char('0' + empty);
+                empty = 0;
+                char c = "PNBRQK"[pieceType(piece)];
+                result += pieceColor(piece) == WHITE ? c : char(tolower(c));
+            }
+            if (empty)
+                result += char('0' + empty);
+            if (y < 7)
+                result += '/';
+        }
+        result += sideToMove == WHITE ? " w " : " b ";
+        string castling;
+        if (castlingRights & WHITE_OO)
+            castling += 'K';
+        if (castlingRights & WHITE_OOO)
+            castling += 'Q';
+        if (castlingRights & BLACK_OO)
+            castling += 'k';
+        if (castlingRights & BLACK_OOO)
+            castling += 'q';
+        result += castling.empty() ? "-" : castling;
+        result += " " + (epSquare == NO_SQUARE ? string("-") : squareName(epSquare));
+        result += " " + to_string(rule50) + " " + to_string(gamePly / 2 + 1);
+        return result;
+    }
+
+    Bitboard occupied() const { return byColor[WHITE] | byColor[BLACK]; }
+    Bitboard pieces(int color) const { return byColor[color]; }
+    Bitboard pieces(int color, int type) const { return byColor[color] & byType[type]; }
+    int pieceOn(int sq) const { return board[sq]; }
+    int kingSquare(int color) const { return lsb(pieces(color, KING)); }
+
+    bool isCapture(Move m) const
+    {
+        return (board[moveTo(m)] != NO_PIECE && moveFlag(m) != CASTLING) || moveFlag(m) == EN_PASSANT;
+    }
+
+    bool isCaptureOrPromotion(Move m) const
+    {
+        return isCapture(m) || moveFlag(m) == PROMOTION;
+    }
+
+    Bitboard attackersTo(int sq, Bitboard occ) const // Pieces of both colors attacking sq
+    {
+        const AttackTables &t = tables();
+        return (t.pawn[BLACK][sq] & pieces(WHITE, PAWN)) | (t.pawn[WHITE][sq] & pieces(BLACK, PAWN)) |
+               (t.knight[sq] & byType[KNIGHT]) | (t.king[sq] & byType[KING]) |
+               (bishopAttacks(sq, occ) & (byType[BISHOP] | byType[QUEEN])) |
+               (rookAttacks(sq, occ) & (byType[ROOK] | byType[QUEEN]));
+    }
+
+    bool isSquareAttacked(int sq, int byColorSide) const
+    {
+        return byColorSide == WHITE ? isAttackedBy<WHITE>(sq, occupied()) : isAttackedBy<BLACK>(sq, occupied());
+    }
+
+    template <int Them>
+    bool isAttackedBy(int sq, Bitboard occ) const // Stops at the first kind of attacker found
+    {
+        const AttackTables &t = tables();
+        return (t.pawn[Them ^ 1][sq] & pieces(Them, PAWN)) || (t.knight[sq] & pieces(Them, KNIGHT)) ||
+               (t.king[sq] & pieces(Them, KING)) ||
+               (bishopAttacks(sq, occ) & (pieces(Them, BISHOP) | pieces(Them, QUEEN))) ||
+               (rookAttacks(sq, occ) & (pieces(Them, ROOK) | pieces(Them, QUEEN)));
+    }
+
+    Bitboard attackMap(int color, Bitboard occ) const // Squares color attacks with the given occupancy
+    {
+        Bitboard queens = pieces(color, QUEEN);
+        return attackedSquares(color, pieces(color, PAWN), pieces(color, KNIGHT), pieces(color, BISHOP) | queens,
+                               pieces(color, ROOK) | queens, pieces(color, KING), occ);
+    }
+
+    Bitboard checkers() const
+    {
+        return attackersTo(kingSquare(sideToMove), occupied()) & byColor[sideToMove ^ 1];
+    }
+
+    bool inCheck() const
+    {
+        return checkers() != 0;
+    }
+
+    Bitboard pinnedPieces(int color) const // Pieces of color that shield their king from a slider
+    {
+        int ksq = kingSquare(color);
+        Bitboard pinned = 0;
+        Bitboard snipers = (rookAttacks(ksq, 0) & (pieces(color ^ 1, ROOK) | pieces(color ^ 1, QUEEN))) |
+                           (bishopAttacks(ksq, 0) & (pieces(color ^ 1, BISHOP) | pieces(color ^ 1, QUEEN)));
+        while (snipers)
+        {
+            int sniper = popLsb(snipers);
+            Bitboard blockers = tables().between[ksq][sniper] & occupied();
+            if (blockers && !(blockers & (blockers - 1)))
+                pinned |= blockers & byColor[color];
+        }
+        return pinned;
+    }
+
+    // Pseudo-legal generation, split so the move picker can generate lazily
+    void generateCaptures(MoveList &list) const // Captures, en passant and queen promotions
+    {
+        sideToMove == WHITE ? generateCaptures<WHITE>(list) : generateCaptures<BLACK>(list);
+    }
+
+    void generateQuiets(MoveList &list) const // Non-captures, under-promotions and castling
+    {
+        sideToMove == WHITE ? generateQuiets<WHITE>(list) : generateQuiets<BLACK>(list);
+    }
+
+    void generatePseudoLegal(MoveList &list) const
+    {
+        generateCaptures(list);
+        generateQuiets(list);
+    }
+
+    void generateLegal(MoveList &list) const
+    {
+        sideToMove == WHITE ? generateLegal<WHITE>(list) : generateLegal<BLACK>(list);
+    }
+
+    bool isLegal(Move m) const
+    {
+        return isLegal(m, pinnedPieces(sideToMove));
+    }
+
+    bool isLegal(Move m, Bitboard pinned) const // Tests a pseudo-legal move for leaving the king in check
+    {
+        return sideToMove == WHITE ? isLegal<WHITE>(m, pinned, checkers()) : isLegal<BLACK>(m, pinned, checkers());
+    }
+
+    template <int Us>
+    void generateCaptures(MoveList &list) const
+    {
+        typedef ColorTraits<Us> C;
+        Bitboard targets = byColor[C::THEM];
+        Bitboard occ = occupied();
+        const AttackTables &t = tables();
+
+        Bitboard pawns = pieces(Us, PAWN);
+        while (pawns)
+        {
+            int from = popLsb(pawns);
+            Bitboard attacks = t.pawn[Us][from] & targets;
+            while (attacks)
+            {
+                int to = popLsb(attacks);
+                if (squareBB(to) & C::PROMOTION_RANK)
+                    addPromotions(list, from, to, true);
+                else
+                    list.add(encodeMove(from, to));
+            }
+            int push = from + C::FORWARD;
+            if ((squareBB(push) & C::PROMOTION_RANK) && board[push] == NO_PIECE)
+                addPromotions(list, from, push, true);
+            if (epSquare != NO_SQUARE && (t.pawn[Us][from] & squareBB(epSquare)))
+                list.add(encodeMove(from, epSquare, EN_PASSANT));
+        }
+
+        for (int type = KNIGHT; type <= KING; type++)
+        {
+            Bitboard pieceSet = pieces(Us, type);
+            while (pieceSet)
+            {
+                int from = popLsb(pieceSet);
+                Bitboard attacks = pieceAttacks(type, from, occ) & targets;
+                while (attacks)
+                    list.add(encodeMove(from, popLsb(attacks)));
+            }
+        }
+    }
+
+    template <int Us>
+    void generateQuiets(MoveList &list) const
+    {
+        typedef ColorTraits<Us> C;
+        Bitboard occ = occupied();
+        Bitboard empty = ~occ;
+        const AttackTables &t = tables();
+
+        Bitboard pawns = pieces(Us, PAWN);
+        while (pawns)
+        {
+            int from = popLsb(pawns);
+            Bitboard attacks = t.pawn[Us][from] & byColor[C::THEM];
+            while (attacks)
+            {
+                int to = popLsb(attacks);
+                if (squareBB(to) & C::PROMOTION_RANK)
+                    addPromotions(list, from, to, false);
+            }
+            int push = from + C::FORWARD;
+            if (board[push] != NO_PIECE)
+                continue;
+            if (squareBB(push) & C::PROMOTION_RANK)
+            {
+                addPromotions(list, from, push, false);
+                continue;
+            }
+            list.add(encodeMove(from, push));
+            if (squareY(from) == C::START_Y && board[push + C::FORWARD] == NO_PIECE)
+                list.add(encodeMove(from, push + C::FORWARD));
+        }
+
+        for (int type = KNIGHT; type <= KING; type++)
+        {
+            Bitboard pieceSet = pieces(Us, type);
+            while (pieceSet)
+            {
+                int from = popLsb(pieceSet);
+                Bitboard attacks = pieceAttacks(type, from, occ) & empty;
+                while (attacks)
+                    list.add(encodeMove(from, popLsb(attacks)));
+            }
+        }
+
+        generateCastling<Us>(list);
+    }
+
+    template <int Us>
+    void generateLegal(MoveList &list) const
+    {
+        MoveList pseudo;
+        generateCaptures<Us>(pseudo);
+        generateQuiets<Us>(pseudo);
+        int ksq = kingSquare(Us);
+        Bitboard pinned = pinnedPieces(Us);
+        Bitboard checkerSet = attackersTo(ksq, occupied()) & byColor[Us ^ 1]; // Once for all moves
+        Bitboard kingDanger = attackMap(Us ^ 1, occupied() ^ squareBB(ksq)); // The king does not shield the squares behind it
+        for (int i = 0; i < pseudo.size; i++)
+        {
+            Move m = pseudo.moves[i].move;
+            if (moveFrom(m) == ksq && moveFlag(m) != CASTLING ? !(kingDanger & squareBB(moveTo(m)))
+                                                               : isLegal<Us>(m, pinned, checkerSet))
+                list.add(m);
+        }
+    }
+
+    template <int Us>
+    bool isLegal(Move m, Bitboard pinned, Bitboard checkerSet) const
+    {
+        typedef ColorTraits<Us> C;
+        int from = moveFrom(m), to = moveTo(m);
+        int ksq = kingSquare(Us);
+
+        if (moveFlag(m) == EN_PASSANT)
+        {
+            int capturedSq = to - C::FORWARD;
+            Bitboard occ = (occupied() ^ squareBB(from) ^ squareBB(capturedSq)) | squareBB(to);
+            return !(attackersTo(ksq, occ) & byColor[C::THEM] & ~squareBB(capturedSq));
+        }
+
+        if (moveFlag(m) == CASTLING) // Path safety was checked by the generator
+            return true;
+
+        if (from == ksq)
+            return !isAttackedBy<C::THEM>(to, occupied() ^ squareBB(from));
+
+        if (checkerSet)
+        {
+            if (checkerSet & (checkerSet - 1)) // Double check: only king moves help
+                return false;
+            int checker = lsb(checkerSet);
+            if (!((tables().between[ksq][checker] | checkerSet) & squareBB(to)))
+                return false;
+        }
+
+        return !(pinned & squareBB(from)) || (tables().line[ksq][from] & squareBB(to));
+    }
+
+    bool isPseudoLegal(Move m) const // Validates moves from the TT or killer slots against this position
+    {
+        if (m == MOVE_NONE || m == MOVE_NULL)
+            return false;
+        int us = sideToMove;
+        int from = moveFrom(m), to = moveTo(m);
+        int piece = board[from];
+        if (piece == NO_PIECE || pieceColor(piece) != us)
+            return false;
+
+        if (moveFlag(m) == CASTLING || moveFlag(m) == EN_PASSANT || moveFlag(m) == PROMOTION)
+        {
+            MoveList list; // Rare special moves: defer to the generator
+            generatePseudoLegal(list);
+            return list.contains(m);
+        }
+
+        if (board[to] != NO_PIECE && pieceColor(board[to]) == us)
+            return false;
+
+        if (pieceType(piece) == PAWN)
+        {
+            Bitboard promotionRank = us == WHITE ? RANK_8_BB : RANK_1_BB;
+            if (squareBB(to) & promotionRank)
+                return false; // Must be encoded as a promotion
+            int forward = us == WHITE ? -8 : 8;
+            if (tables().pawn[us][from] & squareBB(to))
+                return board[to] != NO_PIECE;
+            if (to == from + forward)
+                return board[to] == NO_PIECE;
+            int startY = us == WHITE ? 6 : 1;
+            return to == from + 2 * forward && squareY(from) == startY &&
+                   board[to] == NO_PIECE && board[from + forward] == NO_PIECE;
+        }
+
+        return pieceAttacks(pieceType(piece), from, occupied()) & squareBB(to);
+    }
+
+    void makeMove(Move m)
+    {
+        sideToMove == WHITE ? makeMove<WHITE>(m) : makeMove<BLACK>(m);
+    }
+
+    void unmakeMove()
+    {
+        sideToMove == BLACK ? unmakeMove<WHITE>() : unmakeMove<BLACK>(); // Undoes a move of the side not to move
+    }
+
+    template <int Us>
+    void makeMove(Move m)
+    {
+        typedef ColorTraits<Us> C;
+        const AttackTables &t = tables();
+        int from = moveFrom(m), to = moveTo(m), flag = moveFlag(m);
+        int piece = board[from];
+        int captured = flag == EN_PASSANT ? makePiece(C::THEM, PAWN) : (flag == CASTLING ? NO_PIECE : board[to]);
+
+        history.push_back({m, uint8_t(captured), uint8_t(castlingRights), uint8_t(epSquare), uint8_t(min(rule50, 255)), key});
+
+        if (epSquare != NO_SQUARE)
+            key ^= t.epKeys[squareX(epSquare)];
+        epSquare = NO_SQUARE;
+        rule50++;
+        gamePly++;
+
+        if (captured != NO_PIECE)
+        {
+            int capturedSq = flag == EN_PASSANT ? to - C::FORWARD : to;
+            removePiece(capturedSq);
+            key ^= t.pieceKeys[captured][capturedSq];
+            rule50 = 0;
+        }
+
+        movePieceTo(from, to);
+        key ^= t.pieceKeys[piece][from] ^ t.pieceKeys[piece][to];
+
+        if (flag == CASTLING)
+        {
+            int rookFrom = to > from ? to + 1 : to - 2;
+            int rookTo = to > from ? to - 1 : to + 1;
+            constexpr int rook = makePiece(Us, ROOK);
+            movePieceTo(rookFrom, rookTo);
+            key ^= t.pieceKeys[rook][rookFrom] ^ t.pieceKeys[rook][rookTo];
+        }
+
+        if (piece == makePiece(Us, PAWN))
+        {
+            rule50 = 0;
+            if ((to ^ from) == 16 && (t.pawn[Us][to - C::FORWARD] & pieces(C::THEM, PAWN)))
+            {
+                epSquare = (from + to) / 2;
+                key ^= t.epKeys[squareX(epSquare)];
+            }
+            else if (flag == PROMOTION)
+            {
+                int promoted = makePiece(Us, movePromotion(m));
+                removePiece(to);
+                putPiece(promoted, to);
+                key ^= t.pieceKeys[piece][to] ^ t.pieceKeys[promoted][to];
+            }
+        }
+
+        int newRights = castlingRights & castlingMask(from) & castlingMask(to);
+        if (newRights != castlingRights)
+        {
+            key ^= t.castlingKeys[castlingRights] ^ t.castlingKeys[newRights];
+            castlingRights = newRights;
+        }
+
+        sideToMove = C::THEM;
+        key ^= t.sideKey;
+    }
+
+    template <int Us>
+    void unmakeMove()
+    {
+        typedef ColorTraits<Us> C;
+        const UndoInfo undo = history.back();
+        history.pop_back();
+        Move m = undo.move;
+        int from = moveFrom(m), to = moveTo(m), flag = moveFlag(m);
+
+        sideToMove = Us;
+        gamePly--;
+
+        if (flag == PROMOTION)
+        {
+            removePiece(to);
+            putPiece(makePiece(Us, PAWN), to);
+        }
+
+        movePieceTo(to, from);
+
+        if (flag == CASTLING)
+        {
+            int rookFrom = to > from ? to + 1 : to - 2;
+            int rookTo = to > from ? to - 1 : to + 1;
+            movePieceTo(rookTo, rookFrom);
+        }
+
+        if (undo.captured != NO_PIECE)
+            putPiece(undo.captured, flag == EN_PASSANT ? to - C::FORWARD : to);
+
+        castlingRights = undo.castlingRights;
+        epSquare = undo.epSquare;
+        rule50 = undo.rule50;
+        key = undo.key;
+    }
+
+    void makeNullMove()
+    {
+        history.push_back({MOVE_NULL, NO_PIECE, uint8_t(castlingRights), uint8_t(epSquare), uint8_t(min(rule50, 255)), key});
+        if (epSquare != NO_SQUARE)
+            key ^= tables().epKeys[squareX(epSquare)];
+        epSquare = NO_SQUARE;
+        rule50++;
+        gamePly++;
+        sideToMove ^= 1;
+        key ^= tables().sideKey;
+    }
+
+    void unmakeNullMove()
+    {
+        const UndoInfo undo = history.back();
+        history.pop_back();
+        sideToMove ^= 1;
+        gamePly--;
+        epSquare = undo.epSquare;
+        rule50 = undo.rule50;
+        key = undo.key;
+    }
+
+    bool isRepetition() const // The current position occurred before since the last irreversible move
+    {
+        int limit = min(rule50, (int)history.size());
+        for (int i = 4; i <= limit; i += 2)
+            if (history[history.size() - i].key == key)
+                return true;
+        return false;
+    }
+
+    bool isDraw() const
+    {
+        return rule50 >= 100 || isRepetition() || hasInsufficientMaterial();
+    }
+
+    bool hasInsufficientMaterial() const
+    {
+        if (byType[PAWN] | byType[ROOK] | byType[QUEEN])
+            return false;
+        return popCount(occupied()) <= 3; // K v K, K+minor v K
+    }
+
+    // Static exchange evaluation: material balance for the side to move after the best
+    // sequence of recaptures on the destination square, cheapest attacker first.
+    int see(Move m) const
+    {
+        static const int SEE_VALUE[6] = {100, 320, 330, 500, 900, 20000};
+        if (moveFlag(m) == CASTLING)
+            return 0;
+
+        int from = moveFrom(m), to = moveTo(m);
+        int us = sideToMove;
+        int gain[32];
+        int depth = 0;
+        int attackerType = pieceType(board[from]);
+        Bitboard occ = occupied();
+
+        if (moveFlag(m) == EN_PASSANT)
+        {
+            gain[0] = SEE_VALUE[PAWN];
+            occ ^= squareBB(to + (us == WHITE ? 8 : -8));
+        }
+        else
+            gain[0] = board[to] == NO_PIECE ? 0 : SEE_VALUE[pieceType(board[to])];
+
+        if (moveFlag(m) == PROMOTION)
+        {
+            gain[0] += SEE_VALUE[movePromotion(m)] - SEE_VALUE[PAWN];
+            attackerType = movePromotion(m);
+        }
+
+        Bitboard fromSet = squareBB(from);
+        Bitboard attackers = attackersTo(to, occ);
+        Bitboard diagonalSliders = byType[BISHOP] | byType[QUEEN];
+        Bitboard straightSliders = byType[ROOK] | byType[QUEEN];
+        int side = us;
+
+        do
+        {
+            depth++;
+            gain[depth] = SEE_VALUE[attackerType] - gain[depth - 1]; // Speculative: if the piece gets recaptured
+            if (max(-gain[depth - 1], gain[depth]) < 0)
+                break; // Neither side can improve by continuing
+
+            occ ^= fromSet;
+            attackers &= occ;
+            // Removing a piece may uncover a slider behind it
+            attackers |= (bishopAttacks(to, occ) & diagonalSliders & occ) | (rookAttacks(to, occ) & straightSliders & occ);
+
+            side ^= 1;
+            fromSet = 0;
+            Bitboard sideAttackers = attackers & byColor[side];
+            for (int type = PAWN; type <= KING && sideAttackers; type++)
+            {
+                Bitboard candidates = sideAttackers & byType[type];
+                if (candidates)
+                {
+                    if (type == KING && (attackers & byColor[side ^ 1]))
+                        break; // The king cannot recapture into a defended square
+                    fromSet = squareBB(lsb(candidates));
+                    attackerType = type;
+                    break;
+                }
+            }
+        } while (fromSet && depth < 31);
+
+        while (--depth)
+            gain[depth - 1] = -max(-gain[depth - 1], gain[depth]);
+        return gain[0];
+    }
+
+    Move parseUci(const string &uci) const // Finds the legal move matching e.g. "e2e4" or "e7e8q"
+    {
+        MoveList list;
+        generateLegal(list);
+        for (int i = 0; i < list.size; i++)
+            if (moveToUci(list.moves[i].move) == uci)
+                return list.moves[i].move;
+        return MOVE_NONE;
+    }
+
+    int repetitionCount() const // How often the current position occurred before (threefold = 2)
+    {
+        int count = 0;
+        int limit = min(rule50, (int)history.size());
+        for (int i = 4; i <= limit; i += 2)
+            if (history[history.size() - i].key == key)
+                count++;
+        return count;
+    }
+
+    string moveToSan(Move m) // Standard algebraic notation for a legal move, e.g. "Nbd7", "exd5", "e8=Q+"
+    {
+        int from = moveFrom(m), to = moveTo(m);
+        int type = pieceType(board[from]);
+        string san;
+
+        if (moveFlag(m) == CASTLING)
+            san = to > from ? "O-O" : "O-O-O";
+        else
+        {
+            if (type == PAWN)
+            {
+                if (isCapture(m))
+                    san = string(1, char('a' + squareX(from))) + "x";
+            }
+            else
+            {
+                san = string(1, "PNBRQK"[type]);
+                // Disambiguate against other pieces of the same type that can reach the square
+                MoveList list;
+                generateLegal(list);
+                bool ambiguous = false, sameFile = false, sameRank = false;
+                for (int i = 0; i < list.size; i++)
+                {
+                    Move other = list.moves[i].move;
+                    int otherFrom = moveFrom(other);
+                    if (other == m || moveTo(other) != to || otherFrom == from || pieceType(board[otherFrom]) != type)
+                        continue;
+                    ambiguous = true;
+                    sameFile |= squareX(otherFrom) == squareX(from);
+                    sameRank |= squareY(otherFrom) == squareY(from);
+                }
+                if (ambiguous)
+                {
+                    if (!sameFile)
+                        san += char('a' + squareX(from));
+                    else if (!sameRank)
+                        san += char('0' + 8 - squareY(from));
+                    else
+                        san += squareName(from);
+                }
+                if (isCapture(m))
+                    san += "x";
+            }
+            san += squareName(to);
+            if (moveFlag(m) == PROMOTION)
+                san += string("=") + "PNBRQK"[movePromotion(m)];
+        }
+
+        makeMove(m);
+        if (inCheck())
+        {
+            MoveList replies;
+            generateLegal(replies);
+            san += replies.size ? "+" : "#";
+        }
+        unmakeMove();
+        return san;
+    }
+
+    Move parseSan(string san) const // Finds the legal move for e.g. "Nbd7", "exd5", "e8=Q+", "O-O"; MOVE_NONE if none
+    {
+        while (!san.empty() && string("+#!?").find(san.back()) != string::npos)
+            san.pop_back();
+
+        MoveList list;
+        generateLegal(list);
+        if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0")
+        {
+            for (int i = 0; i < list.size; i++)
+            {
+                Move m = list.moves[i].move;
+                if (moveFlag(m) == CASTLING && (moveTo(m) > moveFrom(m)) == (san.size() == 3))
+                    return m;
+            }
+            return MOVE_NONE;
+        }
+
+        int promotion = NO_PIECE_TYPE;
+        size_t promotionAt = san.find_last_of("NBRQ");
+        if (promotionAt != string::npos && promotionAt > 0 && promotionAt + 1 == san.size())
+        {
+            promotion = string("PNBRQK").find(san[promotionAt]);
+            san.erase(san[promotionAt - 1] == '=' ? promotionAt - 1 : promotionAt);
+        }
+        if (san.size() < 2)
+            return MOVE_NONE;
+
+        int type = PAWN;
+        size_t start = 0;
+        if (string("NBRQK").find(san[0]) != string::npos)
+        {
+            type = string("PNBRQK").find(san[0]);
+            start = 1;
+        }
+        string square = san.substr(san.size() - 2);
+        if (square[0] < 'a' || square[0] > 'h' || square[1] < '1' || square[1] > '8')
+            return MOVE_NONE;
+        int to = ('8' - square[1]) * 8 + (square[0] - 'a');
+        int fromFile = -1, fromRank = -1; // Disambiguation, as board x and y
+        for (size_t i = start; i + 2 < san.size(); i++)
+        {
+            if (san[i] >= 'a' && san[i] <= 'h')
+                fromFile = san[i] - 'a';
+            else if (san[i] >= '1' && san[i] <= '8')
+                fromRank = '8' - san[i];
+        }
+
+        Move found = MOVE_NONE;
+        for (int i = 0; i < list.size; i++)
+        {
+            Move m = list.moves[i].move;
+            int from = moveFrom(m);
+            if (moveTo(m) != to || pieceType(board[from]) != type || moveFlag(m) == CASTLING ||
+                (fromFile >= 0 && squareX(from) != fromFile) || (fromRank >= 0 && squareY(from) != fromRank) ||
+                (moveFlag(m) == PROMOTION ? movePromotion(m) != promotion : promotion != NO_PIECE_TYPE))
+                continue;
+            if (found != MOVE_NONE)
+                return MOVE_NONE; // Ambiguous
+            found = m;
+        }
+        return found;
+    }
+
+    uint64_t computeKey() const
+    {
+        const AttackTables &t = tables();
+        uint64_t k = 0;
+        for (int sq = 0; sq < 64; sq++)
+            if (board[sq] != NO_PIECE)
+                k ^= t.pieceKeys[board[sq]][sq];
+        k ^= t.castlingKeys[castlingRights];
+        if (epSquare != NO_SQUARE)
+            k ^= t.epKeys[squareX(epSquare)];
+        if (sideToMove == BLACK)
+            k ^= t.sideKey;
+        return k;
+    }
+
+private:
+    bool parseFen(const string &fen)
+    {
+        for (auto &bb : byType)
+            bb = 0;
+        byColor[WHITE] = byColor[BLACK] = 0;
+        for (auto &piece : board)
+            piece = NO_PIECE;
+        history.clear();
+
+        istringstream stream(fen);
+        string placement, side, castling, ep;
+        stream >> placement >> side >> castling >> ep;
+        if (!(stream >> rule50))
+            rule50 = 0;
+        int moveNumber = 1;
+        if (!(stream >> moveNumber))
+            moveNumber = 1;
+
+        int x = 0, y = 0;
+        for (char c : placement)
+        {
+            if (c == '/')
+            {
+                if (x != 8)
+                    return false;
+                x = 0;
+                y++;
+            }
+            else if (isdigit((unsigned char)c))
+                x += c - '0';
+            else
+            {
+                size_t index = string("PNBRQK").find(toupper(c));
+                if (index == string::npos || x > 7 || y > 7 || (index == PAWN && (y == 0 || y == 7)))
+                    return false;
+                putPiece(makePiece(isupper(c) ? WHITE : BLACK, int(index)), y * 8 + x);
+                x++;
+            }
+        }
+
+        if (x != 8 || y != 7)
+            return false;
+
+        sideToMove = side == "b" ? BLACK : WHITE;
+        castlingRights = 0;
+        for (char c : castling)
+        {
+            if (c == 'K')
+                castlingRights |= WHITE_OO;
+            else if (c == 'Q')
+                castlingRights |= WHITE_OOO;
+            else if (c == 'k')
+                castlingRights |= BLACK_OO;
+            else if (c == 'q')
+                castlingRights |= BLACK_OOO;
+        }
+        epSquare = NO_SQUARE;
+        if (ep.size() == 2 && ep[0] >= 'a' && ep[0] <= 'h' && ep[1] >= '1' && ep[1] <= '8')
+            epSquare = ('8' - ep[1]) * 8 + (ep[0] - 'a');
+        gamePly = 2 * (max(moveNumber, 1) - 1) + (sideToMove == BLACK);
+        key = computeKey();
+        return pieces(WHITE, KING) && pieces(BLACK, KING);
+    }
+
+    void putPiece(int piece, int sq)
+    {
+        board[sq] = uint8_t(piece);
+        byType[pieceType(piece)] |= squareBB(sq);
+        byColor[pieceColor(piece)] |= squareBB(sq);
+    }
+
+    void removePiece(int sq)
+    {
+        int piece = board[sq];
+        byType[pieceType(piece)] ^= squareBB(sq);
+        byColor[pieceColor(piece)] ^= squareBB(sq);
+        board[sq] = NO_PIECE;
+    }
+
+    void movePieceTo(int from, int to)
+    {
+        int piece = board[from];
+        Bitboard fromTo = squareBB(from) | squareBB(to);
+        byType[pieceType(piece)] ^= fromTo;
+        byColor[pieceColor(piece)] ^= fromTo;
+        board[from] = NO_PIECE;
+        board[to] = uint8_t(piece);
+    }
+
+    static int castlingMask(int sq) // Rights that survive a move touching sq
+    {
+        switch (sq)
+        {
+        case 60: // e1
+            return ~(WHITE_OO | WHITE_OOO) & 15;
+        case 63: // h1
+            return ~WHITE_OO & 15;
+        case 56: // a1
+            return ~WHITE_OOO & 15;
+        case 4: // e8
+            return ~(BLACK_OO | BLACK_OOO) & 15;
+        case 7: // h8
+            return ~BLACK_OO & 15;
+        case 0: // a8
+            return ~BLACK_OOO & 15;
+        default:
+            return 15;
+        }
+    }
+
+    void addPromotions(MoveList &list, int from, int to, bool queenOnly) const
+    {
+        if (queenOnly)
+        {
+            list.add(encodeMove(from, to, PROMOTION, QUEEN));
+            return;
+        }
+        for (int type = KNIGHT; type <= ROOK; type++)
+            list.add(encodeMove(from, to, PROMOTION, type));
+    }
+
+    template <int Us>
+    void generateCastling(MoveList &list) const
+    {
+        typedef ColorTraits<Us> C;
+        constexpr int kingFrom = C::KING_FROM;
+        if (!(castlingRights & (C::SHORT_RIGHT | C::LONG_RIGHT)) || board[kingFrom] != makePiece(Us, KING))
+            return;
+        Bitboard occ = occupied();
+        if (isAttackedBy<C::THEM>(kingFrom, occ))
+            return;
+
+        if ((castlingRights & C::SHORT_RIGHT) && board[kingFrom + 3] == makePiece(Us, ROOK) &&
+            !(occ & (squareBB(kingFrom + 1) | squareBB(kingFrom + 2))) &&
+            !isAttackedBy<C::THEM>(kingFrom + 1, occ) && !isAttackedBy<C::THEM>(kingFrom + 2, occ))
+            list.add(encodeMove(kingFrom, kingFrom + 2, CASTLING));
+
+        if ((castlingRights & C::LONG_RIGHT) && board[kingFrom - 4] == makePiece(Us, ROOK) &&
+            !(occ & (squareBB(kingFrom - 1) | squareBB(kingFrom - 2) | squareBB(kingFrom - 3))) &&
+            !isAttackedBy<C::THEM>(kingFrom - 1, occ) && !isAttackedBy<C::THEM>(kingFrom - 2, occ))
+            list.add(encodeMove(kingFrom, kingFrom - 2, CASTLING));
+    }
+};
+
+inline uint64_t perft(Position &pos, int depth) // Counts leaf nodes of the legal move tree
+{
+    MoveList list;
+    pos.generateLegal(list);
+    if (depth <= 1)
+        return depth == 1 ? list.size : 1;
+    uint64_t nodes = 0;
+    for (int i = 0; i < list.size; i++)
+    {
+        pos.makeMove(list.moves[i].move);
+        nodes += perft(pos, depth - 1);
+        pos.unmakeMove();
+    }
+    return nodes;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <SFML/Network.hpp>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "boardSync.h"
+#include "server.h"
+
+using namespace std;
+
+// Client side of the chess server protocol (see server.h). The local player moves one color;
+// the server checks every move and sends it back to both players, so the board only changes
+// when an update arrives.
+class RemoteOpponent
+{
+public:
+    string status = "Connecting..."; // Shown in the sidebar
+    bool playsWhite = true;
+    bool isStarted = false;
+
+    // joinId 0 opens a new game; with a color, takes that seat back in a game the server recovered
+    bool connect(const string &hostName, unsigned short port, uint64_t joinId, const string &resumeColor = "")
+    {
+        if (socket.connect(sf::IpAddress(hostName), port, sf::seconds(5)) != sf::Socket::Done)
+        {
+            cerr << "Error: cannot connect to " << hostName << ":" << port << endl;
+            return false;
+        }
+        socket.setBlocking(false);
+        isConnected = true;
+        if (joinId && !resumeColor.empty())
+            return sendLine("RESUME " + to_string(joinId) + " " + resumeColor);
+        return sendLine(joinId ? "JOIN " + to_string(joinId) : "NEW");
+    }
+
+    void disconnect()
+    {
+        socket.disconnect();
+        isConnected = false;
+    }
+
+    bool isMyTurn(bool isWhiteTurn) const
+    {
+        return isConnected && isStarted && playsWhite == isWhiteTurn;
+    }
+
+    bool sendMove(int fromX, int fromY, int toX, int toY)
+    {
+        return sendLine("MOVE " + boardUci(fromX, fromY, toX, toY));
+    }
+
+    // Returns the next server message that changes the board ("MOVED <uci> <notation>");
+    // the other messages only update the status
+    bool pollMove(string &uci)
+    {
+        flushOutput();
+        string line;
+        while (pollLine(line))
+        {
+            istringstream in(line);
+            string command, rest;
+            in >> command;
+            getline(in >> ws, rest); // Everything after the command; empty on a bare line
+            if (command == "MOVED")
+            {
+                istringstream(rest) >> uci;
+                return true;
+            }
+            if (command == "GAME")
+            {
+                uint64_t id = 0;
+                string color;
+                istringstream(rest) >> id >> color;
+                playsWhite = color == "white";
+                status = "Game " + to_string(id) + ", " + color + (playsWhite ? "\nWaiting for opponent" : "");
+            }
+            else if (command == "START")
+            {
+                isStarted = true;
+                status = string("Playing ") + (playsWhite ? "white" : "black");
+            }
+            else if (command == "OVER")
+                status = "Game over: " + rest;
+            else if (command == "LEFT")
+                status = "Opponent left";
+            else if (command == "ILLEGAL")
+                cout << "Server rejected move " << rest << endl;
+            else if (command == "ERROR")
+                status = rest;
+        }
+        return false;
+    }
+
+private:
+    sf::TcpSocket socket;
+    string input, output;
+    bool isConnected = false;
+
+    bool sendLine(const string &line) // Queues the line; what the socket does not take now goes out on later polls
+    {
+        output += line + "\n";
+        return flushOutput();
+    }
+
+    bool flushOutput()
+    {
+        while (isConnected && !output.empty())
+        {
+            size_t sent = 0;
+            sf::Socket::Status result = socket.send(output.data(), output.size(), sent);
+            output.erase(0, sent);
+            if (result == sf::Socket::Disconnected || result == sf::Socket::Error)
+            {
+                lostConnection();
+                return false;
+            }
+            if (result == sf::Socket::NotReady || (result == sf::Socket::Partial && sent == 0))
+                break; // The kernel buffer is full
+        }
+        return isConnected;
+    }
+
+    bool pollLine(string &line)
+    {
+        char buffer[1024];
+        size_t received = 0;
+        sf::Socket::Status result;
+        while (isConnected && (result = socket.receive(buffer, sizeof(buffer), received)) == sf::Socket::Done)
+            input.append(buffer, received);
+        if (isConnected && (result == sf::Socket::Disconnected || result == sf::Socket::Error))
+            lostConnection();
+
+        size_t end = input.find('\n');
+        if (end == string::npos)
+            return false;
+        line = input.substr(0, end);
+        input.erase(0, end + 1);
+        return true;
+    }
+
+    void lostConnection()
+    {
+        isConnected = false;
+        status = "Disconnected from server";
+    }
+};
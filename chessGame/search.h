@@ -0,0 +1,544 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <memory>
+#include "position.h"
+#include "evaluate.h"
+#include "movepick.h"
+
+using namespace std;
+
+const int VALUE_DRAW = 0;
+const int VALUE_MATE = 32000;
+const int VALUE_INFINITE = 32001;
+const int MAX_PLY = 128;
+const int VALUE_MATE_IN_MAX_PLY = VALUE_MATE - MAX_PLY;
+
+enum Bound
+{
+    BOUND_NONE,
+    BOUND_UPPER, // Fail-low: the true score is at most the stored score
+    BOUND_LOWER, // Fail-high: the true score is at least the stored score
+    BOUND_EXACT
+};
+
+struct TTEntry
+{
+    uint64_t key;
+    Move move;
+    int16_t score;
+    uint8_t depth;
+    uint8_t bound;
+    uint8_t generation;
+};
+
+// Single-slot, depth-preferred hash table of search results. Searches on several threads may
+// share one table without locks: each slot holds the packed entry and the key XORed with it,
+// so a slot torn by two concurrent writes no longer matches its key and reads as a miss.
+class TranspositionTable
+{
+public:
+    explicit TranspositionTable(size_t megabytes = 16)
+    {
+        resize(megabytes);
+    }
+
+    void resize(size_t megabytes)
+    {
+        size_t count = 1;
+        while (count * 2 * sizeof(Slot) <= megabytes * 1024 * 1024)
+            count *= 2;
+        slots = make_unique<Slot[]>(count);
+        mask = count - 1;
+        clear();
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i <= mask; i++)
+        {
+            slots[i].check.store(0, memory_order_relaxed);
+            slots[i].data.store(0, memory_order_relaxed);
+        }
+        generation = 0;
+    }
+
+    void newSearch()
+    {
+        generation++;
+    }
+
+    bool probe(uint64_t key, TTEntry &out) const
+    {
+        const Slot &slot = slots[key & mask];
+        uint64_t data = slot.data.load(memory_order_relaxed);
+        if ((slot.check.load(memory_order_relaxed) ^ data) != key)
+            return false;
+        out = unpack(key, data);
+        return out.bound != BOUND_NONE;
+    }
+
+    void store(uint64_t key, Move move, int score, int depth, int bound)
+    {
+        Slot &slot = slots[key & mask];
+        uint64_t oldData = slot.data.load(memory_order_relaxed);
+        bool sameKey = (slot.check.load(memory_order_relaxed) ^ oldData) == key;
+        TTEntry entry = unpack(key, oldData);
+        uint8_t currentGeneration = generation.load(memory_order_relaxed);
+        // Keep a deeper entry for the same position from this search unless the new one is exact
+        if (sameKey && entry.generation == currentGeneration && depth < entry.depth && bound != BOUND_EXACT)
+            return;
+        if (move == MOVE_NONE && sameKey)
+            move = entry.move; // Don't forget the best move of an earlier visit
+        uint64_t data = pack({key, move, int16_t(score), uint8_t(max(depth, 0)), uint8_t(bound), currentGeneration});
+        slot.check.store(key ^ data, memory_order_relaxed);
+        slot.data.store(data, memory_order_relaxed);
+    }
+
+private:
+    struct Slot
+    {
+        atomic<uint64_t> check{0}; // key ^ data
+        atomic<uint64_t> data{0};
+    };
+
+    unique_ptr<Slot[]> slots;
+    size_t mask = 0;
+    atomic<uint8_t> generation{0};
+
+    static uint64_t pack(const TTEntry &entry) // move 0-15, score 16-31, depth 32-39, bound 40-47, generation 48-55
+    {
+        return uint64_t(entry.move) | uint64_t(uint16_t(entry.score)) << 16 | uint64_t(entry.depth) << 32 |
+               uint64_t(entry.bound) << 40 | uint64_t(entry.generation) << 48;
+    }
+
+    static TTEntry unpack(uint64_t key, uint64_t data)
+    {
+        return {key, Move(data), int16_t(uint16_t(data >> 16)), uint8_t(data >> 32), uint8_t(data >> 40), uint8_t(data >> 48)};
+    }
+};
+
+struct SearchLimits
+{
+    int depth = MAX_PLY - 1;
+    uint64_t nodes = 0;     // 0 = unlimited
+    int64_t moveTimeMs = 0; // 0 = unlimited
+    vector<Move> rootMoves; // Only consider these moves at the root (empty = all legal moves)
+};
+
+struct SearchOptions
+{
+    OrderingOptions ordering;
+    bool quiescence = true; // Resolve captures and promotions at the leaves instead of evaluating statically
+    bool seePruning = true; // Skip captures that lose material (SEE < 0) in the quiescence search
+    bool nullMove = true;           // Pass and prune if the reduced search still fails high; never without pieces (zugzwang)
+    bool lateMoveReductions = true; // Search late quiet moves shallower, re-searching the ones that beat alpha
+    bool futility = true;           // Skip quiet moves near the leaves when the evaluation is far below alpha
+    bool reverseFutility = true;    // Cut nodes near the leaves when the evaluation is far above beta
+    bool checkExtensions = true;    // Search checking moves one ply deeper
+};
+
+struct SearchResult
+{
+    Move bestMove = MOVE_NONE;
+    int score = 0;
+    int depth = 0;
+    uint64_t nodes = 0;
+    double seconds = 0;
+    vector<Move> pv;
+};
+
+// Parses a comma separated list such as "see=0,quiescence=0"; returns false on an unknown name
+inline bool applySearchOptions(SearchOptions &options, const string &spec)
+{
+    stringstream stream(spec);
+    string item;
+    while (getline(stream, item, ','))
+    {
+        size_t eq = item.find('=');
+        if (item.empty())
+            continue;
+        string name = item.substr(0, eq);
+        bool value = eq == string::npos || item.substr(eq + 1) != "0";
+        map<string, bool *> switches = {
+            {"ttmove", &options.ordering.ttMove},
+            {"captures", &options.ordering.captures},
+            {"killers", &options.ordering.killers},
+            {"history", &options.ordering.history},
+            {"see", &options.ordering.see},
+            {"quiescence", &options.quiescence},
+            {"seepruning", &options.seePruning},
+            {"nullmove", &options.nullMove},
+            {"lmr", &options.lateMoveReductions},
+            {"futility", &options.futility},
+            {"rfp", &options.reverseFutility},
+            {"checkext", &options.checkExtensions},
+        };
+        auto it = switches.find(name);
+        if (it == switches.end())
+            return false;
+        *it->second = value;
+    }
+    return true;
+}
+
+// Mate scores are stored relative to the node so they stay valid at other plies
+inline int scoreToTT(int score, int ply)
+{
+    return score >= VALUE_MATE_IN_MAX_PLY ? score + ply : score <= -VALUE_MATE_IN_MAX_PLY ? score - ply : score;
+}
+
+inline int scoreFromTT(int score, int ply)
+{
+    return score >= VALUE_MATE_IN_MAX_PLY ? score - ply : score <= -VALUE_MATE_IN_MAX_PLY ? score + ply : score;
+}
+
+inline int lateMoveReduction(int depth, int moveNumber) // Plies taken off the moveNumber-th move; grows with both
+{
+    static const auto table = []
+    {
+        array<array<int8_t, 64>, 64> reductions = {};
+        for (int d = 1; d < 64; d++)
+            for (int m = 1; m < 64; m++)
+                reductions[d][m] = int8_t(0.75 + log(d) * log(m) / 2.25);
+        return reductions;
+    }();
+    return table[min(depth, 63)][min(moveNumber, 63)];
+}
+
+inline int futilityMargin(int depth)
+{
+    return 150 * depth;
+}
+
+inline int reverseFutilityMargin(int depth)
+{
+    return 120 * depth;
+}
+
+class Search // Iterative deepening principal variation search
+{
+public:
+    SearchOptions options;
+    atomic<bool> stopRequested{false};            // Set from another thread to abort the search; the owner clears it
+    function<void(const SearchResult &)> onIteration; // Called after every completed depth
+
+    Search() : ownTT(new TranspositionTable()), tt(ownTT.get()) {}
+    explicit Search(TranspositionTable &sharedTT) : tt(&sharedTT) {}
+
+    SearchResult think(Position &pos, const SearchLimits &searchLimits)
+    {
+        limits = searchLimits;
+        startTime = chrono::steady_clock::now();
+        nodes = 0;
+        stopped = false;
+        tt->newSearch();
+        for (auto &slots : killers)
+            slots[0] = slots[1] = MOVE_NONE;
+
+        SearchResult result;
+        for (int depth = 1; depth <= limits.depth; depth++)
+        {
+            rootDepth = depth;
+            int score = alphaBeta(pos, -VALUE_INFINITE, VALUE_INFINITE, depth, 0);
+            if (stopped && depth > 1)
+                break; // The unfinished iteration cannot be trusted
+
+            result.depth = depth;
+            result.score = score;
+            result.pv.assign(pvTable[0], pvTable[0] + pvLength[0]);
+            result.bestMove = result.pv.empty() ? MOVE_NONE : result.pv[0];
+            result.nodes = nodes;
+            result.seconds = elapsedMs() / 1000.0;
+            if (onIteration)
+                onIteration(result);
+            if (stopped || result.bestMove == MOVE_NONE)
+                break;
+        }
+        result.nodes = nodes;
+        result.seconds = elapsedMs() / 1000.0;
+        return result;
+    }
+
+    void clear() // Forget everything learned in previous searches
+    {
+        tt->clear();
+        history.clear();
+    }
+
+    uint64_t nodeCount() const
+    {
+        return nodes;
+    }
+
+    TranspositionTable &transpositionTable()
+    {
+        return *tt;
+    }
+
+private:
+    unique_ptr<TranspositionTable> ownTT;
+    TranspositionTable *tt;
+    HistoryTable history;
+    Move killers[MAX_PLY][2];
+    Move pvTable[MAX_PLY][MAX_PLY];
+    int pvLength[MAX_PLY];
+    SearchLimits limits;
+    chrono::steady_clock::time_point startTime;
+    uint64_t nodes = 0;
+    bool stopped = false;
+    int rootDepth = 0; // Check extensions stop at twice this ply
+
+    int64_t elapsedMs() const
+    {
+        return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startTime).count();
+    }
+
+    void checkLimits()
+    {
+        if (stopRequested || (limits.nodes && nodes >= limits.nodes) ||
+            ((nodes & 1023) == 0 && limits.moveTimeMs && elapsedMs() >= limits.moveTimeMs))
+            stopped = true;
+    }
+
+    int alphaBeta(Position &pos, int alpha, int beta, int depth, int ply, bool allowNull = true)
+    {
+        if (depth <= 0 && options.quiescence)
+            return quiescence(pos, alpha, beta, ply);
+
+        pvLength[ply] = ply;
+        nodes++;
+        checkLimits();
+        if (stopped)
+            return 0;
+
+        bool rootNode = ply == 0;
+        bool pvNode = beta - alpha > 1;
+
+        if (!rootNode && pos.isDraw())
+            return VALUE_DRAW;
+        if (depth <= 0 || ply >= MAX_PLY - 1)
+            return evaluate(pos);
+
+        TTEntry entry;
+        bool ttHit = tt->probe(pos.key, entry);
+        Move ttMove = ttHit ? entry.move : MOVE_NONE;
+        if (ttHit && !pvNode && entry.depth >= depth)
+        {
+            int ttScore = scoreFromTT(entry.score, ply);
+            if (entry.bound == BOUND_EXACT || (entry.bound == BOUND_LOWER && ttScore >= beta) ||
+                (entry.bound == BOUND_UPPER && ttScore <= alpha))
+                return ttScore;
+        }
+
+        bool inCheck = pos.inCheck();
+        int staticEval = inCheck ? -VALUE_INFINITE : evaluate(pos);
+
+        // Reverse futility: this far above beta, one quiet move is not going to bring it back down
+        if (options.reverseFutility && !pvNode && !inCheck && depth <= 4 && abs(beta) < VALUE_MATE_IN_MAX_PLY &&
+            staticEval - reverseFutilityMargin(depth) >= beta)
+            return staticEval;
+
+        // Null move: if passing still fails high at reduced depth, a real move will too. Passing is
+        // illegal in zugzwang, which is only common without pieces, so pawn endings never try it,
+        // and deep cutoffs are confirmed by a search without the null move.
+        Bitboard nonPawnMaterial = pos.byColor[pos.sideToMove] & ~(pos.byType[PAWN] | pos.byType[KING]);
+        if (options.nullMove && allowNull && !pvNode && !inCheck && depth >= 3 && nonPawnMaterial && staticEval >= beta &&
+            abs(beta) < VALUE_MATE_IN_MAX_PLY)
+        {
+            int reduction = depth >= 7 ? 3 : 2;
+            pos.makeNullMove();
+            int score = -alphaBeta(pos, -beta, -beta + 1, depth - 1 - reduction, ply + 1, false);
+            pos.unmakeNullMove();
+            if (stopped)
+                return 0;
+            if (score >= beta && depth >= 8)
+                score = alphaBeta(pos, beta - 1, beta, depth - 1 - reduction, ply, false);
+            if (score >= beta)
+                return score >= VALUE_MATE_IN_MAX_PLY ? beta : score; // An unproven mate
+        }
+
+        int originalAlpha = alpha;
+        int bestScore = -VALUE_INFINITE;
+        Move bestMove = MOVE_NONE;
+        int legalMoves = 0;
+        Move quietsTried[64];
+        int quietCount = 0;
+        Bitboard pinned = pos.pinnedPieces(pos.sideToMove);
+
+        MovePicker picker(pos, ttMove, killers[ply], history, options.ordering);
+        Move m;
+        while ((m = picker.nextMove()) != MOVE_NONE)
+        {
+            if (!pos.isLegal(m, pinned))
+                continue;
+            if (rootNode && !limits.rootMoves.empty() && find(limits.rootMoves.begin(), limits.rootMoves.end(), m) == limits.rootMoves.end())
+                continue;
+            legalMoves++;
+            bool quiet = !pos.isCaptureOrPromotion(m);
+
+            pos.makeMove(m);
+            bool givesCheck = pos.inCheck();
+
+            // Futility: a quiet move near the leaves cannot make up this much
+            if (options.futility && !pvNode && !inCheck && !givesCheck && quiet && depth <= 2 && legalMoves > 1 &&
+                abs(alpha) < VALUE_MATE_IN_MAX_PLY && staticEval + futilityMargin(depth) <= alpha)
+            {
+                pos.unmakeMove();
+                continue;
+            }
+
+            int newDepth = depth - 1 + (options.checkExtensions && givesCheck && ply < 2 * rootDepth);
+            int score;
+            if (legalMoves == 1)
+                score = -alphaBeta(pos, -beta, -alpha, newDepth, ply + 1);
+            else
+            {
+                // Late quiet moves are rarely best when the ordering is good; search them shallower first
+                int reduction = 0;
+                if (options.lateMoveReductions && depth >= 3 && quiet && !inCheck && !givesCheck)
+                    reduction = max(0, min(newDepth - 1, lateMoveReduction(depth, legalMoves) - pvNode));
+                score = -alphaBeta(pos, -alpha - 1, -alpha, newDepth - reduction, ply + 1);
+                if (reduction && score > alpha)
+                    score = -alphaBeta(pos, -alpha - 1, -alpha, newDepth, ply + 1);
+                if (score > alpha && score < beta)
+                    score = -alphaBeta(pos, -beta, -alpha, newDepth, ply + 1);
+            }
+            pos.unmakeMove();
+
+            if (stopped)
+                return 0;
+
+            if (score > bestScore)
+            {
+                bestScore = score;
+                if (score > alpha)
+                {
+                    alpha = score;
+                    bestMove = m;
+                    updatePv(ply, m);
+                    if (score >= beta)
+                    {
+                        if (quiet)
+                            updateQuietStats(pos, m, ply, depth, quietsTried, quietCount);
+                        break;
+                    }
+                }
+            }
+            if (quiet && quietCount < 64)
+                quietsTried[quietCount++] = m;
+        }
+
+        if (legalMoves == 0)
+            return inCheck ? -VALUE_MATE + ply : VALUE_DRAW;
+
+        int bound = bestScore >= beta ? BOUND_LOWER : (alpha > originalAlpha ? BOUND_EXACT : BOUND_UPPER);
+        tt->store(pos.key, bestMove, scoreToTT(bestScore, ply), depth, bound);
+        return bestScore;
+    }
+
+    // Searches captures and promotions until the position is quiet, so the static
+    // evaluation is never taken in the middle of an exchange (the horizon effect)
+    int quiescence(Position &pos, int alpha, int beta, int ply)
+    {
+        pvLength[ply] = ply;
+        nodes++;
+        checkLimits();
+        if (stopped)
+            return 0;
+        if (pos.isDraw())
+            return VALUE_DRAW;
+        if (ply >= MAX_PLY - 1)
+            return evaluate(pos);
+
+        bool inCheck = pos.inCheck();
+        int bestScore = -VALUE_INFINITE;
+        if (!inCheck) // Stand pat: the side to move may decline every capture
+        {
+            bestScore = evaluate(pos);
+            if (bestScore >= beta)
+                return bestScore;
+            alpha = max(alpha, bestScore);
+        }
+
+        TTEntry entry;
+        bool ttHit = tt->probe(pos.key, entry);
+        Move ttMove = ttHit ? entry.move : MOVE_NONE;
+        if (ttHit && beta - alpha == 1)
+        {
+            int ttScore = scoreFromTT(entry.score, ply);
+            if (entry.bound == BOUND_EXACT || (entry.bound == BOUND_LOWER && ttScore >= beta) ||
+                (entry.bound == BOUND_UPPER && ttScore <= alpha))
+                return ttScore;
+        }
+
+        int originalAlpha = alpha;
+        Move bestMove = MOVE_NONE;
+        int legalMoves = 0;
+        Bitboard pinned = pos.pinnedPieces(pos.sideToMove);
+
+        MovePicker picker(pos, ttMove, history, options.ordering, inCheck);
+        Move m;
+        while ((m = picker.nextMove()) != MOVE_NONE)
+        {
+            if (!pos.isLegal(m, pinned))
+                continue;
+            legalMoves++;
+            if (!inCheck && options.seePruning && pos.see(m) < 0)
+                continue; // A losing capture cannot raise the stand-pat score
+
+            pos.makeMove(m);
+            int score = -quiescence(pos, -beta, -alpha, ply + 1);
+            pos.unmakeMove();
+
+            if (stopped)
+                return 0;
+
+            if (score > bestScore)
+            {
+                bestScore = score;
+                if (score > alpha)
+                {
+                    alpha = score;
+                    bestMove = m;
+                    updatePv(ply, m);
+                    if (score >= beta)
+                        break;
+                }
+            }
+        }
+
+        if (inCheck && legalMoves == 0)
+            return -VALUE_MATE + ply;
+
+        int bound = bestScore >= beta ? BOUND_LOWER : (alpha > originalAlpha ? BOUND_EXACT : BOUND_UPPER);
+        tt->store(pos.key, bestMove, scoreToTT(bestScore, ply), 0, bound);
+        return bestScore;
+    }
+
+    void updatePv(int ply, Move m)
+    {
+        pvTable[ply][ply] = m;
+        for (int i = ply + 1; i < pvLength[ply + 1]; i++)
+            pvTable[ply][i] = pvTable[ply + 1][i];
+        pvLength[ply] = max(pvLength[ply + 1], ply + 1);
+    }
+
+    void updateQuietStats(const Position &pos, Move best, int ply, int depth, const Move *quietsTried, int quietCount)
+    {
+        if (killers[ply][0] != best)
+        {
+            killers[ply][1] = killers[ply][0];
+            killers[ply][0] = best;
+        }
+        int bonus = depth * depth;
+        history.update(pos.sideToMove, best, bonus);
+        for (int i = 0; i < quietCount; i++) // Quiets searched before the cutoff were worse
+            history.update(pos.sideToMove, quietsTried[i], -bonus);
+    }
+};
@@ -0,0 +1,569 @@
+#pragma once
+
+// Line protocol, one command per line:
+//   client -> server: NEW | JOIN <id> | RESUME <id> white|black | MOVE <uci> | PING
+//   server -> client: GAME <id> white|black | START | MOVED <uci> <notation> | ILLEGAL <uci>
+//                     OVER <result> <reason> | LEFT | PONG | ERROR <text>
+// Squares use the board notation, e.g. "MOVE e2e4"; castling is sent as the king move.
+// A player who takes a seat in a game that already has moves, e.g. one recovered from the
+// journal after a restart or one they lost the connection to, gets them as MOVED lines right
+// after GAME. LEFT means the opponent disconnected; the game stays open for them to RESUME.
+// RESUME takes any free seat of a started game, so the server only listens on loopback
+// unless --listen names another address.
+
+const unsigned short DEFAULT_SERVER_PORT = 5000;
+
+#ifdef __linux__
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "commandLine.h"
+#include "boardSync.h"
+#include "gameHost.h"
+
+using namespace std;
+
+const size_t MAX_LINE_LENGTH = 256; // Longer lines close the connection
+
+inline bool raiseFileLimit(rlim_t wanted) // Lifts the soft descriptor limit towards the hard one
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return false;
+    if (limit.rlim_cur >= wanted)
+        return true;
+    limit.rlim_cur = min(wanted, limit.rlim_max);
+    if (setrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return false;
+    return limit.rlim_cur >= wanted;
+}
+
+inline bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Hosts two-player games for many clients. One thread owns every socket and multiplexes them
+// with epoll; moves are validated with the ChessBoard rules on a GameHost pool and the results
+// come back to the I/O thread through an eventfd, which then pushes them to both players.
+class ChessServer
+{
+public:
+    explicit ChessServer(unsigned validationThreads = thread::hardware_concurrency()) : host(validationThreads) {}
+
+    ~ChessServer()
+    {
+        host.waitIdle();
+        journal.close(); // Answers the last journaled moves while wakeFd is still open
+        for (auto &[fd, connection] : connections)
+            close(fd);
+        for (int fd : {listenFd, wakeFd, epollFd, spareFd})
+            if (fd >= 0)
+                close(fd);
+    }
+
+    // Recovers the unfinished games of a journal, whose players can take their seats back with
+    // RESUME, and journals every game from now on
+    bool openJournal(const string &path)
+    {
+        vector<JournalGame> recovered;
+        if (!journal.open(path, recovered))
+            return false;
+        for (const JournalGame &game : recovered)
+        {
+            if (games.count(game.id))
+                continue; // restoreSession would clash with the game that holds this id; leave its journal alone
+            if (!game.startFen.empty() || !host.restoreSession(game))
+            {
+                journal.append(journalEndGame(game.id)); // Not a server game; dropped at the next start
+                continue;
+            }
+            HostedGame &hosted = games[game.id];
+            hosted.isStarted = true;
+            hosted.isWhiteTurn = game.moves.size() % 2 == 0;
+            vector<string> notations = host.moveList(game.id);
+            for (size_t i = 0; i < game.moves.size(); i++)
+            {
+                const BoardMove &m = game.moves[i];
+                hosted.moves.push_back(boardUci(m[0], m[1], m[2], m[3]) + " " + notations[i]);
+            }
+        }
+        host.setJournal(&journal);
+        if (!recovered.empty())
+            cout << "Recovered " << games.size() << " games from " << path << endl;
+        return true;
+    }
+
+    bool listen(unsigned short port, const string &listenAddress = "127.0.0.1")
+    {
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (listenFd < 0)
+        {
+            cerr << "Error: socket: " << strerror(errno) << endl;
+            return false;
+        }
+        int yes = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        if (inet_pton(AF_INET, listenAddress.c_str(), &address.sin_addr) != 1)
+        {
+            cerr << "Error: " << listenAddress << " is not an IPv4 address" << endl;
+            return false;
+        }
+        if (::bind(listenFd, (sockaddr *)&address, sizeof(address)) != 0 || ::listen(listenFd, SOMAXCONN) != 0)
+        {
+            cerr << "Error: cannot listen on " << listenAddress << ":" << port << ": " << strerror(errno) << endl;
+            return false;
+        }
+
+        epollFd = epoll_create1(0);
+        wakeFd = eventfd(0, EFD_NONBLOCK);
+        if (epollFd < 0 || wakeFd < 0)
+        {
+            cerr << "Error: epoll setup: " << strerror(errno) << endl;
+            return false;
+        }
+        return watch(listenFd, EPOLLIN, EPOLL_CTL_ADD) && watch(wakeFd, EPOLLIN, EPOLL_CTL_ADD);
+    }
+
+    void run() // Serves until stop() is called
+    {
+        epoll_event events[256];
+        while (!stopping)
+        {
+            int ready = epoll_wait(epollFd, events, 256, -1);
+            if (ready < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                cerr << "Error: epoll_wait: " << strerror(errno) << endl;
+                return;
+            }
+            for (int i = 0; i < ready; i++)
+            {
+                int fd = events[i].data.fd;
+                if (fd == listenFd)
+                    acceptAll();
+                else if (fd == wakeFd)
+                    deliverResults();
+                else
+                    onSocketEvent(fd, events[i].events);
+            }
+        }
+    }
+
+    void stop() // Safe to call from any thread
+    {
+        stopping = true;
+        wake();
+    }
+
+    size_t connectionCount() const // Only meaningful on the I/O thread or after run() returns
+    {
+        return connections.size();
+    }
+
+private:
+    struct Connection
+    {
+        string input, output;
+        uint64_t gameId = 0; // 0 while not seated in a game
+        bool isWhite = true;
+        bool watchingWrite = false;
+    };
+
+    struct HostedGame
+    {
+        int whiteFd = -1, blackFd = -1;
+        bool isWhiteTurn = true;
+        vector<string> moves;      // "<uci> <notation>" for every accepted move, replayed to a player taking a seat
+        bool moveInFlight = false; // One move per game is validated at a time
+        bool isStarted = false;    // Both seats were taken once; from then on only RESUME fills a seat
+        bool isOver = false;
+    };
+
+    struct Validated
+    {
+        uint64_t gameId;
+        int moverFd;
+        string uci;
+        MoveResult result;
+    };
+
+    int listenFd = -1, epollFd = -1, wakeFd = -1;
+    int spareFd = open("/dev/null", O_RDONLY); // Released when accept runs out of descriptors
+    atomic<bool> stopping{false};
+    unordered_map<int, Connection> connections;
+    unordered_map<uint64_t, HostedGame> games; // Keyed by the GameHost session id
+    mutex validatedMutex;
+    vector<Validated> validated; // Results waiting for the I/O thread
+    GameJournal journal;         // Only open with --journal
+    GameHost host;               // Declared last so its workers stop first
+
+    bool watch(int fd, uint32_t events, int operation)
+    {
+        epoll_event event = {};
+        event.events = events;
+        event.data.fd = fd;
+        if (epoll_ctl(epollFd, operation, fd, &event) != 0)
+        {
+            cerr << "Error: epoll_ctl: " << strerror(errno) << endl;
+            return false;
+        }
+        return true;
+    }
+
+    void wake()
+    {
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            cerr << "Error: eventfd write: " << strerror(errno) << endl;
+    }
+
+    void acceptAll()
+    {
+        while (true)
+        {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK);
+            if (fd < 0)
+            {
+                if ((errno == EMFILE || errno == ENFILE) && spareFd >= 0)
+                {
+                    // Accept and drop the client with the spare descriptor so the listening socket
+                    // does not stay readable forever
+                    close(spareFd);
+                    close(accept(listenFd, nullptr, nullptr));
+                    spareFd = open("/dev/null", O_RDONLY);
+                    cerr << "Error: out of file descriptors at " << connections.size() << " connections\n";
+                    continue;
+                }
+                else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    cerr << "Error: accept: " << strerror(errno) << endl;
+                if (errno != EINTR)
+                    return;
+                continue;
+            }
+            int yes = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+            if (!watch(fd, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD))
+            {
+                close(fd);
+                continue;
+            }
+            connections.emplace(fd, Connection());
+        }
+    }
+
+    void onSocketEvent(int fd, uint32_t events)
+    {
+        if (!connections.count(fd))
+            return;
+        if (events & (EPOLLERR | EPOLLHUP))
+        {
+            closeConnection(fd);
+            return;
+        }
+        if (events & EPOLLOUT)
+        {
+            if (!flush(fd))
+                return;
+        }
+        if (events & (EPOLLIN | EPOLLRDHUP))
+            readFrom(fd);
+    }
+
+    void readFrom(int fd)
+    {
+        char buffer[4096];
+        while (true)
+        {
+            ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received == 0)
+            {
+                closeConnection(fd);
+                return;
+            }
+            if (received < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    closeConnection(fd);
+                return;
+            }
+
+            string &input = connections[fd].input;
+            input.append(buffer, received);
+            size_t start = 0, end;
+            while ((end = input.find('\n', start)) != string::npos)
+            {
+                string line = input.substr(start, end - start);
+                start = end + 1;
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                handleCommand(fd, line);
+                if (!connections.count(fd))
+                    return; // The command closed the connection
+            }
+            connections[fd].input.erase(0, start);
+            if (connections[fd].input.size() > MAX_LINE_LENGTH)
+            {
+                closeConnection(fd);
+                return;
+            }
+        }
+    }
+
+    void handleCommand(int fd, const string &line)
+    {
+        istringstream in(line);
+        string command;
+        in >> command;
+        Connection &connection = connections[fd];
+
+        if (command == "PING")
+            sendLine(fd, "PONG");
+        else if (command == "NEW")
+        {
+            if (connection.gameId)
+            {
+                sendLine(fd, "ERROR already in a game");
+                return;
+            }
+            uint64_t id = host.createSession();
+            games[id].whiteFd = fd;
+            connection.gameId = id;
+            connection.isWhite = true;
+            sendLine(fd, "GAME " + to_string(id) + " white");
+        }
+        else if (command == "JOIN")
+        {
+            uint64_t id = 0;
+            in >> id;
+            auto it = games.find(id);
+            if (connection.gameId)
+                sendLine(fd, "ERROR already in a game");
+            else if (it == games.end() || it->second.isStarted || it->second.blackFd >= 0 || it->second.whiteFd < 0)
+                sendLine(fd, "ERROR no open game " + to_string(id));
+            else
+                takeSeat(fd, id, false);
+        }
+        else if (command == "RESUME")
+        {
+            uint64_t id = 0;
+            string color;
+            in >> id >> color;
+            auto it = games.find(id);
+            if (connection.gameId)
+                sendLine(fd, "ERROR already in a game");
+            else if (it == games.end() || !it->second.isStarted || it->second.isOver || (color != "white" && color != "black") ||
+                     (color == "white" ? it->second.whiteFd : it->second.blackFd) >= 0)
+                sendLine(fd, "ERROR no " + color + " seat free in game " + to_string(id));
+            else
+                takeSeat(fd, id, color == "white");
+        }
+        else if (command == "MOVE")
+        {
+            string uci;
+            in >> uci;
+            submitMove(fd, uci);
+        }
+        else if (!command.empty())
+            sendLine(fd, "ERROR unknown command " + command);
+    }
+
+    void takeSeat(int fd, uint64_t id, bool isWhite) // Sends the moves so far, and START once both players are seated
+    {
+        HostedGame &game = games[id];
+        (isWhite ? game.whiteFd : game.blackFd) = fd;
+        connections[fd].gameId = id;
+        connections[fd].isWhite = isWhite;
+        sendLine(fd, "GAME " + to_string(id) + (isWhite ? " white" : " black"));
+        for (const string &move : game.moves)
+            sendLine(fd, "MOVED " + move);
+        if (game.whiteFd >= 0 && game.blackFd >= 0)
+        {
+            game.isStarted = true;
+            sendLine(game.whiteFd, "START");
+            sendLine(game.blackFd, "START");
+        }
+    }
+
+    void submitMove(int fd, const string &uci)
+    {
+        Connection &connection = connections[fd];
+        auto it = games.find(connection.gameId);
+        int fromX, fromY, toX, toY;
+        if (it == games.end() || !it->second.isStarted)
+        {
+            sendLine(fd, "ERROR game has not started");
+            return;
+        }
+        HostedGame &game = it->second;
+        if (game.isOver || game.isWhiteTurn != connection.isWhite || game.moveInFlight || !parseBoardUci(uci, fromX, fromY, toX, toY))
+        {
+            sendLine(fd, "ILLEGAL " + uci);
+            return;
+        }
+
+        game.moveInFlight = true;
+        uint64_t gameId = connection.gameId;
+        host.submitMove(gameId, fromX, fromY, toX, toY, [this, gameId, fd, uci](const MoveResult &result)
+                        {
+                            {
+                                lock_guard<mutex> lock(validatedMutex);
+                                validated.push_back({gameId, fd, uci, result});
+                            }
+                            wake(); });
+    }
+
+    void deliverResults() // Runs on the I/O thread after a validation worker signalled the eventfd
+    {
+        uint64_t count;
+        while (read(wakeFd, &count, sizeof(count)) > 0)
+            ;
+        vector<Validated> batch;
+        {
+            lock_guard<mutex> lock(validatedMutex);
+            batch.swap(validated);
+        }
+
+        for (Validated &item : batch)
+        {
+            auto it = games.find(item.gameId);
+            if (it == games.end())
+                continue; // Both players left while the move was being checked
+            HostedGame &game = it->second;
+            game.moveInFlight = false;
+            if (!item.result.accepted)
+            {
+                if (connections.count(item.moverFd))
+                    sendLine(item.moverFd, "ILLEGAL " + item.uci);
+                continue;
+            }
+
+            if (item.result.journalFailed)
+            {
+                game.isOver = true; // The move cannot be confirmed, and the session has already played it
+                int players[2] = {game.whiteFd, game.blackFd};
+                for (int fd : players)
+                    sendLine(fd, "ERROR the game journal failed; the game is stopped");
+                continue;
+            }
+            game.isWhiteTurn = !game.isWhiteTurn;
+            game.isOver = item.result.gameOver;
+            game.moves.push_back(item.uci + " " + item.result.notation);
+            vector<string> lines = {"MOVED " + item.uci + " " + item.result.notation};
+            if (game.isOver)
+                lines.push_back(string("OVER ") + (game.isWhiteTurn ? "0-1" : "1-0") + " checkmate");
+            int players[2] = {game.whiteFd, game.blackFd}; // A failed send may close a player and the game
+            for (const string &line : lines)
+                for (int fd : players)
+                    sendLine(fd, line);
+        }
+    }
+
+    void sendLine(int fd, const string &line)
+    {
+        auto it = connections.find(fd);
+        if (it == connections.end())
+            return;
+        it->second.output += line;
+        it->second.output += '\n';
+        if (!it->second.watchingWrite)
+            flush(fd);
+    }
+
+    bool flush(int fd) // Writes what the socket accepts and waits for EPOLLOUT for the rest
+    {
+        Connection &connection = connections[fd];
+        size_t sent = 0;
+        while (sent < connection.output.size())
+        {
+            ssize_t written = ::send(fd, connection.output.data() + sent, connection.output.size() - sent, MSG_NOSIGNAL);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                closeConnection(fd);
+                return false;
+            }
+            sent += written;
+        }
+        connection.output.erase(0, sent);
+
+        bool wantWrite = !connection.output.empty();
+        if (wantWrite != connection.watchingWrite)
+        {
+            connection.watchingWrite = wantWrite;
+            watch(fd, EPOLLIN | EPOLLRDHUP | (wantWrite ? uint32_t(EPOLLOUT) : 0u), EPOLL_CTL_MOD);
+        }
+        return true;
+    }
+
+    void closeConnection(int fd)
+    {
+        auto it = connections.find(fd);
+        if (it == connections.end())
+            return;
+        uint64_t gameId = it->second.gameId;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        connections.erase(it);
+
+        auto gameIt = games.find(gameId);
+        if (gameIt == games.end())
+            return;
+        HostedGame &game = gameIt->second;
+        (game.whiteFd == fd ? game.whiteFd : game.blackFd) = -1;
+        int opponent = game.whiteFd >= 0 ? game.whiteFd : game.blackFd;
+        if (opponent >= 0)
+        {
+            if (!game.isOver)
+                sendLine(opponent, "LEFT"); // The seat stays free for RESUME
+            return;
+        }
+        if (game.isStarted && !game.isOver)
+            return; // Both players can still RESUME the game
+        games.erase(gameIt);
+        host.closeSession(gameId);
+    }
+};
+
+inline int runServer(const CommandArgs &args)
+{
+    unsigned short port = args.getInt("port", DEFAULT_SERVER_PORT, 1, 65535);
+    string listenAddress = args.getString("listen", "127.0.0.1");
+    unsigned threads = args.getInt("threads", max(1u, thread::hardware_concurrency()), 1);
+    int maxConnections = args.getInt("max-connections", 100000, 1, INT_MAX - 64);
+    if (!args.isValid())
+        return 1;
+    raiseFileLimit(maxConnections + 64);
+
+    ChessServer server(threads);
+    if (args.has("journal") && !server.openJournal(args.getString("journal", "games.journal")))
+        return 1;
+    if (!server.listen(port, listenAddress))
+        return 1;
+    cout << "Chess server listening on " << listenAddress << ":" << port << " (" << threads << " validation threads)" << endl;
+    server.run();
+    return 0;
+}
+
+#endif
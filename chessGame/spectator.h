@@ -0,0 +1,444 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <SFML/Graphics.hpp>
+#include "commandLine.h"
+#include "search.h"
+
+using namespace std;
+
+// Spectator mode: many games on one screen, e.g. a whole self-play run. Worker threads play the
+// games and publish every new position with a version number. The view keeps each board as a
+// fixed run of quads in one vertex array, textured from a single atlas that holds the pieces and
+// both square colours, so the whole grid is one draw call. A frame only rewrites, and uploads,
+// the boards whose version changed since the last one.
+
+struct SpectatorBoard // One game as the view sees it
+{
+    uint8_t pieces[64];                           // Position piece codes, a8 = 0; NO_PIECE if empty
+    int lastFrom = NO_SQUARE, lastTo = NO_SQUARE; // Squares of the last move, tinted on the board
+    bool isOver = false;                          // Greyed out until the next game starts on this board
+};
+
+class SpectatorFeed // Self-play games, each worker playing its share of them a move at a time
+{
+public:
+    SpectatorFeed(size_t games, unsigned threads, int64_t moveTimeMs, uint64_t seed)
+        : slots(new Slot[games]), games(games), threads(max(1u, min<unsigned>(threads, games))),
+          moveTimeMs(moveTimeMs), seed(seed)
+    {
+    }
+
+    SpectatorFeed(const SpectatorFeed &) = delete;
+    SpectatorFeed &operator=(const SpectatorFeed &) = delete;
+
+    ~SpectatorFeed()
+    {
+        stop();
+    }
+
+    void start()
+    {
+        for (unsigned t = 0; t < threads; t++)
+            searches.push_back(make_unique<Search>());
+        for (unsigned t = 0; t < threads; t++)
+            workers.emplace_back(&SpectatorFeed::work, this, t);
+    }
+
+    void stop()
+    {
+        stopping = true;
+        for (auto &search : searches)
+            search->stopRequested = true;
+        for (thread &worker : workers)
+            worker.join();
+        workers.clear();
+    }
+
+    size_t size() const
+    {
+        return games;
+    }
+
+    bool read(size_t index, uint64_t &version, SpectatorBoard &board) // Copies the board if it changed since version
+    {
+        Slot &slot = slots[index];
+        if (slot.version.load(memory_order_acquire) == version)
+            return false;
+        lock_guard<mutex> lock(slot.lock);
+        board = slot.board;
+        version = slot.version;
+        return true;
+    }
+
+    uint64_t moveCount() const
+    {
+        return moves;
+    }
+
+    uint64_t finishedCount() const
+    {
+        return finished;
+    }
+
+private:
+    static constexpr int OPENING_PLIES = 4;   // Random moves before the engine takes over, so the boards differ
+    static constexpr int MAX_GAME_PLIES = 400; // Called a draw after this many
+    static constexpr int RESTART_DELAY_MS = 3000;
+
+    struct Slot
+    {
+        mutex lock; // Held only while a board is copied in or out
+        SpectatorBoard board;
+        atomic<uint64_t> version{0};
+    };
+
+    struct LiveGame
+    {
+        Position pos;
+        int plies = 0;
+        bool isOver = false;
+        chrono::steady_clock::time_point restartAt;
+    };
+
+    unique_ptr<Slot[]> slots;
+    size_t games;
+    unsigned threads;
+    int64_t moveTimeMs;
+    uint64_t seed;
+    vector<unique_ptr<Search>> searches; // One per worker
+    vector<thread> workers;
+    atomic<bool> stopping{false};
+    atomic<uint64_t> moves{0};
+    atomic<uint64_t> finished{0};
+
+    void publish(size_t index, const Position &pos, Move lastMove, bool isOver)
+    {
+        SpectatorBoard board;
+        for (int sq = 0; sq < 64; sq++)
+            board.pieces[sq] = uint8_t(pos.pieceOn(sq));
+        board.lastFrom = lastMove == MOVE_NONE ? NO_SQUARE : moveFrom(lastMove);
+        board.lastTo = lastMove == MOVE_NONE ? NO_SQUARE : moveTo(lastMove);
+        board.isOver = isOver;
+        Slot &slot = slots[index];
+        lock_guard<mutex> lock(slot.lock);
+        slot.board = board;
+        slot.version.fetch_add(1, memory_order_release);
+    }
+
+    void startGame(LiveGame &game, size_t index, mt19937_64 &rng)
+    {
+        Move last = MOVE_NONE;
+        do
+        {
+            game.pos = Position();
+            for (int ply = 0; ply < OPENING_PLIES; ply++)
+            {
+                MoveList list;
+                game.pos.generateLegal(list);
+                if (list.size == 0)
+                    break;
+                last = list.moves[rng() % list.size].move;
+                game.pos.makeMove(last);
+            }
+        } while (isFinished(game.pos));
+        game.plies = OPENING_PLIES;
+        game.isOver = false;
+        publish(index, game.pos, last, false);
+    }
+
+    bool isFinished(const Position &pos) const
+    {
+        MoveList list;
+        Position copy = pos;
+        copy.generateLegal(list);
+        return list.size == 0 || pos.isDraw();
+    }
+
+    void work(unsigned index)
+    {
+        mt19937_64 rng(seed * 0x9E3779B97F4A7C15ULL + index);
+        Search &search = *searches[index];
+        vector<size_t> ownSlots; // Every threads-th game, starting at this worker's index
+        for (size_t g = index; g < games; g += threads)
+            ownSlots.push_back(g);
+        vector<LiveGame> own(ownSlots.size());
+        for (size_t i = 0; i < own.size(); i++)
+            startGame(own[i], ownSlots[i], rng);
+
+        while (!stopping)
+        {
+            bool moved = false;
+            for (size_t i = 0; i < own.size() && !stopping; i++)
+            {
+                LiveGame &game = own[i];
+                if (game.isOver)
+                {
+                    if (chrono::steady_clock::now() < game.restartAt)
+                        continue; // The final position stays on screen for a while
+                    startGame(game, ownSlots[i], rng);
+                    moved = true;
+                    continue;
+                }
+
+                SearchLimits limits;
+                limits.moveTimeMs = moveTimeMs;
+                SearchResult result = search.think(game.pos, limits);
+                if (stopping || result.bestMove == MOVE_NONE)
+                    break;
+                game.pos.makeMove(result.bestMove);
+                moves++;
+                if (isFinished(game.pos) || ++game.plies >= MAX_GAME_PLIES)
+                {
+                    game.isOver = true;
+                    game.restartAt = chrono::steady_clock::now() + chrono::milliseconds(RESTART_DELAY_MS);
+                    finished++;
+                }
+                publish(ownSlots[i], game.pos, result.bestMove, game.isOver);
+                moved = true;
+            }
+            if (!moved)
+                this_thread::sleep_for(chrono::milliseconds(10)); // All finished games are still on display
+        }
+    }
+};
+
+class SpectatorView // Every board of a feed in one vertex array, drawn with one call
+{
+public:
+    static constexpr int SQUARE = 32; // Logical size of a square; the window view scales the whole grid
+    static constexpr int GAP = 8;     // Between boards
+
+    bool create(const map<string, sf::Texture> &textures, size_t boards)
+    {
+        if (!buildAtlas(textures))
+            return false;
+        columns = size_t(ceil(sqrt(double(boards))));
+        rows = (boards + columns - 1) / columns;
+        versions.assign(boards, 0);
+        vertices.assign(boards * BOARD_VERTICES, sf::Vertex());
+        SpectatorBoard empty;
+        fill(begin(empty.pieces), end(empty.pieces), uint8_t(NO_PIECE));
+        for (size_t i = 0; i < boards; i++)
+            writeBoard(i, empty);
+
+        // Boards go through a vertex buffer in video memory where the driver has them, so an
+        // unchanged board costs nothing per frame; otherwise the array is drawn from memory
+        useBuffer = sf::VertexBuffer::isAvailable() && buffer.create(vertices.size()) && buffer.update(vertices.data());
+        return true;
+    }
+
+    size_t update(SpectatorFeed &feed) // Rewrites the boards that changed; returns how many
+    {
+        size_t changed = 0;
+        for (size_t i = 0; i < versions.size(); i++)
+        {
+            if (!feed.read(i, versions[i], scratch))
+                continue;
+            writeBoard(i, scratch);
+            if (useBuffer)
+                buffer.update(&vertices[i * BOARD_VERTICES], BOARD_VERTICES, unsigned(i * BOARD_VERTICES));
+            changed++;
+        }
+        return changed;
+    }
+
+    void draw(sf::RenderTarget &target) const
+    {
+        sf::RenderStates states(&atlas.getTexture());
+        if (useBuffer)
+            target.draw(buffer, states);
+        else
+            target.draw(vertices.data(), vertices.size(), sf::Quads, states);
+    }
+
+    sf::Vector2f size() const // Logical size of the grid
+    {
+        return sf::Vector2f(float(columns * BOARD_STRIDE), float(rows * BOARD_STRIDE));
+    }
+
+    static size_t boardBytes() // Uploaded per changed board
+    {
+        return BOARD_VERTICES * sizeof(sf::Vertex);
+    }
+
+private:
+    static constexpr int CELL = 64;                         // Atlas cell, twice the logical square so scaled boards stay sharp
+    static constexpr int CELL_STRIDE = CELL + 2;            // One pixel of padding on each side keeps neighbours from bleeding in
+    static constexpr int ATLAS_COLUMNS = 4;                 // 12 pieces and 2 squares in a 4x4 grid
+    static constexpr int LIGHT_CELL = 12, DARK_CELL = 13;   // Cells 0-11 hold the pieces by Position piece code
+    static constexpr size_t BOARD_VERTICES = 64 * 2 * 4;    // A square quad and a piece quad for every square
+    static constexpr int BOARD_STRIDE = 8 * SQUARE + GAP;
+
+    sf::RenderTexture atlas;
+    vector<sf::Vertex> vertices; // BOARD_VERTICES per board, in feed order
+    sf::VertexBuffer buffer{sf::Quads, sf::VertexBuffer::Stream};
+    bool useBuffer = false;
+    vector<uint64_t> versions;   // Feed version each board was last written from
+    SpectatorBoard scratch;
+    size_t columns = 1, rows = 1;
+
+    static sf::Vector2f cellOrigin(int cell)
+    {
+        return sf::Vector2f(float(cell % ATLAS_COLUMNS * CELL_STRIDE + 1), float(cell / ATLAS_COLUMNS * CELL_STRIDE + 1));
+    }
+
+    bool buildAtlas(const map<string, sf::Texture> &textures)
+    {
+        if (!atlas.create(ATLAS_COLUMNS * CELL_STRIDE, ATLAS_COLUMNS * CELL_STRIDE))
+        {
+            cerr << "Error: cannot create the spectator texture atlas" << endl;
+            return false;
+        }
+        atlas.clear(sf::Color::Transparent);
+        for (int piece = 0; piece < NO_PIECE; piece++) // Fitted into the cell and centred, keeping the aspect ratio
+        {
+            string key = string(1, piece < 6 ? 'W' : 'B') + "PNBRQK"[piece % 6];
+            const sf::Texture &texture = textures.at(key);
+            sf::Vector2f textureSize(float(texture.getSize().x), float(texture.getSize().y));
+            float scale = min(CELL / textureSize.x, CELL / textureSize.y);
+            sf::Sprite sprite(texture);
+            sprite.setScale(scale, scale);
+            sprite.setPosition(cellOrigin(piece).x + (CELL - textureSize.x * scale) / 2,
+                               cellOrigin(piece).y + (CELL - textureSize.y * scale) / 2);
+            atlas.draw(sprite);
+        }
+        for (int cell : {LIGHT_CELL, DARK_CELL}) // Squares also fill their padding, so edges sample the same colour
+        {
+            const sf::Texture &texture = textures.at(cell == LIGHT_CELL ? "WS1" : "BS1");
+            sf::Sprite sprite(texture);
+            sprite.setScale(float(CELL + 2) / texture.getSize().x, float(CELL + 2) / texture.getSize().y);
+            sprite.setPosition(cellOrigin(cell).x - 1, cellOrigin(cell).y - 1);
+            atlas.draw(sprite);
+        }
+        atlas.display();
+        atlas.setSmooth(true);
+        return true;
+    }
+
+    static void setQuad(sf::Vertex *quad, sf::Vector2f topLeft, float size, int cell, sf::Color color)
+    {
+        sf::Vector2f tex = cellOrigin(cell);
+        quad[0] = sf::Vertex(topLeft, color, tex);
+        quad[1] = sf::Vertex(sf::Vector2f(topLeft.x + size, topLeft.y), color, sf::Vector2f(tex.x + CELL, tex.y));
+        quad[2] = sf::Vertex(sf::Vector2f(topLeft.x + size, topLeft.y + size), color, sf::Vector2f(tex.x + CELL, tex.y + CELL));
+        quad[3] = sf::Vertex(sf::Vector2f(topLeft.x, topLeft.y + size), color, sf::Vector2f(tex.x, tex.y + CELL));
+    }
+
+    void writeBoard(size_t index, const SpectatorBoard &board)
+    {
+        static const sf::Color lastMoveTint(255, 230, 120), finishedTint(150, 150, 150);
+        sf::Vertex *quads = &vertices[index * BOARD_VERTICES];
+        float left = float(index % columns * BOARD_STRIDE + GAP / 2), top = float(index / columns * BOARD_STRIDE + GAP / 2);
+        for (int sq = 0; sq < 64; sq++)
+        {
+            int x = sq % 8, y = sq / 8; // a8 = 0, so white plays up the screen as on the main board
+            sf::Vector2f topLeft(left + x * SQUARE, top + y * SQUARE);
+            sf::Color tint = board.isOver ? finishedTint : sq == board.lastFrom || sq == board.lastTo ? lastMoveTint : sf::Color::White;
+            setQuad(quads + sq * 8, topLeft, SQUARE, (x + y) % 2 == 0 ? LIGHT_CELL : DARK_CELL, tint);
+            int piece = board.pieces[sq];
+            setQuad(quads + sq * 8 + 4, topLeft, piece == NO_PIECE ? 0 : SQUARE, piece == NO_PIECE ? LIGHT_CELL : piece, sf::Color::White); // Empty squares get a zero-size quad
+        }
+    }
+};
+
+// "chess spectate [--games 64] [--threads N] [--movetime 100] [--seed 1] [--frames N]": plays the
+// games and shows them all in one window. With --frames, renders that many frames offscreen at
+// 60 per second instead and prints the frame times.
+inline int runSpectator(const CommandArgs &args, const map<string, sf::Texture> &textures)
+{
+    size_t games = args.getInt("games", 64, 1);
+    unsigned threads = args.getInt("threads", max(1u, thread::hardware_concurrency()), 1);
+    int64_t moveTimeMs = args.getInt("movetime", 100, 1);
+    int frames = args.getInt("frames", 0, 0);
+    int seed = args.getInt("seed", 1);
+    if (!args.isValid())
+        return 1;
+
+    SpectatorView view;
+    if (!view.create(textures, games))
+        return 1;
+    SpectatorFeed feed(games, threads, moveTimeMs, seed);
+    feed.start();
+    sf::Vector2f size = view.size();
+    const auto frameTime = chrono::microseconds(16667);
+
+    if (frames > 0)
+    {
+        sf::RenderTexture target;
+        if (!target.create(unsigned(size.x), unsigned(size.y)))
+        {
+            cerr << "Error: cannot create an offscreen render target" << endl;
+            return 1;
+        }
+        vector<int64_t> frameNs;
+        size_t uploaded = 0;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            auto frameStart = chrono::steady_clock::now();
+            uploaded += view.update(feed);
+            target.clear(sf::Color(40, 40, 40));
+            view.draw(target);
+            target.display();
+            frameNs.push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - frameStart).count());
+            this_thread::sleep_until(frameStart + frameTime);
+        }
+        feed.stop();
+
+        sort(frameNs.begin(), frameNs.end());
+        auto percentileUs = [&](double p)
+        {
+            return frameNs[min(frameNs.size() - 1, size_t(p * frameNs.size()))] / 1000.0;
+        };
+        cout << fixed << setprecision(1) << frames << " frames of " << games << " boards, 1 draw call each\n"
+             << "frame us: p50 " << percentileUs(0.50) << ", p90 " << percentileUs(0.90) << ", p99 " << percentileUs(0.99)
+             << ", max " << percentileUs(1.0) << "\n"
+             << setprecision(2) << double(uploaded) / frames << " boards uploaded per frame ("
+             << double(uploaded) * SpectatorView::boardBytes() / frames / 1024 << " KB), " << feed.moveCount() << " moves, "
+             << feed.finishedCount() << " games finished" << endl;
+        return 0;
+    }
+
+    float scale = min(1.0f, 1000.0f / max(size.x, size.y)); // Fits a 64 board grid on a typical screen
+    sf::RenderWindow window(sf::VideoMode(unsigned(size.x * scale), unsigned(size.y * scale)), "Chess Spectator");
+    window.setView(sf::View(sf::FloatRect(0, 0, size.x, size.y))); // Resizing scales the grid
+    window.setFramerateLimit(60);
+    auto start = chrono::steady_clock::now(), lastTitle = start;
+    while (window.isOpen())
+    {
+        sf::Event event;
+        while (window.pollEvent(event))
+        {
+            if (event.type == sf::Event::Closed || (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape))
+                window.close();
+        }
+        view.update(feed);
+        window.clear(sf::Color(40, 40, 40));
+        view.draw(window);
+        window.display();
+
+        auto now = chrono::steady_clock::now();
+        if (now - lastTitle >= chrono::milliseconds(500))
+        {
+            lastTitle = now;
+            double seconds = chrono::duration<double>(now - start).count();
+            ostringstream title;
+            title << "Chess Spectator - " << games << " games, " << feed.moveCount() << " moves (" << fixed << setprecision(1)
+                  << feed.moveCount() / seconds << "/s), " << feed.finishedCount() << " finished";
+            window.setTitle(title.str());
+        }
+    }
+    feed.stop();
+    return 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+class ThreadPool // Fixed set of worker threads draining a shared FIFO task queue
+{
+public:
+    explicit ThreadPool(unsigned threadCount = thread::hardware_concurrency())
+    {
+        threadCount = max(threadCount, 1u);
+        for (unsigned i = 0; i < threadCount; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueReady.notify_all();
+        for (thread &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(function<void()> task)
+    {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            tasks.push_back(std::move(task));
+        }
+        queueReady.notify_one();
+    }
+
+    void waitIdle() // Blocks until every submitted task has finished
+    {
+        unique_lock<mutex> lock(queueMutex);
+        allDone.wait(lock, [this] { return tasks.empty() && busyWorkers == 0; });
+    }
+
+    size_t size() const
+    {
+        return workers.size();
+    }
+
+private:
+    vector<thread> workers;
+    deque<function<void()>> tasks;
+    mutex queueMutex;
+    condition_variable queueReady;
+    condition_variable allDone;
+    int busyWorkers = 0;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        while (true)
+        {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueReady.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                    return; // Stopping and nothing left to run
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                busyWorkers++;
+            }
+            task();
+            {
+                lock_guard<mutex> lock(queueMutex);
+                busyWorkers--;
+                if (tasks.empty() && busyWorkers == 0)
+                    allDone.notify_all();
+            }
+        }
+    }
+};
@@ -0,0 +1,322 @@
+#pragma once
+
+// Latency tracing. Build with -DCHESS_TRACE to turn it on; without it every TRACE_ macro
+// expands to nothing and costs nothing.
+//
+//   TRACE_SCOPE("name")          times the enclosing block: a Chrome trace span plus a histogram
+//   TRACE_COUNT("name")          bumps a counter; counters are sampled into the trace every frame
+//   TRACE_INPUT()                remembers when an input was handled ...
+//   TRACE_PRESENTED("name")      ... and records the time until the frame that shows it
+//   TRACE_FRAME_COUNTERS()       samples all counters into the trace
+//   TRACE_DUMP()                 writes chess_trace.json (chrome://tracing, Perfetto) and prints
+//                                the latency histograms
+//
+// Events go into a fixed-size lock-free ring buffer, so the oldest ones are overwritten
+// once it is full and recording never blocks or allocates.
+
+#ifdef CHESS_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+inline uint64_t traceNowNs()
+{
+    static const auto origin = chrono::steady_clock::now();
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origin).count();
+}
+
+inline uint32_t traceThreadId() // Small stable numbers read better in the trace viewer than OS ids
+{
+    static atomic<uint32_t> next{1};
+    thread_local uint32_t id = next++;
+    return id;
+}
+
+struct TraceEvent
+{
+    const char *name;
+    uint64_t startNs;
+    uint64_t durationNs; // Spans only
+    int64_t value;       // Counters only
+    uint32_t threadId;
+    char phase; // 'X' span, 'C' counter sample
+};
+
+class TraceRing // Multi-producer ring buffer; each slot is guarded by its own sequence number
+{
+public:
+    static const size_t CAPACITY = 1 << 16;
+
+    void push(const TraceEvent &event)
+    {
+        uint64_t index = head.fetch_add(1, memory_order_relaxed);
+        Slot &slot = slots[index & (CAPACITY - 1)];
+        slot.sequence.store(2 * index + 1, memory_order_release); // Odd while being written
+        slot.event = event;
+        slot.sequence.store(2 * index + 2, memory_order_release);
+    }
+
+    vector<TraceEvent> snapshot() const // Complete events, oldest first
+    {
+        vector<TraceEvent> events;
+        uint64_t end = head.load(memory_order_acquire);
+        uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+        for (uint64_t index = begin; index < end; index++)
+        {
+            const Slot &slot = slots[index & (CAPACITY - 1)];
+            if (slot.sequence.load(memory_order_acquire) != 2 * index + 2)
+                continue; // Still being written, or already overwritten
+            TraceEvent event = slot.event;
+            atomic_thread_fence(memory_order_acquire);
+            if (slot.sequence.load(memory_order_relaxed) == 2 * index + 2)
+                events.push_back(event);
+        }
+        return events;
+    }
+
+private:
+    struct Slot
+    {
+        atomic<uint64_t> sequence{0};
+        TraceEvent event;
+    };
+    atomic<uint64_t> head{0};
+    Slot slots[CAPACITY];
+};
+
+class LatencyHistogram // Log-linear buckets: four per power of two, from 1 ns up
+{
+public:
+    static const int BUCKETS = 4 * 40;
+
+    const char *name;
+
+    explicit LatencyHistogram(const char *name) : name(name) {}
+
+    void add(uint64_t ns)
+    {
+        counts[bucketOf(ns)].fetch_add(1, memory_order_relaxed);
+        uint64_t previous = maximum.load(memory_order_relaxed);
+        while (ns > previous && !maximum.compare_exchange_weak(previous, ns, memory_order_relaxed))
+            ;
+    }
+
+    uint64_t total() const
+    {
+        uint64_t sum = 0;
+        for (const auto &count : counts)
+            sum += count.load(memory_order_relaxed);
+        return sum;
+    }
+
+    double percentileNs(double p) const // Upper edge of the bucket holding the percentile
+    {
+        uint64_t target = uint64_t(ceil(p * total())), seen = 0;
+        for (int b = 0; b < BUCKETS; b++)
+        {
+            seen += counts[b].load(memory_order_relaxed);
+            if (seen >= target && seen > 0)
+                return min<double>(upperEdge(b), maximum.load(memory_order_relaxed));
+        }
+        return maximum.load(memory_order_relaxed);
+    }
+
+    uint64_t maxNs() const
+    {
+        return maximum.load(memory_order_relaxed);
+    }
+
+private:
+    atomic<uint64_t> counts[BUCKETS] = {};
+    atomic<uint64_t> maximum{0};
+
+    static int bucketOf(uint64_t ns)
+    {
+        if (ns < 4)
+            return int(ns);
+        int power = 63 - __builtin_clzll(ns);
+        int quarter = int((ns >> (power - 2)) & 3);
+        return min(BUCKETS - 1, 4 * (power - 1) + quarter);
+    }
+
+    static double upperEdge(int bucket)
+    {
+        if (bucket < 4)
+            return bucket;
+        int power = bucket / 4 + 1, quarter = bucket % 4;
+        return ldexp(1.0 + (quarter + 1) / 4.0, power);
+    }
+};
+
+class Tracer
+{
+public:
+    TraceRing ring;
+    atomic<uint64_t> pendingInputNs{0}; // Time of the last input not yet shown on screen
+
+    static Tracer &instance()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    LatencyHistogram &histogram(const char *name) // Called once per instrumented site; sites share by name
+    {
+        lock_guard<mutex> lock(registryMutex);
+        for (auto &h : histograms)
+            if (strcmp(h->name, name) == 0)
+                return *h;
+        histograms.push_back(make_unique<LatencyHistogram>(name));
+        return *histograms.back();
+    }
+
+    atomic<int64_t> &counter(const char *name) // Called once per counted site; sites share by name
+    {
+        lock_guard<mutex> lock(registryMutex);
+        for (auto &c : counters)
+            if (strcmp(c->name, name) == 0)
+                return c->value;
+        counters.push_back(make_unique<NamedCounter>(name));
+        return counters.back()->value;
+    }
+
+    void sampleCounters()
+    {
+        uint64_t now = traceNowNs();
+        lock_guard<mutex> lock(registryMutex);
+        for (auto &counter : counters)
+            ring.push({counter->name, now, 0, counter->value.load(memory_order_relaxed), traceThreadId(), 'C'});
+    }
+
+    void dump(const string &path = "chess_trace.json")
+    {
+        vector<TraceEvent> events = ring.snapshot();
+        ofstream out(path);
+        out << "{\"traceEvents\": [\n";
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            const TraceEvent &e = events[i];
+            out << fixed << setprecision(3) << "{\"name\": \"" << e.name << "\", \"ph\": \"" << e.phase
+                << "\", \"ts\": " << e.startNs / 1000.0 << ", \"pid\": 1, \"tid\": " << e.threadId;
+            if (e.phase == 'X')
+                out << ", \"dur\": " << e.durationNs / 1000.0;
+            else
+                out << ", \"args\": {\"value\": " << e.value << "}";
+            out << "}" << (i + 1 < events.size() ? ",\n" : "\n");
+        }
+        out << "], \"displayTimeUnit\": \"ms\"}\n";
+
+        cout << "Trace: " << events.size() << " events written to " << path << "\n";
+        cout << left << setw(32) << "Span" << right << setw(10) << "count" << setw(12) << "p50 us" << setw(12) << "p90 us"
+             << setw(12) << "p99 us" << setw(12) << "max us" << "\n";
+        lock_guard<mutex> lock(registryMutex);
+        for (auto &h : histograms)
+        {
+            if (!h->total())
+                continue;
+            cout << left << setw(32) << h->name << right << setw(10) << h->total() << fixed << setprecision(1)
+                 << setw(12) << h->percentileNs(0.50) / 1000 << setw(12) << h->percentileNs(0.90) / 1000
+                 << setw(12) << h->percentileNs(0.99) / 1000 << setw(12) << h->maxNs() / 1000.0 << "\n";
+        }
+        for (auto &counter : counters)
+            cout << left << setw(32) << counter->name << right << setw(10) << counter->value.load() << " (counter)\n";
+        cout.flush();
+    }
+
+private:
+    struct NamedCounter
+    {
+        const char *name;
+        atomic<int64_t> value{0};
+        explicit NamedCounter(const char *name) : name(name) {}
+    };
+    mutex registryMutex; // Only taken when a site registers and when sampling or dumping
+    vector<unique_ptr<LatencyHistogram>> histograms;
+    vector<unique_ptr<NamedCounter>> counters;
+};
+
+class TraceScope // Records one span on destruction
+{
+public:
+    TraceScope(const char *name, LatencyHistogram &histogram) : name(name), histogram(histogram), start(traceNowNs()) {}
+
+    ~TraceScope()
+    {
+        uint64_t duration = traceNowNs() - start;
+        histogram.add(duration);
+        Tracer::instance().ring.push({name, start, duration, 0, traceThreadId(), 'X'});
+    }
+
+private:
+    const char *name;
+    LatencyHistogram &histogram;
+    uint64_t start;
+};
+
+inline void tracePresented(const char *name, LatencyHistogram &histogram)
+{
+    uint64_t input = Tracer::instance().pendingInputNs.exchange(0);
+    if (!input)
+        return;
+    uint64_t now = traceNowNs();
+    histogram.add(now - input);
+    Tracer::instance().ring.push({name, input, now - input, 0, traceThreadId(), 'X'});
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name)                                                                              \
+    static LatencyHistogram &TRACE_CONCAT(traceHistogram, __LINE__) = Tracer::instance().histogram(name); \
+    TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, TRACE_CONCAT(traceHistogram, __LINE__))
+#define TRACE_COUNT(name)                                                                                   \
+    do                                                                                                      \
+    {                                                                                                       \
+        static atomic<int64_t> &traceCounter = Tracer::instance().counter(name);                            \
+        traceCounter.fetch_add(1, memory_order_relaxed);                                                    \
+    } while (0)
+#define TRACE_INPUT() Tracer::instance().pendingInputNs.store(traceNowNs())
+#define TRACE_PRESENTED(name)                                                                          \
+    do                                                                                                 \
+    {                                                                                                  \
+        static LatencyHistogram &traceHistogram = Tracer::instance().histogram(name);                 \
+        tracePresented(name, traceHistogram);                                                          \
+    } while (0)
+#define TRACE_FRAME_COUNTERS() Tracer::instance().sampleCounters()
+#define TRACE_DUMP() Tracer::instance().dump()
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_COUNT(name) \
+    do                    \
+    {                     \
+    } while (0)
+#define TRACE_INPUT() \
+    do                \
+    {                 \
+    } while (0)
+#define TRACE_PRESENTED(name) \
+    do                        \
+    {                         \
+    } while (0)
+#define TRACE_FRAME_COUNTERS() \
+    do                         \
+    {                          \
+    } while (0)
+#define TRACE_DUMP() \
+    do               \
+    {                \
+    } while (0)
+
+#endif